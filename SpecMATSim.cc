@@ -1,8 +1,17 @@
 /// \file SpecMATSim.cc
 /// \brief Main program of the SpecMATSim
+///
+/// Also built as the headless SpecMATSimBatch with SPECMATSIM_HEADLESS,
+/// without the UI and Vis drivers.
+
+#ifdef SPECMATSIM_HEADLESS
+#undef G4VIS_USE
+#undef G4UI_USE
+#endif
 
 #include "G4RunManager.hh"
 #include "G4UImanager.hh"
+#include "G4UIcommand.hh"
 
 #include "Randomize.hh"
 
@@ -12,6 +21,18 @@
 #include "SpecMATSimRunAction.hh"
 #include "SpecMATSimEventAction.hh"
 #include "SpecMATSimStackingAction.hh"
+#include "SpecMATSimSteppingAction.hh"
+#include "SpecMATSimAnalysis.hh"
+#include "SpecMATSimPhases.hh"
+#include "SpecMATSimVariants.hh"
+#include "SpecMATSimOptimiser.hh"
+#include "SpecMATSimResultCache.hh"
+#include "SpecMATSimRunManager.hh"
+#include "SpecMATSimUtils.hh"
+
+#include <unistd.h>
+#include <cstdlib>
+#include <vector>
 
 #ifdef G4VIS_USE
 #include "G4VisExecutive.hh"
@@ -23,53 +44,294 @@
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+namespace {
+
+  void PrintUsage()
+  {
+    G4cerr << " Usage: SpecMATSim [options] [macro]\n"
+           << "  -m <macro>   execute the macro\n"
+           << "  -n <events>  run this number of events after the macro\n"
+           << "  -t <threads> number of worker processes of the event loop\n"
+           << "  -s <seed>    seed of the random engine\n"
+           << "  -R           reproducible: every event seeded from the seed and its number\n"
+           << "  -e <event>   number of the first event, for shards of one run, implies -R\n"
+           << "  -r <events>  replay these events of a -R run with the same seed, e.g. 37,1020-1022,\n"
+           << "               verbose and with trajectories, with -V through vis.mac\n"
+           << "  -o <name>    base name of the output files\n"
+           << "  -f <format>  output format of the histograms and the ntuple\n"
+           << "  -v <level>   0 - silent, 1 - progress, 2 - every event (default)\n"
+           << "  -V           start the visualisation in batch mode too\n"
+           << "  -S <source>  gamma, ion, inFlight, gammaGrid, opticalScan or phaseSpace instead of the default source\n"
+           << "  -L <file>    weight the deposits with the light collection map of the file\n"
+           << "  -c <file>    run the geometry variants of the file with shared event seeds, needs -n\n"
+           << "  -O <file>    optimise the layout over the parameters of the file, -t runs\n"
+           << "               candidates in parallel\n"
+           << " Without macro and events an interactive session is started."
+           << G4endl;
+  }
+
+  // Runs the listed events of a reproducible run again, in one process,
+  // with every step printed and the trajectories stored; the outputs are
+  // named <name>_replay so that those of the run are kept
+  void Replay(SpecMATSimRunManager* runManager, SpecMATSimPrimaryGeneratorAction* generator,
+              SpecMATSimRunAction* runAction, SpecMATSimEventAction* eventAction,
+              const std::vector<G4int>& events, long seed, const G4String& outputName,
+              G4bool vis)
+  {
+    if (generator->GetSource() == "phaseSpace") {
+      G4cerr << "Phase-space events are read in sequence and cannot be replayed." << G4endl;
+      return;
+    }
+
+    G4cout << "Replaying " << events.size() << " events of the run with seed " << seed << G4endl;
+    for (size_t i = 0; i < events.size(); i++) {
+      long seeds[2];
+      SpecMATSimUtils::EventSeeds(seed, events[i], seeds);
+      G4cout << "  event " << events[i] << ": /random/setSeeds " << seeds[0] << " " << seeds[1] << G4endl;
+    }
+
+    G4UImanager* UImanager = G4UImanager::GetUIpointer();
+    if (vis) UImanager->ApplyCommand("/control/execute vis.mac");
+    UImanager->ApplyCommand("/tracking/verbose 1");
+    UImanager->ApplyCommand("/tracking/storeTrajectory 2");
+    eventAction->SetVerboseLevel(2);
+    runManager->SetNbWorkers(1);
+    runAction->SetOutputName((outputName != "" ? outputName + "_" : G4String("")) + "replay");
+    generator->SetEventSeeding(true, seed);
+    generator->SetEventList(events);
+
+    runManager->BeamOn(G4int(events.size()));
+
+    generator->SetEventList(std::vector<G4int>());
+    generator->SetEventSeeding(false);
+    runAction->SetOutputName(outputName);
+  }
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 int main(int argc,char** argv)
 {
+  // Command line options
+  //
+  G4String macro;
+  G4int nbEvents = -1;
+  G4int nbThreads = 1;
+  G4bool seedSet = false;
+  long seed = 0;
+  G4bool reproducible = false;
+  G4int firstEvent = 0;
+  G4String replayList;
+  G4String outputName;
+  G4String format = "root";
+  G4int verbose = 2;
+  G4bool batchVis = false;
+  G4String source;
+  G4String lightMapFile;
+  G4String variantsFile;
+  G4String optimiseFile;
+
+  G4int option;
+  while ((option = getopt(argc, argv, "m:n:t:s:Re:r:o:f:v:VS:L:c:O:h")) != -1) {
+    switch (option) {
+      case 'm': macro = optarg; break;
+      case 'n': nbEvents = std::atoi(optarg); break;
+      case 't': nbThreads = std::atoi(optarg); break;
+      case 's': seed = std::atol(optarg); seedSet = true; break;
+      case 'R': reproducible = true; break;
+      case 'e': firstEvent = std::atoi(optarg); reproducible = true; break;
+      case 'r': replayList = optarg; break;
+      case 'o': outputName = optarg; break;
+      case 'f': format = optarg; break;
+      case 'v': verbose = std::atoi(optarg); break;
+      case 'V': batchVis = true; break;
+      case 'S': source = optarg; break;
+      case 'L': lightMapFile = optarg; break;
+      case 'c': variantsFile = optarg; break;
+      case 'O': optimiseFile = optarg; break;
+      default:
+        PrintUsage();
+        return 1;
+    }
+  }
+  if (optind < argc && macro == "") {
+    macro = argv[optind];
+  }
+  if (variantsFile != "" && nbEvents <= 0) {
+    G4cerr << "Correlated variants need a number of events (-n)." << G4endl;
+    PrintUsage();
+    return 1;
+  }
+  if (optimiseFile != "" && (nbEvents >= 0 || variantsFile != "" || reproducible)) {
+    G4cerr << "An optimisation sets its own events, it cannot be combined with -n, -c, -R or -e." << G4endl;
+    PrintUsage();
+    return 1;
+  }
+  if (firstEvent < 0) {
+    G4cerr << "The first event cannot be negative." << G4endl;
+    PrintUsage();
+    return 1;
+  }
+  std::vector<G4int> replayEvents;
+  if (replayList != "" && !SpecMATSimUtils::ParseEventList(replayList, replayEvents)) {
+    G4cerr << "Cannot read the events to replay from " << replayList << G4endl;
+    PrintUsage();
+    return 1;
+  }
+  if (replayList != "" && (nbEvents >= 0 || variantsFile != "" || optimiseFile != "")) {
+    G4cerr << "A replay runs its own events, it cannot be combined with -n, -c or -O." << G4endl;
+    PrintUsage();
+    return 1;
+  }
+  if (outputName.size() > 5 && outputName.substr(outputName.size()-5) == ".root") {
+    outputName = outputName.substr(0, outputName.size()-5);
+  }
+
   // Choose the Random engine
   //
   CLHEP::HepRandom::setTheEngine(new CLHEP::RanecuEngine);
+  if (seedSet) {
+    CLHEP::HepRandom::setTheSeed(seed);
+  }
      
   // Construct the default run manager
   //
-  G4RunManager * runManager = new G4RunManager;
+  SpecMATSimRunManager * runManager = new SpecMATSimRunManager;
 
   // Set mandatory initialization classes
   //
-  runManager->SetUserInitialization(new SpecMATSimDetectorConstruction);
+  SpecMATSimDetectorConstruction* detector = new SpecMATSimDetectorConstruction;
+  if (lightMapFile != "") {
+    detector->SetLightCollection("map");
+    detector->SetLightMapFile(lightMapFile);
+  }
+  runManager->SetUserInitialization(detector);
   //
-  runManager->SetUserInitialization(new SpecMATSimPhysicsList);
+  // optical physics is only needed to tabulate the light collection map
+  G4bool lightTabulation = (detector->GetLightCollection() == "tabulate");
+  SpecMATSimPhysicsList* physicsList = new SpecMATSimPhysicsList(lightTabulation);
+  runManager->SetUserInitialization(physicsList);
     
   // Set user action classes
   //
-  runManager->SetUserAction(new SpecMATSimPrimaryGeneratorAction);
+  SpecMATSimPrimaryGeneratorAction* generator = new SpecMATSimPrimaryGeneratorAction;
+  if (source != "") {
+    generator->SetSource(source);
+  }
+  runManager->SetUserAction(generator);
   //
   SpecMATSimRunAction* runAction = new SpecMATSimRunAction();
+  runAction->SetOutputName(outputName);
+  runAction->SetPhysicsList(physicsList);
   runManager->SetUserAction(runAction);
   //
-  runManager->SetUserAction(new SpecMATSimEventAction(runAction));
+  SpecMATSimEventAction* eventAction = new SpecMATSimEventAction(runAction);
+  eventAction->SetVerboseLevel(verbose);
+  runManager->SetUserAction(eventAction);
   //
   runManager->SetUserAction(new SpecMATSimStackingAction);  
+  //
+  // also counts or kills the particles leaving the tracking envelope
+  if (lightTabulation || detector->GetEnvelope() != "off") {
+    runManager->SetUserAction(new SpecMATSimSteppingAction(eventAction, runAction));
+  }
   
+  // The kernel of Geant4 9.6 is sequential, the event loop is shared by
+  // worker processes instead; every event is seeded from its number so
+  // that the result does not depend on the number of workers. The same
+  // seeding in one process, or in shards starting at their first event,
+  // gives the same spectra and ntuple rows. An optimisation shares the
+  // workers between its candidates itself.
+  //
+  if (nbThreads > 1 && optimiseFile == "") {
+    runManager->SetNbWorkers(nbThreads);
+  }
+  if (nbThreads > 1 || reproducible) {
+    generator->SetEventSeeding(true, seed, firstEvent);
+  }
+
+  // Histograms and ntuple use the analysis technology selected at compile
+  // time in SpecMATSimAnalysis.hh
+  //
+  G4String analysisType = G4AnalysisManager::Instance()->GetType();
+  analysisType.toLower();
+  format.toLower();
+  if (format != analysisType) {
+    G4cerr << "Output format " << format << " is not available, SpecMATSim was built with "
+           << analysisType << " output." << G4endl;
+    delete runManager;
+    return 1;
+  }
+
   // Initialize G4 kernel
   //
+  SpecMATSimPhases::Instance()->Start("initialize");
   runManager->Initialize();
+  SpecMATSimPhases::Instance()->Stop("initialize");
   
+  G4bool batchMode = (macro != "" || nbEvents >= 0 || replayList != "" || optimiseFile != "");
+
+  G4bool visStarted = false;
 #ifdef G4VIS_USE
-  // Initialize visualization
-  G4VisManager* visManager = new G4VisExecutive;
-  // G4VisExecutive can take a verbosity argument - see /vis/verbose guidance.
-  // G4VisManager* visManager = new G4VisExecutive("Quiet");
-  visManager->Initialize();
+  // Initialize visualization, only for interactive sessions unless asked for:
+  // the graphics systems cost startup time and memory in batch jobs
+  G4VisManager* visManager = 0;
+  if (!batchMode || batchVis) {
+    visManager = new G4VisExecutive;
+    visStarted = true;
+    // G4VisExecutive can take a verbosity argument - see /vis/verbose guidance.
+    // G4VisManager* visManager = new G4VisExecutive("Quiet");
+    visManager->Initialize();
+  }
+#else
+  if (batchVis) {
+    G4cerr << "Built without visualisation, -V is ignored." << G4endl;
+  }
 #endif
 
   // Get the pointer to the User Interface manager
   G4UImanager* UImanager = G4UImanager::GetUIpointer();
+  UImanager->ApplyCommand("/control/verbose "+G4UIcommand::ConvertToString(verbose));
+  UImanager->ApplyCommand("/run/verbose "+G4UIcommand::ConvertToString(verbose));
 
-  if (argc!=1)   // batch mode
+  if (batchMode)   // batch mode
     {
-      G4String command = "/control/execute ";
-      G4String fileName = argv[1];
-      UImanager->ApplyCommand(command+fileName);
+      if (macro != "") {
+        G4String command = "/control/execute ";
+        UImanager->ApplyCommand(command+macro);
+      }
+      if (replayList != "") {
+        Replay(runManager, generator, runAction, eventAction, replayEvents, seed,
+               outputName, visStarted);
+      }
+      else if (variantsFile != "") {
+        SpecMATSimVariants variants(detector, generator, runAction);
+        if (variants.Read(variantsFile)) {
+          variants.Run(nbEvents, seed, outputName);
+        }
+      }
+      else if (optimiseFile != "") {
+        SpecMATSimOptimiser optimiser(detector, generator, runAction);
+        if (optimiser.Read(optimiseFile)) {
+          optimiser.Run(nbThreads, seed, outputName);
+        }
+      }
+      else if (nbEvents >= 0 && runAction->GetResultCache() == "yes" && firstEvent == 0) {
+        SpecMATSimResultCache resultCache(runAction, generator, physicsList);
+        resultCache.BeamOn(nbEvents, seed);
+      }
+      else if (nbEvents >= 0) {
+        runManager->BeamOn(nbEvents);
+      }
+#ifdef G4UI_USE
+      // the replayed events stay on screen until the session is closed
+      if (replayList != "" && visStarted) {
+        G4UIExecutive* ui = new G4UIExecutive(argc, argv);
+        ui->SessionStart();
+        delete ui;
+      }
+#endif
     }
   else
     {  // interactive mode : define UI session
@@ -82,6 +344,9 @@ int main(int argc,char** argv)
 */
       ui->SessionStart();
       delete ui;
+#else
+      G4cerr << "Built without UI drivers, give a macro or a number of events." << G4endl;
+      PrintUsage();
 #endif
     }
 
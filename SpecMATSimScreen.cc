@@ -0,0 +1,88 @@
+/// \file SpecMATSimScreen.cc
+/// \brief Screening of detector layouts with the geometry-only efficiency estimator
+
+#include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimVariants.hh"
+#include "SpecMATSimEfficiencyEstimator.hh"
+
+#include "G4GeometryManager.hh"
+#include "G4Timer.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  // Usage: SpecMATSimScreen <layouts file> [energy keV] [rays] [workers] [seed]
+  G4String layoutsFile = (argc > 1) ? argv[1] : "";
+  G4double energy = ((argc > 2) ? std::atof(argv[2]) : 1000.)*keV;
+  G4long nbRays = (argc > 3) ? std::atol(argv[3]) : 20000;
+  G4int nbWorkers = (argc > 4) ? std::atoi(argv[4]) : 4;
+  long seed = (argc > 5) ? std::atol(argv[5]) : 1;
+  if (layoutsFile == "" || energy <= 0. || nbRays < 1 || nbWorkers < 1) {
+    G4cerr << " Usage: SpecMATSimScreen <layouts file> [energy keV] [rays] [workers] [seed]" << G4endl;
+    return 1;
+  }
+
+  // The layouts have the format of the correlated variants file; without
+  // the overlap check a layout is built in milliseconds
+  SpecMATSimDetectorConstruction detector;
+  detector.SetCheckOverlaps(false);
+  // A geometry read from GDML is the same world for every layout
+  if (detector.GetGdmlGeometry() == "read") {
+    G4cerr << " The layouts cannot be screened with gdmlGeometry \"read\", use \"no\" or \"cache\"" << G4endl;
+    return 1;
+  }
+  SpecMATSimVariants layouts(&detector, 0, 0);
+  if (!layouts.Read(layoutsFile)) return 1;
+
+  SpecMATSimEfficiencyEstimator estimator(energy);
+  estimator.SetNbWorkers(nbWorkers);
+
+  std::ofstream csv("SpecMATSimScreen.csv");
+  csv << "layout,crystals,rays,geometric,geometric_err,first_interaction,first_interaction_err,transmission,seconds\n";
+  G4cout
+     << "\n--------------------Layout screening------------------------\n"
+     << " " << energy/keV << " keV gammas from the origin, " << nbRays << " rays per layout, "
+     << nbWorkers << " workers, seed " << seed << "\n"
+     << std::setw(20) << "layout" << std::setw(9) << "crystals"
+     << std::setw(20) << "geometric [%]" << std::setw(24) << "first interaction [%]"
+     << std::setw(14) << "transmission" << std::setw(10) << "time [s]\n";
+
+  G4Timer timer;
+  timer.Start();
+  for (size_t i = 0; i < layouts.GetNbVariants(); i++) {
+    detector.ClearGeometry();
+    layouts.Apply(i);
+    G4VPhysicalVolume* world = detector.Construct();
+    G4GeometryManager::GetInstance()->CloseGeometry(true);
+
+    SpecMATSimEfficiencyEstimator::Result r
+      = estimator.Estimate(world, detector.GetSciCrystMat(), nbRays, seed);
+    G4int crystals = G4int(detector.GetNbSegments()*detector.GetNbCrystInSegmentRow()
+                           *detector.GetNbCrystInSegmentColumn());
+    G4cout << std::setw(20) << layouts.GetName(i) << std::setw(9) << crystals
+           << std::setw(11) << 100.*r.geometric << " +- " << std::setw(5) << std::setprecision(2) << 100.*r.geometricError
+           << std::setprecision(6)
+           << std::setw(15) << 100.*r.firstInteraction << " +- " << std::setw(5) << std::setprecision(2) << 100.*r.firstInteractionError
+           << std::setprecision(6)
+           << std::setw(14) << r.transmission << std::setw(9) << r.seconds << "\n";
+    csv << layouts.GetName(i) << "," << crystals << "," << r.rays << ","
+        << r.geometric << "," << r.geometricError << ","
+        << r.firstInteraction << "," << r.firstInteractionError << ","
+        << r.transmission << "," << r.seconds << "\n";
+  }
+  timer.Stop();
+  G4cout << " " << layouts.GetNbVariants() << " layouts in " << timer.GetRealElapsed() << " s"
+         << ", written to SpecMATSimScreen.csv"
+         << "\n------------------------------------------------------------\n"
+         << G4endl;
+
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
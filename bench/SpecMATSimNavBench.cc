@@ -0,0 +1,147 @@
+/// \file SpecMATSimNavBench.cc
+/// \brief Navigation benchmark of the boolean and nested cell geometries
+
+#include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimRayCaster.hh"
+
+#include "G4Timer.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+#include "G4Material.hh"
+#include "Randomize.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdlib>
+#include <map>
+#include <vector>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+namespace {
+
+  typedef std::map<G4String, G4double> Budget;
+
+  struct BenchResult {
+    G4double seconds;
+    G4long nbSteps;
+    std::vector<G4double> rayBudgets;   // areal density along every ray
+    Budget pathLengths;                 // summed over all rays, per material
+  };
+
+  G4double ArealDensity(const Budget& pathLengths)
+  {
+    G4double density = 0.;
+    Budget::const_iterator it;
+    for (it = pathLengths.begin(); it != pathLengths.end(); it++) {
+      density += G4Material::GetMaterial(it->first)->GetDensity()*it->second;
+    }
+    return density;
+  }
+
+  BenchResult CastRays(G4VPhysicalVolume* world, const G4ThreeVector& origin,
+                       const std::vector<G4ThreeVector>& directions)
+  {
+    SpecMATSimRayCaster caster(world);
+    BenchResult result;
+    result.nbSteps = 0;
+    result.rayBudgets.reserve(directions.size());
+
+    G4Timer timer;
+    timer.Start();
+    for (size_t i = 0; i < directions.size(); i++) {
+      Budget pathLengths;
+      result.nbSteps += caster.Cast(origin, directions[i], pathLengths);
+      result.rayBudgets.push_back(ArealDensity(pathLengths));
+      Budget::const_iterator it;
+      for (it = pathLengths.begin(); it != pathLengths.end(); it++) {
+        result.pathLengths[it->first] += it->second;
+      }
+    }
+    timer.Stop();
+    result.seconds = timer.GetRealElapsed();
+    return result;
+  }
+
+  // equal up to rounding of the navigation
+  G4bool Same(G4double a, G4double b, G4double absolute)
+  {
+    return std::fabs(a - b) <= absolute + 1e-9*std::max(std::fabs(a), std::fabs(b));
+  }
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  // Usage: SpecMATSimNavBench [rays] [seed]
+  G4int nbRays = (argc > 1) ? std::atoi(argv[1]) : 100000;
+  long seed = (argc > 2) ? std::atol(argv[2]) : 12345;
+  if (nbRays < 1) {
+    G4cerr << " Usage: SpecMATSimNavBench [rays] [seed]" << G4endl;
+    return 1;
+  }
+
+  // Both geometries are built with the parameters of the simulation
+  SpecMATSimDetectorConstruction booleanDetector;
+  booleanDetector.SetCellGeometry("boolean");
+  G4VPhysicalVolume* booleanWorld = booleanDetector.Construct();
+
+  SpecMATSimDetectorConstruction nestedDetector;
+  nestedDetector.SetCellGeometry("nested");
+  G4VPhysicalVolume* nestedWorld = nestedDetector.Construct();
+
+  // Identical isotropic rays from the centre of the array
+  CLHEP::HepJamesRandom engine(seed);
+  std::vector<G4ThreeVector> directions(nbRays);
+  for (G4int i = 0; i < nbRays; i++) {
+    G4double cosTheta = 2.*engine.flat() - 1.;
+    G4double sinTheta = std::sqrt(1. - cosTheta*cosTheta);
+    G4double phi = twopi*engine.flat();
+    directions[i] = G4ThreeVector(sinTheta*std::cos(phi), sinTheta*std::sin(phi), cosTheta);
+  }
+  G4ThreeVector origin(0., 0., 0.);
+
+  BenchResult booleanResult = CastRays(booleanWorld, origin, directions);
+  BenchResult nestedResult = CastRays(nestedWorld, origin, directions);
+
+  G4int nbMismatches = 0;
+  for (G4int i = 0; i < nbRays; i++) {
+    if (!Same(booleanResult.rayBudgets[i], nestedResult.rayBudgets[i], 1e-9*g/cm2)) nbMismatches++;
+  }
+
+  G4cout
+     << "\n--------------------Navigation benchmark--------------------\n"
+     << " Rays: " << nbRays << ", seed: " << seed << "\n"
+     << " boolean: " << booleanResult.seconds << " s, "
+     << booleanResult.nbSteps << " steps\n"
+     << " nested:  " << nestedResult.seconds << " s, "
+     << nestedResult.nbSteps << " steps\n";
+  if (nestedResult.seconds > 0.) {
+    G4cout << " Speedup: " << booleanResult.seconds/nestedResult.seconds << "\n";
+  }
+
+  // Material budget summed over all rays
+  G4cout << " Path length per material [mm]  boolean  nested\n";
+  Budget materials = booleanResult.pathLengths;
+  materials.insert(nestedResult.pathLengths.begin(), nestedResult.pathLengths.end());
+  Budget::const_iterator it;
+  for (it = materials.begin(); it != materials.end(); it++) {
+    G4double booleanLength = booleanResult.pathLengths[it->first];
+    G4double nestedLength = nestedResult.pathLengths[it->first];
+    G4cout << "  " << it->first << "  " << booleanLength/mm << "  " << nestedLength/mm << "\n";
+    if (!Same(booleanLength, nestedLength, 1e-9*mm*nbRays)) nbMismatches++;
+  }
+
+  G4cout << " Total areal density [g/cm2]: "
+         << ArealDensity(booleanResult.pathLengths)/(g/cm2) << "  "
+         << ArealDensity(nestedResult.pathLengths)/(g/cm2) << "\n"
+         << " Material budget mismatches: " << nbMismatches
+         << "\n------------------------------------------------------------\n"
+         << G4endl;
+
+  return (nbMismatches == 0) ? 0 : 2;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
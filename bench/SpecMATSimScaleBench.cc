@@ -0,0 +1,162 @@
+/// \file SpecMATSimScaleBench.cc
+/// \brief Scaling benchmark of the geometry with the size of the array
+
+#include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimRayCaster.hh"
+#include "SpecMATSimPhases.hh"
+#include "SpecMATSimUtils.hh"
+
+#include "G4GeometryManager.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4Timer.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include <cmath>
+#include <cstdlib>
+#include <fstream>
+#include <iomanip>
+#include <vector>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+namespace {
+
+  // segments, crystals along the axis (rings), crystals across a segment
+  struct ArraySize {
+    G4int segments;
+    G4int rows;
+    G4int columns;
+  };
+
+  // From the current array up to thousands of crystals; the rows stay
+  // within the length of the chamber flanges
+  const ArraySize arraySizes[] = {
+    { 6, 3, 4},   //   72, the current array
+    { 8, 4, 4},   //  128
+    {12, 4, 6},   //  288
+    {16, 6, 6},   //  576
+    {24, 6, 8},   // 1152
+    {32, 8, 8},   // 2048
+    {48, 8, 10},  // 3840
+    {64, 10, 10}, // 6400
+    {96, 10, 12}  // 11520
+  };
+  const G4int nbArraySizes = sizeof(arraySizes)/sizeof(arraySizes[0]);
+
+  struct BenchResult {
+    G4int crystals;
+    G4int placements;
+    G4double constructSeconds;
+    G4double overlapSeconds;
+    G4double voxelSeconds;
+    G4double voxelMB;
+    G4double rssMB;
+    G4double raysPerSecond;
+    G4double stepsPerRay;
+  };
+
+  G4double MB(G4long bytes) { return bytes/1048576.; }
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+int main(int argc, char** argv)
+{
+  // Usage: SpecMATSimScaleBench [max crystals] [rays] [seed]
+  G4int maxCrystals = (argc > 1) ? std::atoi(argv[1]) : 4000;
+  G4int nbRays = (argc > 2) ? std::atoi(argv[2]) : 100000;
+  long seed = (argc > 3) ? std::atol(argv[3]) : 12345;
+  if (maxCrystals < 1 || nbRays < 1) {
+    G4cerr << " Usage: SpecMATSimScaleBench [max crystals] [rays] [seed]" << G4endl;
+    return 1;
+  }
+
+  // The same isotropic rays from the centre of the array for every size
+  CLHEP::HepJamesRandom engine(seed);
+  std::vector<G4ThreeVector> directions(nbRays);
+  for (G4int i = 0; i < nbRays; i++) {
+    G4double cosTheta = 2.*engine.flat() - 1.;
+    G4double sinTheta = std::sqrt(1. - cosTheta*cosTheta);
+    G4double phi = twopi*engine.flat();
+    directions[i] = G4ThreeVector(sinTheta*std::cos(phi), sinTheta*std::sin(phi), cosTheta);
+  }
+  G4ThreeVector origin(0., 0., 0.);
+
+  // One detector is rebuilt for every size, with the overlap check of the
+  // simulation; the sizes grow, so the memory of a size is mostly new
+  SpecMATSimDetectorConstruction detector;
+  SpecMATSimPhases* phases = SpecMATSimPhases::Instance();
+  std::vector<BenchResult> results;
+  for (G4int i = 0; i < nbArraySizes; i++) {
+    const ArraySize& size = arraySizes[i];
+    BenchResult result;
+    result.crystals = size.segments*size.rows*size.columns;
+    if (result.crystals > maxCrystals) break;
+
+    detector.ClearGeometry();
+    detector.SetNbSegments(size.segments);
+    detector.SetNbCrystInSegmentRow(size.rows);
+    detector.SetNbCrystInSegmentColumn(size.columns);
+
+    G4double geometryBefore = phases->GetWallTime("geometry");
+    G4double overlapsBefore = phases->GetWallTime("overlaps");
+    G4VPhysicalVolume* world = detector.Construct();
+    result.constructSeconds = phases->GetWallTime("geometry") - geometryBefore;
+    result.overlapSeconds = phases->GetWallTime("overlaps") - overlapsBefore;
+    result.placements = G4int(G4PhysicalVolumeStore::GetInstance()->size());
+
+    // Voxelisation, as done at the start of a run
+    G4long rssBefore = SpecMATSimUtils::CurrentRSS();
+    G4Timer timer;
+    timer.Start();
+    G4GeometryManager::GetInstance()->CloseGeometry(true);
+    timer.Stop();
+    result.voxelSeconds = timer.GetRealElapsed();
+    result.rssMB = MB(SpecMATSimUtils::CurrentRSS());
+    result.voxelMB = MB(SpecMATSimUtils::CurrentRSS() - rssBefore);
+
+    SpecMATSimRayCaster caster(world);
+    G4long nbSteps = 0;
+    timer.Start();
+    for (G4int j = 0; j < nbRays; j++) {
+      std::map<G4String, G4double> pathLengths;
+      nbSteps += caster.Cast(origin, directions[j], pathLengths);
+    }
+    timer.Stop();
+    result.raysPerSecond = (timer.GetRealElapsed() > 0.) ? nbRays/timer.GetRealElapsed() : 0.;
+    result.stepsPerRay = G4double(nbSteps)/nbRays;
+    results.push_back(result);
+  }
+
+  // Table, and the same as CSV for plots
+  std::ofstream csv("SpecMATSimScaleBench.csv");
+  csv << "crystals,placements,construct_s,overlaps_s,voxelise_s,voxel_MB,rss_MB,rays_per_s,steps_per_ray\n";
+  G4cout
+     << "\n--------------------Scaling benchmark-----------------------\n"
+     << " Rays: " << nbRays << ", seed: " << seed << "\n"
+     << std::setw(9) << "crystals" << std::setw(11) << "volumes"
+     << std::setw(12) << "build [s]" << std::setw(13) << "overlaps [s]"
+     << std::setw(11) << "voxel [s]" << std::setw(12) << "voxel [MB]"
+     << std::setw(10) << "RSS [MB]" << std::setw(11) << "rays/s" << std::setw(11) << "steps/ray\n";
+  for (size_t i = 0; i < results.size(); i++) {
+    const BenchResult& r = results[i];
+    G4cout << std::setw(9) << r.crystals << std::setw(11) << r.placements
+           << std::setw(12) << r.constructSeconds << std::setw(13) << r.overlapSeconds
+           << std::setw(11) << r.voxelSeconds << std::setw(12) << r.voxelMB
+           << std::setw(10) << r.rssMB << std::setw(11) << r.raysPerSecond
+           << std::setw(11) << r.stepsPerRay << "\n";
+    csv << r.crystals << "," << r.placements << "," << r.constructSeconds << ","
+        << r.overlapSeconds << "," << r.voxelSeconds << "," << r.voxelMB << ","
+        << r.rssMB << "," << r.raysPerSecond << "," << r.stepsPerRay << "\n";
+  }
+  G4cout << " Written to SpecMATSimScaleBench.csv"
+         << "\n------------------------------------------------------------\n"
+         << G4endl;
+
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
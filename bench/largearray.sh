@@ -0,0 +1,81 @@
+#!/bin/bash
+# Checks that layouts with more crystals than the default 6x3x4 array run
+# cleanly as geometry variants and as optimisation candidates.
+# Run from the build directory, e.g.
+#   bench/largearray.sh 2000 12345
+# Both runs rebuild the geometry in the process. The summary of every run
+# must report the crystal count of its layout and hits; a spectrum sized
+# for another layout stops the run with SpecMATSim012.
+EVENTS=${1:-1000}
+SEED=${2:-12345}
+EXE=${EXE:-./SpecMATSimBatch}
+DIR=largearray
+
+if [ ! -x "$EXE" ]; then
+    echo "$EXE is not built"
+    exit 1
+fi
+mkdir -p $DIR
+
+# value of a key of the "results" line of a summary
+function result {
+    grep '"results"' $1 | sed -e "s/.*\"$2\": \"*\([0-9a-f]*\).*/\1/"
+}
+
+# summary, expected crystal count, then the name of the layout
+status=0
+function check {
+    if [ ! -f $1 ]; then
+        echo "  $3: no summary $1"
+        status=1
+        return
+    fi
+    crystals=$(result $1 crystals)
+    hits=$(result $1 hits)
+    printf "%-24s %4s crystals %8s hits\n" $3 $crystals $hits
+    if [ "$crystals" != "$2" ] || [ "$hits" == "0" ]; then
+        echo "  $3: expected $2 crystals with hits"
+        status=1
+    fi
+}
+
+# name, then the options of the run
+function run {
+    name=$1
+    shift
+    if ! $EXE -v 0 -s $SEED -o $DIR/$name "$@" > $DIR/$name.log 2>&1; then
+        echo "$name failed, see $DIR/$name.log"
+        exit 1
+    fi
+}
+
+cat > $DIR/large.variants <<END
+reference
+segments8   nbSegments=8
+rows5       nbSegments=8 nbCrystInSegmentRow=5
+END
+run variants -c $DIR/large.variants -n $EVENTS -t 2
+check $DIR/variants_reference_summary.json 72 reference
+check $DIR/variants_segments8_summary.json 96 segments8
+check $DIR/variants_rows5_summary.json 160 rows5
+
+cat > $DIR/large.optimise <<END
+parameter   nbSegments 6 8
+parameter   nbCrystInSegmentRow 3 5
+parameter   sciCrystMat CeBr3 LaBr3
+energy      1000
+events      $EVENTS
+reduction   2
+END
+run optimise -O $DIR/large.optimise -t 2
+for candidate in 0 1 2 3 4 5 6 7; do
+    summary=$DIR/optimise_candidate000${candidate}_summary.json
+    [ -f $summary ] || continue
+    # nbSegments varies fastest, then the rows
+    check $summary $(( (candidate % 2 ? 8 : 6) * ((candidate / 2) % 2 ? 5 : 3) * 4 )) candidate000$candidate
+done
+
+if [ $status == 0 ]; then
+    echo "Large arrays: all layouts ran with their crystal counts"
+fi
+exit $status
@@ -0,0 +1,59 @@
+#!/bin/bash
+# Profile-guided and link-time optimised build of SpecMATSimBatch, e.g.
+#   bench/pgo.sh path_to_SpecMATscint [work directory] [benchmark events]
+# 1. builds an instrumented SpecMATSimBatch in <work>/pgo
+# 2. runs bench/training.in with the gamma and the Co-60 (ion) source
+# 3. rebuilds it in the same directory with the profiles and LTO
+# 4. builds a plain release version in <work>/plain and compares events/s
+# Extra CMake arguments, e.g. -DGeant4_DIR=... or -DSPECMATSIM_UNITY=ON,
+# are taken from CMAKE_ARGS.
+set -e
+SRC=$(cd "${1:?give the source directory}" && pwd)
+WORK=${2:-pgo-work}
+EVENTS=${3:-20000}
+JOBS=$(nproc 2> /dev/null || echo 2)
+mkdir -p "$WORK/pgo" "$WORK/plain"
+WORK=$(cd "$WORK" && pwd)
+PROFILES=$WORK/profiles
+
+# build directory, then extra CMake arguments
+function build {
+    dir=$1
+    shift
+    (cd "$dir" && cmake "$SRC" -DCMAKE_BUILD_TYPE=Release -DWITH_GEANT4_UIVIS=OFF $CMAKE_ARGS "$@" > cmake.log \
+        && make -j$JOBS SpecMATSimBatch > make.log)
+}
+
+# build directory, source, output name
+function run {
+    (cd "$1" && ./SpecMATSimBatch -v 0 -s 12345 -S $2 -n $EVENTS -o $3 > $3.log 2>&1)
+    sed -n 's/.*"eventsPerSecond": \([0-9.eE+-]*\).*/\1/p' "$1/$3_summary.json"
+}
+
+echo "Instrumented build"
+rm -rf "$PROFILES"
+build "$WORK/pgo" -DSPECMATSIM_PGO=generate -DSPECMATSIM_PGO_DIR="$PROFILES" -DSPECMATSIM_LTO=OFF
+
+echo "Training"
+for source in gamma ion; do
+    (cd "$WORK/pgo" && ./SpecMATSimBatch -v 0 -s 1 -S $source -m bench/training.in -o train_$source > train_$source.log 2>&1)
+done
+# Clang writes raw profiles that have to be merged
+if ls "$PROFILES"/*.profraw > /dev/null 2>&1; then
+    llvm-profdata merge -output="$PROFILES/SpecMATSim.profdata" "$PROFILES"/*.profraw
+fi
+
+echo "Optimised build"
+build "$WORK/pgo" -DSPECMATSIM_PGO=use -DSPECMATSIM_PGO_DIR="$PROFILES" -DSPECMATSIM_LTO=ON
+
+echo "Plain build"
+build "$WORK/plain" -DSPECMATSIM_PGO= -DSPECMATSIM_LTO=OFF
+
+echo ""
+printf "%-8s %14s %14s %9s\n" "source" "plain ev/s" "PGO+LTO ev/s" "change"
+for source in gamma ion; do
+    plain=$(run "$WORK/plain" $source bench_$source)
+    optimised=$(run "$WORK/pgo" $source bench_$source)
+    change=$(awk -v a=$plain -v b=$optimised 'BEGIN {if (a > 0) printf "%+.1f %%", 100*(b-a)/a; else print "-"}')
+    printf "%-8s %14s %14s %9s\n" $source $plain $optimised "$change"
+done
@@ -0,0 +1,95 @@
+#!/bin/bash
+# Checks that reproducible runs do not depend on how the events are shared.
+# Run from the build directory, e.g.
+#   bench/reproducibility.sh 2000 12345
+# The same events (default 1000) and seed are run in one process, in 2, 8
+# and 64 worker processes, and as 3 shards of the event range. With the
+# light collection map of MAP (default lightCollectionMap.dat) present, 1
+# and 8 workers applying the map are compared too. The hit and
+# spectra checksums of the run summaries must agree; the checksums of the
+# shards add up (mod 2^64) to the ones of the full run. The ROOT files
+# themselves differ in their time of writing.
+EVENTS=${1:-1000}
+SEED=${2:-12345}
+EXE=${EXE:-./SpecMATSimBatch}
+DIR=reproducibility
+
+if [ ! -x "$EXE" ]; then
+    echo "$EXE is not built"
+    exit 1
+fi
+mkdir -p $DIR
+
+# value of a key of the "results" line of a summary
+function result {
+    grep '"results"' $1 | sed -e "s/.*\"$2\": \"*\([0-9a-f]*\).*/\1/"
+}
+
+# name, then the options of the run
+function run {
+    name=$1
+    shift
+    if ! $EXE -v 0 -s $SEED -R -o $DIR/$name "$@" > $DIR/$name.log 2>&1; then
+        echo "$name failed, see $DIR/$name.log"
+        exit 1
+    fi
+    printf "%-12s %8s hits  hits %s  spectra %s\n" $name \
+           $(result $DIR/${name}_summary.json hits) \
+           $(result $DIR/${name}_summary.json hitsChecksum) \
+           $(result $DIR/${name}_summary.json spectraChecksum)
+}
+
+# key, value, then the name of the runs compared with the single process
+status=0
+function compare {
+    if [ "$(result $DIR/threads1_summary.json $1)" != "$2" ]; then
+        echo "  $3: $1 differs"
+        status=1
+    fi
+}
+
+run threads1 -n $EVENTS -t 1
+for threads in 2 8 64; do
+    run threads$threads -n $EVENTS -t $threads
+    for key in hits hitsChecksum spectraChecksum; do
+        compare $key "$(result $DIR/threads${threads}_summary.json $key)" "$threads workers"
+    done
+done
+
+# The light collection map, when one has been tabulated: every worker must
+# apply it, not only the one that starts at event 0
+MAP=${MAP:-lightCollectionMap.dat}
+if [ -f "$MAP" ]; then
+    run map1 -n $EVENTS -t 1 -L $MAP
+    run map8 -n $EVENTS -t 8 -L $MAP
+    for key in hits hitsChecksum spectraChecksum; do
+        if [ "$(result $DIR/map1_summary.json $key)" != "$(result $DIR/map8_summary.json $key)" ]; then
+            echo "  8 workers with the light map: $key differs"
+            status=1
+        fi
+    done
+else
+    echo "No light collection map $MAP, the map runs are skipped"
+fi
+
+# shards of about a third of the events each, added up
+first=0
+hits=0
+hitsChecksum=0
+spectraChecksum=0
+for shard in 0 1 2; do
+    last=$((EVENTS*(shard+1)/3))
+    run shard$shard -n $((last-first)) -e $first
+    hits=$((hits + $(result $DIR/shard${shard}_summary.json hits)))
+    hitsChecksum=$((hitsChecksum + 16#$(result $DIR/shard${shard}_summary.json hitsChecksum)))
+    spectraChecksum=$((spectraChecksum + 16#$(result $DIR/shard${shard}_summary.json spectraChecksum)))
+    first=$last
+done
+compare hits $hits "3 shards"
+compare hitsChecksum $(printf "%016x" $hitsChecksum) "3 shards"
+compare spectraChecksum $(printf "%016x" $spectraChecksum) "3 shards"
+
+if [ $status == 0 ]; then
+    echo "Reproducible: all runs agree"
+fi
+exit $status
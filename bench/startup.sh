@@ -0,0 +1,41 @@
+#!/bin/bash
+# Startup time and peak memory of the interactive and the headless executable.
+# Run from the build directory, e.g.
+#   bench/startup.sh 5
+# Every executable initialises the geometry and the physics and runs no
+# events ("-n 0"), the given number of times (default 3). Needs GNU time,
+# another location can be given in TIME.
+RUNS=${1:-3}
+TIME=${TIME:-/usr/bin/time}
+
+if ! $TIME -f "%e" true > /dev/null 2>&1; then
+    echo "GNU time is needed at $TIME"
+    exit 1
+fi
+
+# name, then the command line
+function measure {
+    name=$1
+    shift
+    if [ ! -x "$1" ]; then
+        printf "%-28s not built\n" "$name"
+        return
+    fi
+    total_sec=0
+    max_kb=0
+    for ((i=0; i<RUNS; i++)); do
+        result=$($TIME -f "%e %M" "$@" -v 0 -n 0 2>&1 > /dev/null | tail -n 1)
+        sec=${result% *}
+        kb=${result#* }
+        total_sec=$(awk -v a=$total_sec -v b=$sec 'BEGIN {print a+b}')
+        if ((kb>max_kb)); then
+            max_kb=$kb
+        fi
+    done
+    printf "%-28s %8.2f s %10d kB\n" "$name" $(awk -v a=$total_sec -v n=$RUNS 'BEGIN {print a/n}') $max_kb
+}
+
+printf "%-28s %10s %13s\n" "executable ($RUNS runs)" "startup" "peak RSS"
+measure "SpecMATSim -V (vis)" ./SpecMATSim -V
+measure "SpecMATSim" ./SpecMATSim
+measure "SpecMATSimBatch" ./SpecMATSimBatch
@@ -0,0 +1,51 @@
+/// \file SpecMATSimCoincidenceMatrix.hh
+/// \brief Definition of the SpecMATSimCoincidenceMatrix class
+
+#ifndef SpecMATSimCoincidenceMatrix_h
+#define SpecMATSimCoincidenceMatrix_h 1
+
+#include "globals.hh"
+
+#include <ostream>
+#include <vector>
+
+/// Symmetric gamma-gamma matrix in blocked sparse storage.
+///
+/// The nbBins x nbBins matrix is cut into square blocks of blockSize bins.
+/// Only blocks on and above the diagonal exist and each is allocated on
+/// its first entry, so the memory follows the populated area instead of
+/// the nbBins^2 of a dense matrix. A pair of energies is stored once, with
+/// the lower energy as the x coordinate.
+
+class SpecMATSimCoincidenceMatrix
+{
+  public:
+    SpecMATSimCoincidenceMatrix(const G4String& name, G4int nbBins,
+                                G4double binWidth, G4int blockSize = 64);
+    ~SpecMATSimCoincidenceMatrix();
+
+    void Fill(G4double energy1, G4double energy2);
+
+    // Appends the non-empty blocks to a SpecMATSimCoincidences output file
+    void Write(std::ostream& out) const;
+
+    const G4String& GetName() const { return fName; }
+    G4int GetNbAllocatedBlocks() const { return fNbAllocatedBlocks; }
+    G4double GetAllocatedBytes() const;
+    G4double GetDenseBytes() const;
+
+  private:
+    G4int BlockIndex(G4int blockX, G4int blockY) const;
+
+    G4String fName;
+    G4int fNbBins;
+    G4double fBinWidth;
+    G4int fBlockSize;
+    G4int fNbBlocks;
+    G4int fNbAllocatedBlocks;
+    std::vector< std::vector<unsigned int>* > fBlocks;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
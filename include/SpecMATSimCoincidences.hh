@@ -0,0 +1,54 @@
+/// \file SpecMATSimCoincidences.hh
+/// \brief Definition of the SpecMATSimCoincidences class
+
+#ifndef SpecMATSimCoincidences_h
+#define SpecMATSimCoincidences_h 1
+
+#include "globals.hh"
+
+#include <map>
+#include <vector>
+
+class SpecMATSimCoincidenceMatrix;
+
+/// In-simulation gamma-gamma coincidence building.
+///
+/// For every event with at least two fired crystals all pairs of crystal
+/// energies are added to the "gg" matrix. Optionally:
+/// - "addback": energies of fired neighbouring crystals of a segment
+///   (sharing a side) are summed before pairing;
+/// - "gg_dSegN": separate matrices by segment distance N of the pair,
+///   0 for pairs within one segment up to nbSegments/2 for opposite ones.
+///
+/// All matrices go into one file, see Write() for the layout.
+
+class SpecMATSimCoincidences
+{
+  public:
+    SpecMATSimCoincidences(G4int nbSegments, G4int nbCrystInSegmentRow,
+                           G4int nbCrystInSegmentColumn,
+                           G4bool addBack, G4bool angleGroups);
+    ~SpecMATSimCoincidences();
+
+    // energies [keV] of the fired crystals of one event, keyed by copy number
+    void FillEvent(const std::map<G4int, G4double>& energies);
+    void Write(const G4String& fileName) const;
+
+  private:
+    G4int Segment(G4int copyNb) const;
+    G4bool AreNeighbours(G4int copyNb1, G4int copyNb2) const;
+
+    G4int fNbSegments;
+    G4int fNbCrystInSegmentRow;
+    G4int fNbCrystInSegmentColumn;
+
+    SpecMATSimCoincidenceMatrix* fMatrix;
+    SpecMATSimCoincidenceMatrix* fAddBackMatrix;
+    std::vector<SpecMATSimCoincidenceMatrix*> fAngleMatrices;
+
+    G4long fNbEvents;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -26,8 +26,13 @@
 
 #include "globals.hh"
 
+#include <map>
+#include <set>
+#include <vector>
+
 class G4VPhysicalVolume;
 class G4LogicalVolume;
+class SpecMATSimLightMap;
 
 /// Detector construction class to define materials and geometry.
 ///
@@ -36,13 +41,31 @@ class SpecMATSimDetectorConstruction : public G4VUserDetectorConstruction
 {
   private:
     void DefineMaterials();
+    void ComputeDimensions();
+    void ConstructGeometry();
+    void SetVisAttributes();
+    G4bool ReadGDML(const G4String& fileName);
+    void WriteGDML(const G4String& fileName);
+    void DefineOpticalProperties();
     void CreateScorers();
+    void ConstructNestedFlange();
+    void ConstructEnvelope();
+    // radius and half length of the segments and flanges around the beam axis
+    void ComputeArrayExtent(G4double& radius, G4double& halfZ) const;
+    G4LogicalVolume* AddFlangePiece(const G4String& name, G4double halfX, G4double halfY, G4double halfZ,
+                                    const G4ThreeVector& offset, G4LogicalVolume* pieceLog);
+    void FillCrystalTransforms(G4VPhysicalVolume* mother, const G4Transform3D& motherTransform,
+                               G4int cellCopyNb = -1);
+    void CheckOverlaps(const G4LogicalVolume* mother, std::set<const G4LogicalVolume*>& checked) const;
 
     G4double a, z, density;
     G4int natoms, ncomponents;
 
     G4double worldSizeXY;
     G4double worldSizeZ;
+    // the world that is built, enlarged for arrays that do not fit
+    G4double fWorldSizeXY;
+    G4double fWorldSizeZ;
 
     G4int nbSegments;
     G4int nbCrystInSegmentRow;
@@ -142,6 +165,8 @@ class SpecMATSimDetectorConstruction : public G4VUserDetectorConstruction
     G4LogicalVolume* vacuumFlangeBoxLog;
     G4LogicalVolume* vacuumChamberSideFlangeLog;
     G4LogicalVolume* segmentBoxLog;
+    std::vector<G4LogicalVolume*> fFlangePieces;
+    std::vector<G4ThreeVector> fFlangePieceOffsets;
 
     G4VPhysicalVolume* physWorld;
 
@@ -152,28 +177,62 @@ class SpecMATSimDetectorConstruction : public G4VUserDetectorConstruction
 
     G4bool  fCheckOverlaps;
 
+    G4String cellGeometry;
+
+    G4String lightCollection;
+    G4String lightMapFile;
+    G4int lightMapNbBinsX;
+    G4int lightMapNbBinsY;
+    G4int lightMapNbBinsZ;
+    SpecMATSimLightMap* fLightMap;
+
+    G4String digitizer;
+
+    G4String gdmlGeometry;
+    G4String gdmlFile;
+    G4String gdmlCacheDir;
+    G4bool fGeometryFromGDML;
+
+    std::map<G4int, G4Transform3D> fCrystalTransforms;
+
+    G4String envelope;
+    G4double envelopeMargin;
+    G4double envelopeThickness;
+    G4double envelopeRadius;
+    G4double envelopeHalfZ;
+    G4LogicalVolume* killShellSideLog;
+    G4LogicalVolume* killShellCapLog;
+
   public:
     SpecMATSimDetectorConstruction();
     virtual ~SpecMATSimDetectorConstruction();
 
     virtual G4VPhysicalVolume* Construct();
+    // Builds the geometry again after parameters were changed between runs
+    void UpdateGeometry();
+    // Deletes all volumes and solids, before building without a run manager
+    void ClearGeometry();
 
     G4double ComputeCircleR1();
+    // radius of the last Construct()
+    G4double GetCircleR1(void) const {return circleR1;}
+    // crystals of the array, the highest crystal copy number
+    G4int GetNbCrystals(void) const {return nbSegments*nbCrystInSegmentRow*nbCrystInSegmentColumn;}
 
     void SetNbSegments(G4int val){nbSegments = val;}
-    G4double GetNbSegments(void){return nbSegments;}
+    G4double GetNbSegments(void) const {return nbSegments;}
     void SetNbCrystInSegmentRow(G4int val){nbCrystInSegmentRow = val;}
-    G4double GetNbCrystInSegmentRow(void){return nbCrystInSegmentRow;}
+    G4double GetNbCrystInSegmentRow(void) const {return nbCrystInSegmentRow;}
     void SetNbCrystInSegmentColumn(G4int val){nbCrystInSegmentColumn = val;}
-    G4double GetNbCrystInSegmentColumn(void){return nbCrystInSegmentColumn;}
+    G4double GetNbCrystInSegmentColumn(void) const {return nbCrystInSegmentColumn;}
 
 
     void SetSciCrystSizeX(G4double val){sciCrystSizeX = val;}
-    G4double GetSciCrystSizeX(void){return sciCrystSizeX;}
+    G4double GetSciCrystSizeX(void) const {return sciCrystSizeX;}
     void SetSciCrystSizeY(G4double val){sciCrystSizeY = val;}
-    G4double GetSciCrystSizeY(void){return sciCrystSizeY;}
+    G4double GetSciCrystSizeY(void) const {return sciCrystSizeY;}
     void SetSciCrystSizeZ(G4double val){sciCrystSizeZ = val;}
-    G4double GetSciCrystSizeZ(void){return sciCrystSizeZ;}
+    G4double GetSciCrystSizeZ(void) const {return sciCrystSizeZ;}
 
 
     void SetSciWindSizeX(G4double val){sciWindSizeX = val;}
@@ -207,7 +266,44 @@ class SpecMATSimDetectorConstruction : public G4VUserDetectorConstruction
     G4double GetSciHousSizeZ(void){return sciHousSizeZ;}
 
     void SetSciCrystMat (G4String);
-    G4Material* GetSciCrystMat(){return sciCrystMat;}
+    G4Material* GetSciCrystMat() const {return sciCrystMat;}
+
+    void SetVacuumChamber(G4String val){vacuumChamber = val;}
+    G4String GetVacuumChamber(void) const {return vacuumChamber;}
+    void SetVacuumFlangeThickFrontOfScint(G4double val){vacuumFlangeThickFrontOfScint = val;}
+    G4double GetVacuumFlangeThickFrontOfScint(void) const {return vacuumFlangeThickFrontOfScint;}
+
+    // the placements are checked for overlaps after construction, on by default
+    void SetCheckOverlaps(G4bool val){fCheckOverlaps = val;}
+    G4bool GetCheckOverlaps(void) const {return fCheckOverlaps;}
+
+    // before the first Construct()
+    void SetLightCollection(G4String val){lightCollection = val;}
+    G4String GetLightCollection(void) const {return lightCollection;}
+    void SetLightMapFile(G4String val){lightMapFile = val;}
+    G4String GetLightMapFile(void) const {return lightMapFile;}
+    SpecMATSimLightMap* GetLightMap(void) const {return fLightMap;}
+
+    G4String GetDigitizer(void) const {return digitizer;}
+
+    void SetCellGeometry(G4String val){cellGeometry = val;}
+    G4String GetCellGeometry(void) const {return cellGeometry;}
+
+    // "off"/"kill"/"tally", the shell is built by Construct()
+    G4String GetEnvelope(void) const {return envelope;}
+    G4double GetEnvelopeRadius(void) const {return envelopeRadius;}
+    G4double GetEnvelopeHalfZ(void) const {return envelopeHalfZ;}
+    G4bool IsKillShell(const G4LogicalVolume* volume) const
+      {return volume && (volume == killShellSideLog || volume == killShellCapLog);}
+    G4bool IsInsideEnvelope(const G4ThreeVector& position) const;
+
+    G4String GetGdmlGeometry(void) const {return gdmlGeometry;}
+    G4bool IsGeometryFromGDML(void) const {return fGeometryFromGDML;}
+    // Text of all parameters that define the geometry, its hash names the GDML cache file
+    G4String GetGeometryKey(void) const;
+
+    // Crystal frame to world frame, filled by Construct() for every crystal copy number
+    G4bool GetCrystalTransform(G4int copyNb, G4Transform3D& transform) const;
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
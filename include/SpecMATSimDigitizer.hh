@@ -0,0 +1,110 @@
+/// \file SpecMATSimDigitizer.hh
+/// \brief Definition of the SpecMATSimDigitizer class
+
+#ifndef SpecMATSimDigitizer_h
+#define SpecMATSimDigitizer_h 1
+
+#include "globals.hh"
+#include "Randomize.hh"
+
+#include <map>
+#include <queue>
+#include <vector>
+#include <fstream>
+#include <functional>
+
+/// Streaming digitizer of the crystal signals.
+///
+/// Simulated events are placed on a Poisson timeline with the mean rate
+/// sourceActivity. Every crystal hit arrives at the event time plus the
+/// delay of its first deposit relative to the first deposit of the event.
+/// Per crystal a pulse integrates all hits within integrationTime
+/// (pile-up) and the crystal is then dead for deadTime, non-paralyzable:
+/// hits during the dead time are lost and do not extend it. Closed pulses
+/// below threshold are rejected, the others are converted to ADC channels
+/// of width adcGain (adcBits resolution) and written in time order.
+///
+/// Hits are buffered only until no later event can precede them, so the
+/// memory used is bounded by the rate times the longest hit delay.
+
+class SpecMATSimDigitizer
+{
+  public:
+    SpecMATSimDigitizer(G4int nbCrystals, const G4String& fileName);
+    ~SpecMATSimDigitizer();
+
+    // energies [keV] and first hit times of the fired crystals of one event
+    void ProcessEvent(G4int eventNb,
+                      const std::map<G4int, G4double>& energies,
+                      const std::map<G4int, G4double>& times);
+    // flushes the pending hits and pulses, closes the file and prints the counters
+    void Finish();
+
+    void SetSourceActivity(G4double val) { sourceActivity = val; }
+    G4double GetSourceActivity(void) const { return sourceActivity; }
+    void SetThreshold(G4double val) { threshold = val; }
+    G4double GetThreshold(void) const { return threshold; }
+    void SetDeadTime(G4double val) { deadTime = val; }
+    G4double GetDeadTime(void) const { return deadTime; }
+    void SetIntegrationTime(G4double val) { integrationTime = val; }
+    G4double GetIntegrationTime(void) const { return integrationTime; }
+    void SetAdcGain(G4double val) { adcGain = val; }
+    G4double GetAdcGain(void) const { return adcGain; }
+    void SetAdcBits(G4int val) { adcBits = val; }
+    G4int GetAdcBits(void) const { return adcBits; }
+
+    G4double GetElapsedTime(void) const { return fTime; }
+    G4long GetNbAccepted(void) const { return fNbAccepted; }
+
+  private:
+    struct Hit {
+      G4double time;
+      G4double energy;
+      G4int crystal;
+      G4int event;
+      G4bool operator>(const Hit& other) const { return time > other.time; }
+    };
+    struct Pulse {
+      G4double start;
+      G4double energy;
+      G4int crystal;
+      G4int event;
+      G4int nbHits;
+      G4bool operator>(const Pulse& other) const { return start > other.start; }
+    };
+
+    void Release(G4double upToTime);
+    void ProcessHit(const Hit& hit);
+    void ClosePulse(G4int crystal);
+    void Write(const Pulse& pulse);
+
+    G4double sourceActivity;
+    G4double threshold;
+    G4double deadTime;
+    G4double integrationTime;
+    G4double adcGain;
+    G4int adcBits;
+
+    G4int fNbCrystals;
+    G4double fTime;
+    CLHEP::HepJamesRandom fTimeEngine;
+    std::ofstream fOutput;
+
+    std::priority_queue<Hit, std::vector<Hit>, std::greater<Hit> > fPendingHits;
+    std::priority_queue<Pulse, std::vector<Pulse>, std::greater<Pulse> > fClosedPulses;
+    std::vector<Pulse> fOpenPulses;
+    std::vector<G4bool> fPulseOpen;
+    std::vector<G4double> fDeadUntil;
+
+    G4long fNbEvents;
+    G4long fNbHits;
+    G4long fNbPileUp;
+    G4long fNbDead;
+    G4long fNbBelowThreshold;
+    G4long fNbOverflow;
+    G4long fNbAccepted;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
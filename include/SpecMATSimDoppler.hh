@@ -0,0 +1,49 @@
+/// \file SpecMATSimDoppler.hh
+/// \brief Definition of the SpecMATSimDoppler class
+
+#ifndef SpecMATSimDoppler_h
+#define SpecMATSimDoppler_h 1
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+
+#include <vector>
+
+class SpecMATSimDetectorConstruction;
+
+/// Online Doppler correction of the crystal energies.
+///
+/// The angle between the direction of flight of the emitter and the line
+/// from the emission point to the centre of every crystal is taken once
+/// from the crystal placements of Construct(). An energy measured in a
+/// crystal is corrected to the rest frame with
+///
+///     E0 = E gamma (1 - beta cos(theta))
+///
+/// using the factor of the crystal from the table.
+
+class SpecMATSimDoppler
+{
+  public:
+    SpecMATSimDoppler(const SpecMATSimDetectorConstruction* detector, G4int nbCryst,
+                      G4double beta, const G4ThreeVector& direction,
+                      const G4ThreeVector& emissionPoint);
+    ~SpecMATSimDoppler();
+
+    // rest-frame energy of an energy measured in crystal copyNb
+    G4double Correct(G4int copyNb, G4double energy) const
+      { return (copyNb > 0 && copyNb < G4int(fFactors.size())) ? energy*fFactors[copyNb] : energy; }
+    // cosine of the angle of crystal copyNb to the direction of flight
+    G4double GetCosTheta(G4int copyNb) const { return fCosTheta[copyNb]; }
+    G4double GetBeta() const { return fBeta; }
+
+  private:
+    G4double fBeta;
+    // indexed by copy number, entry 0 is unused
+    std::vector<G4double> fCosTheta;
+    std::vector<G4double> fFactors;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,85 @@
+/// \file SpecMATSimEfficiencyEstimator.hh
+/// \brief Definition of the SpecMATSimEfficiencyEstimator class
+
+#ifndef SpecMATSimEfficiencyEstimator_h
+#define SpecMATSimEfficiencyEstimator_h 1
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+
+#include <vector>
+
+class G4Material;
+class G4VPhysicalVolume;
+class G4VEmModel;
+
+/// Efficiency of a layout from its geometry alone, without running events.
+///
+/// Isotropic rays from a point source are cast through the constructed
+/// geometry with SpecMATSimRayCaster. The geometric efficiency is the
+/// fraction of rays crossing the crystal material. Along every ray the
+/// optical depth is added up from the attenuation coefficient of each
+/// material at the gamma energy (photoelectric effect, Compton scattering
+/// and pair production of the standard models, Rayleigh scattering is
+/// left out); the first-interaction efficiency is the mean probability
+/// that the first interaction of the gamma is in a crystal. It is an upper
+/// bound of the full-energy efficiency and ranks layouts by what they can
+/// collect at all.
+///
+/// The rays are cast in batches with their own seeds, so the result does
+/// not depend on the number of worker processes sharing the batches. The
+/// geometry must be closed before Estimate() is called.
+
+class SpecMATSimEfficiencyEstimator
+{
+  public:
+    SpecMATSimEfficiencyEstimator(G4double energy);
+    ~SpecMATSimEfficiencyEstimator();
+
+    void SetSource(const G4ThreeVector& position) { fSource = position; }
+    void SetNbWorkers(G4int val) { fNbWorkers = (val > 1) ? val : 1; }
+    void SetBatchSize(G4int val) { fBatchSize = (val > 1) ? val : 1; }
+
+    struct Result {
+      G4long rays;
+      G4double geometric;
+      G4double geometricError;
+      G4double firstInteraction;
+      G4double firstInteractionError;
+      // mean probability that a gamma entering the crystals has not
+      // interacted on its way there
+      G4double transmission;
+      G4double seconds;
+    };
+
+    Result Estimate(G4VPhysicalVolume* world, const G4Material* crystalMaterial,
+                    G4long nbRays, long seed);
+
+    // linear attenuation coefficient [1/length] at the energy of the estimator
+    G4double GetAttenuation(const G4Material* material);
+
+  private:
+    // sums of one batch of rays
+    struct BatchSums {
+      G4long rays;
+      G4long hits;
+      G4double sumP;
+      G4double sumP2;
+      G4double sumTransmission;
+    };
+    void CastBatch(G4VPhysicalVolume* world, const G4Material* crystalMaterial,
+                   G4long nbRays, long seed, G4int batch, BatchSums& sums);
+
+    G4double fEnergy;
+    G4ThreeVector fSource;
+    G4int fNbWorkers;
+    G4int fBatchSize;
+    // owned by the G4LossTableManager
+    std::vector<G4VEmModel*> fModels;
+    // per material index, negative until computed
+    std::vector<G4double> fAttenuation;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
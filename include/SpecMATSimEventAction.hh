@@ -29,6 +29,11 @@ class SpecMATSimEventAction : public G4UserEventAction
     virtual void    EndOfEventAction(const G4Event* );
 
     void SetPrintModulo(G4int value);
+    // 0 - silent, 1 - progress of the run, 2 - every event and crystal
+    void SetVerboseLevel(G4int value) { fVerboseLevel = value; }
+
+    // Called by the stepping action when tabulating the light collection map
+    void AddDetectedPhoton() { fDetectedPhotons++; }
 
     G4double absoEdep;
 
@@ -38,14 +43,19 @@ class SpecMATSimEventAction : public G4UserEventAction
                                           const G4Event* event) const;
     G4double GetSum(G4THitsMap<G4double>* hitsMap) const;
     void PrintEventStatistics(G4double absoEdep) const;
-    SpecMATSimDetectorConstruction* sciCryst;
     SpecMATSimRunAction*  fRunAct;
 
     G4int fCollID_cryst;
 	G4int fCollID_ring;
+    G4int fCollID_light;
+    G4int fCollID_time;
+    // run of the collection IDs above
+    G4int fCollIDRun;
+    G4int fDetectedPhotons;
 
     G4Material* crystMat;
     G4int fPrintModulo;
+    G4int fVerboseLevel;
 };
 
 // inline functions
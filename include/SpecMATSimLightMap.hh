@@ -0,0 +1,59 @@
+/// \file SpecMATSimLightMap.hh
+/// \brief Definition of the SpecMATSimLightMap class
+
+#ifndef SpecMATSimLightMap_h
+#define SpecMATSimLightMap_h 1
+
+#include "G4ThreeVector.hh"
+#include "globals.hh"
+
+#include <vector>
+
+/// Light-collection efficiency of a crystal as a function of the
+/// deposit position in the crystal frame.
+///
+/// The crystal (half-sizes sizeX, sizeY, sizeZ) is split into a regular
+/// grid of cells. In the "tabulate" mode optical photons are emitted from
+/// every cell and the fraction reaching the quartz window is accumulated
+/// with AddTabulation(). In the "map" mode the table is read back and
+/// GetRelativeEfficiency() interpolates it trilinearly between the cell
+/// centres, normalised to a mean of one over the crystal volume.
+
+class SpecMATSimLightMap
+{
+  public:
+    SpecMATSimLightMap(G4int nbBinsX, G4int nbBinsY, G4int nbBinsZ,
+                       G4double sizeX, G4double sizeY, G4double sizeZ);
+    ~SpecMATSimLightMap();
+
+    G4int GetNbCells() const { return fNbBinsX*fNbBinsY*fNbBinsZ; }
+    G4ThreeVector GetCellCentre(G4int cell) const;
+    G4ThreeVector GetCellHalfSize() const;
+
+    void AddTabulation(G4int cell, G4double emitted, G4double detected);
+
+    G4bool Write(const G4String& fileName) const;
+    G4bool Read(const G4String& fileName);
+
+    G4double GetRelativeEfficiency(const G4ThreeVector& localPosition) const;
+
+  private:
+    G4int CellIndex(G4int ix, G4int iy, G4int iz) const;
+    G4double Efficiency(G4int cell) const;
+    void Normalise();
+
+    G4int fNbBinsX;
+    G4int fNbBinsY;
+    G4int fNbBinsZ;
+    G4double fSizeX;
+    G4double fSizeY;
+    G4double fSizeZ;
+
+    std::vector<G4double> fEmitted;
+    std::vector<G4double> fDetected;
+    std::vector<G4double> fRelative;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
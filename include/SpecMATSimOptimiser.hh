@@ -0,0 +1,116 @@
+/// \file SpecMATSimOptimiser.hh
+/// \brief Definition of the SpecMATSimOptimiser class
+
+#ifndef SpecMATSimOptimiser_h
+#define SpecMATSimOptimiser_h 1
+
+#include "globals.hh"
+#include "SpecMATSimVariants.hh"
+
+#include <map>
+#include <vector>
+
+class SpecMATSimDetectorConstruction;
+class SpecMATSimPrimaryGeneratorAction;
+class SpecMATSimRunAction;
+
+/// Search of the detector layout with the best efficiency under a
+/// crystal-count and cost constraint.
+///
+/// The file gives the values of the parameters, the objective and the
+/// constraints; '#' starts a comment:
+///
+///     parameter   nbSegments 6 8 12
+///     parameter   sciCrystSize 15 19 25
+///     parameter   sciCrystMat CeBr3 LaBr3
+///     objective   fullEnergy        # or detection
+///     energy      1000              # keV, of the gamma source
+///     maxCrystals 150
+///     maxCost     30000
+///     cost        LaBr3 3           # per cm3 of crystal, 1 if not given
+///     candidates  100               # random sample of larger grids
+///     events      1000              # of every candidate in the first round
+///     reduction   3
+///
+/// The parameters are settings of SpecMATSimVariants. Every combination of
+/// their values is a candidate; those above maxCrystals or maxCost are
+/// dropped before any event is run. The others are simulated by successive
+/// halving: in every round all remaining candidates run the same events,
+/// the best 1/reduction of them advance, and the next round runs
+/// reduction times more events, added to those of the earlier rounds. Poor
+/// layouts thus cost a short run, and the statistics go to the promising
+/// ones. Every event is seeded from the seed base and its number, so the
+/// candidates of a round are compared on the same events.
+///
+/// The geometry is rebuilt in the process for every candidate, without
+/// the overlap check. The candidates of a round are shared by forked
+/// worker processes; when there are fewer candidates than workers, the
+/// event loop of each candidate gets the rest. The ROOT output of a
+/// candidate is <name>_<candidate> and holds the events of its last round;
+/// the ranking is printed and written to <name>_optimisation.json.
+
+class SpecMATSimOptimiser
+{
+  public:
+    SpecMATSimOptimiser(SpecMATSimDetectorConstruction* detector,
+                        SpecMATSimPrimaryGeneratorAction* generator,
+                        SpecMATSimRunAction* runAction);
+    ~SpecMATSimOptimiser();
+
+    // false if the file cannot be read or has an unknown keyword or setting
+    G4bool Read(const G4String& fileName);
+    void Run(G4int nbWorkers, long seedBase, const G4String& baseName);
+
+  private:
+    struct Parameter {
+      G4String name;
+      std::vector<G4String> values;
+    };
+    struct Candidate {
+      std::vector<SpecMATSimVariants::Setting> settings;
+      G4int crystals;
+      G4double cost;
+      G4long events;
+      G4long detected;
+      G4long fullEnergy;
+      G4int rounds;
+    };
+    // counts of one candidate in one round, written by the worker processes
+    struct Counts {
+      G4long detected;
+      G4long fullEnergy;
+    };
+
+    // all grid points within the constraints, or a random sample of them
+    void MakeCandidates(long seedBase);
+    // applies the settings and fills the crystal count and the cost
+    void Evaluate(Candidate& candidate) const;
+    void RunRound(const std::vector<size_t>& selected, G4int nbEvents, G4int firstEvent,
+                  G4int nbWorkers, long seedBase, const G4String& baseName);
+    void RunCandidate(size_t index, G4int nbEvents, G4int firstEvent, long seedBase,
+                      const G4String& baseName, Counts& counts);
+    G4double GetObjective(const Candidate& candidate) const;
+    G4double GetObjectiveError(const Candidate& candidate) const;
+    G4String GetName(size_t index) const;
+    void Report(long seedBase, const G4String& baseName) const;
+
+    SpecMATSimDetectorConstruction* fDetector;
+    SpecMATSimPrimaryGeneratorAction* fGenerator;
+    SpecMATSimRunAction* fRunAction;
+    SpecMATSimVariants fVariants;
+
+    std::vector<Parameter> fParameters;
+    G4String fObjective;
+    G4double fEnergy;
+    G4int fMaxCrystals;
+    G4double fMaxCost;
+    std::map<G4String, G4double> fCosts;
+    G4int fMaxCandidates;
+    G4int fFirstEvents;
+    G4int fReduction;
+    std::vector<Candidate> fCandidates;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
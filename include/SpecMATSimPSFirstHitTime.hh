@@ -0,0 +1,37 @@
+/// \file SpecMATSimPSFirstHitTime.hh
+/// \brief Definition of the SpecMATSimPSFirstHitTime class
+
+#ifndef SpecMATSimPSFirstHitTime_h
+#define SpecMATSimPSFirstHitTime_h 1
+
+#include "G4VPrimitiveScorer.hh"
+#include "G4THitsMap.hh"
+
+/// Primitive scorer for the time of the first energy deposit in a crystal
+///
+/// Keeps the smallest global time of all steps with a non-zero deposit,
+/// instead of summing like the other primitive scorers.
+
+class SpecMATSimPSFirstHitTime : public G4VPrimitiveScorer
+{
+  public:
+    SpecMATSimPSFirstHitTime(G4String name, G4int depth = 0);
+    virtual ~SpecMATSimPSFirstHitTime();
+
+    virtual void Initialize(G4HCofThisEvent*);
+    virtual void EndOfEvent(G4HCofThisEvent*);
+    virtual void clear();
+    virtual void DrawAll();
+    virtual void PrintAll();
+
+  protected:
+    virtual G4bool ProcessHits(G4Step*, G4TouchableHistory*);
+
+  private:
+    G4int HCID;
+    G4THitsMap<G4double>* EvtMap;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,43 @@
+/// \file SpecMATSimPSLightCollection.hh
+/// \brief Definition of the SpecMATSimPSLightCollection class
+
+#ifndef SpecMATSimPSLightCollection_h
+#define SpecMATSimPSLightCollection_h 1
+
+#include "G4VPrimitiveScorer.hh"
+#include "G4THitsMap.hh"
+
+class SpecMATSimLightMap;
+
+/// Primitive scorer for the collected light of a crystal
+///
+/// Works like G4PSEnergyDeposit, but every step deposit is weighted with
+/// the relative light-collection efficiency at the step position in the
+/// crystal frame. The result is an energy equivalent of the light that
+/// reaches the window, equal to the deposit for a uniform crystal.
+
+class SpecMATSimPSLightCollection : public G4VPrimitiveScorer
+{
+  public:
+    SpecMATSimPSLightCollection(G4String name, const SpecMATSimLightMap* lightMap,
+                                G4int depth = 0);
+    virtual ~SpecMATSimPSLightCollection();
+
+    virtual void Initialize(G4HCofThisEvent*);
+    virtual void EndOfEvent(G4HCofThisEvent*);
+    virtual void clear();
+    virtual void DrawAll();
+    virtual void PrintAll();
+
+  protected:
+    virtual G4bool ProcessHits(G4Step*, G4TouchableHistory*);
+
+  private:
+    const SpecMATSimLightMap* fLightMap;
+    G4int HCID;
+    G4THitsMap<G4double>* EvtMap;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,87 @@
+/// \file SpecMATSimPhaseSpace.hh
+/// \brief Definition of the SpecMATSimPhaseSpace class
+
+#ifndef SpecMATSimPhaseSpace_h
+#define SpecMATSimPhaseSpace_h 1
+
+#include "globals.hh"
+
+#include <stdint.h>
+#include <pthread.h>
+
+/// Memory-mapped reader of a phase-space file.
+///
+/// File layout, little endian:
+///
+///     header, 32 bytes
+///       char     magic[8]       "SMPHSP01"
+///       int32    recordSize     48
+///       int32    reserved
+///       int64    nbRecords
+///       int64    reserved
+///     nbRecords records, 48 bytes each
+///       int32    pdg            PDG code, ions as 100ZZZAAAI
+///       uint32   event          records in a row with the same number form one event
+///       float    energy         kinetic energy [keV]
+///       float    x, y, z        position [mm]
+///       float    dx, dy, dz     direction, normalised by the reader
+///       float    weight
+///       double   time           [ns]
+///
+/// The file is mapped read-only and handed out in chunks of whole events.
+/// NextChunk() is thread safe. It asks the kernel to read the following
+/// chunk ahead, and ReleaseChunk() drops the pages of a finished chunk, so
+/// files larger than the memory stream through. At the end of the file the
+/// reader starts over and counts the passes.
+
+class SpecMATSimPhaseSpace
+{
+  public:
+    struct Record {
+      int32_t pdg;
+      uint32_t event;
+      float energy;
+      float position[3];
+      float direction[3];
+      float weight;
+      double time;
+    };
+    // records [begin, end) of one pass through the file
+    struct Chunk {
+      G4long begin;
+      G4long end;
+      G4long pass;
+    };
+
+    SpecMATSimPhaseSpace(const G4String& fileName, G4long chunkSize = 65536);
+    ~SpecMATSimPhaseSpace();
+
+    // false with a message on G4cerr if the file cannot be used
+    G4bool IsOpen() const { return fRecords != 0; }
+    G4long GetNbRecords() const { return fNbRecords; }
+    const Record& GetRecord(G4long index) const { return fRecords[index]; }
+    // first record after the event that starts at begin, at most limit
+    G4long GetEventEnd(G4long begin, G4long limit) const;
+
+    G4bool NextChunk(Chunk& chunk);
+    void ReleaseChunk(const Chunk& chunk);
+
+  private:
+    void Advise(G4long begin, G4long end, int advice);
+
+    G4String fFileName;
+    int fFile;
+    void* fMap;
+    size_t fMapSize;
+    const Record* fRecords;
+    G4long fNbRecords;
+    G4long fChunkSize;
+
+    pthread_mutex_t fMutex;
+    G4long fNext;
+    G4long fPass;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
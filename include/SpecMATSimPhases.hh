@@ -0,0 +1,61 @@
+/// \file SpecMATSimPhases.hh
+/// \brief Definition of the SpecMATSimPhases class
+
+#ifndef SpecMATSimPhases_h
+#define SpecMATSimPhases_h 1
+
+#include "globals.hh"
+
+#include <vector>
+
+/// Wall and CPU time of the phases of a job, with the peak resident memory
+/// at the end of each phase.
+///
+/// A phase is opened with Start() and closed with Stop() by name; a phase
+/// that runs more than once (materials of the copies of the detector
+/// construction, the event loop of every run) accumulates its time. Phases
+/// are listed in the order they were first started; they may be nested,
+/// "initialize" contains the geometry and the overlap checks.
+
+class SpecMATSimPhases
+{
+  public:
+    static SpecMATSimPhases* Instance();
+
+    void Start(const G4String& name);
+    void Stop(const G4String& name);
+
+    // 0 for a phase that never ran
+    G4double GetWallTime(const G4String& name) const;
+    G4long GetPeakRSS(const G4String& name) const;
+
+    void Print() const;
+    // JSON array of the phases, entries indented by indent spaces
+    G4String ToJson(G4int indent) const;
+
+  private:
+    SpecMATSimPhases();
+
+    struct Phase {
+      G4String name;
+      G4int calls;
+      G4bool running;
+      G4double wallStart;
+      G4double cpuStart;
+      G4double wallTime;
+      G4double cpuTime;
+      G4long peakRSS;
+    };
+
+    Phase* Find(const G4String& name);
+    const Phase* Find(const G4String& name) const;
+
+    static G4double WallClock();
+    static G4double CpuClock();
+
+    std::vector<Phase> fPhases;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -6,20 +6,54 @@
 
 #include "G4VModularPhysicsList.hh"
 
+class G4Timer;
+
 /// Modular physics list
 ///
 /// It includes the folowing physics builders
 /// - G4DecayPhysics
 /// - G4RadioactiveDecayPhysics
 /// - G4EmStandardPhysics
+/// - G4OpticalPhysics (only to tabulate the light collection map)
+///
+/// With physicsTableCache = "yes" the physics tables built by the first run
+/// are stored in a directory named after the hash of the physics
+/// composition, the cuts and the material table, and retrieved by later
+/// starts with the same key. Any change of those gives a new directory.
 
 class SpecMATSimPhysicsList: public G4VModularPhysicsList
 {
 public:
-  SpecMATSimPhysicsList();
+  SpecMATSimPhysicsList(G4bool opticalPhysics = false);
   virtual ~SpecMATSimPhysicsList();
 
   virtual void SetCuts();
+
+  // Called by the run manager before the kernel initialises the first run,
+  // in which the tables are built or retrieved
+  void StartTableTimer();
+  // Called at the start of every run, once the tables are built or retrieved:
+  // stores new tables and reports the initialisation time
+  void FinishTableCache();
+  // "off", "stored", "retrieved" or "failed"
+  G4String GetTableCacheStatus() const { return fTableCacheStatus; }
+  G4double GetTableInitTime() const { return fTableInitTime; }
+  // Physics composition, cuts and material table, valid after initialisation
+  G4String GetTableKey() const;
+
+private:
+  void RegisterNamedPhysics(G4VPhysicsConstructor* physics);
+
+  G4String physicsTableCache;
+  G4String physicsTableCacheDir;
+
+  G4String fComposition;
+  G4String fTableKey;
+  G4String fTableDir;
+  G4String fTableCacheStatus;
+  G4double fTableInitTime;
+  G4Timer* fTableTimer;
+  G4bool fTableTimerStarted;
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
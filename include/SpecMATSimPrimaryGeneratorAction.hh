@@ -7,10 +7,15 @@
 #include "G4VUserPrimaryGeneratorAction.hh"
 #include "G4ParticleGun.hh"
 #include "globals.hh"
+#include "SpecMATSimPhaseSpace.hh"
+
+#include <map>
+#include <vector>
 
 class G4ParticleGun;
 class G4Event;
 class SpecMATSimDetectorConstruction;
+class G4ParticleDefinition;
 
 /// The primary generator action class with particle gum.
 ///
@@ -37,28 +42,81 @@ class SpecMATSimPrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
     const G4ParticleGun* GetParticleGun() const { return fParticleGun; }
 
     void SetDistFromCrystSurfToSource(G4double val) { distFromCrystSurfToSource = val; }
-    G4double GetDistFromCrystSurfToSource(void) { return distFromCrystSurfToSource;}
+    G4double GetDistFromCrystSurfToSource(void) const { return distFromCrystSurfToSource;}
 
     void SetGammaEnergy(G4double val) { gammaEnergy = val; }
-    G4double GetGammaEnergy(void) { return gammaEnergy;}
+    G4double GetGammaEnergy(void) const { return gammaEnergy;}
 
     void SetZ(G4double val) { Z = val; }
-    G4double GetZ(void) { return Z;}
+    G4double GetZ(void) const { return Z;}
 
     void SetA(G4double val) { A = val; }
-    G4double GetA(void) { return A;}
+    G4double GetA(void) const { return A;}
 
     void SetIonCharge(G4double val) { ionCharge = val; }
-    G4double GetIonCharge(void) { return ionCharge;}
+    G4double GetIonCharge(void) const { return ionCharge;}
 
     void SetExcitEnergy(G4double val) { excitEnergy = val; }
-    G4double GetExcitEnergy(void) { return excitEnergy;}
+    G4double GetExcitEnergy(void) const { return excitEnergy;}
 
     void SetIonEnergy(G4double val) { ionEnergy = val; }
-    G4double GetIonEnergy(void) { return ionEnergy;}
+    G4double GetIonEnergy(void) const { return ionEnergy;}
 
     void SetSource(G4String val) { source = val; }
-    G4String GetSource(void) { return source;}
+    G4String GetSource(void) const { return source;}
+
+    void SetResponseEMin(G4double val) { responseEMin = val; }
+    G4double GetResponseEMin(void) const { return responseEMin;}
+
+    void SetResponseEMax(G4double val) { responseEMax = val; }
+    G4double GetResponseEMax(void) const { return responseEMax;}
+
+    void SetResponseNbSteps(G4int val) { responseNbSteps = val; }
+    G4int GetResponseNbSteps(void) const { return responseNbSteps;}
+
+    // Index of the true-energy grid point used in the current event
+    G4int GetResponseGridIndex(void) const { return responseGridIndex;}
+
+    void SetOpticalScanPhotons(G4int val) { opticalScanPhotons = val; }
+    G4int GetOpticalScanPhotons(void) const { return opticalScanPhotons;}
+
+    // Light collection map cell the photons of the current event start from
+    G4int GetOpticalScanCell(void) const { return opticalScanCell;}
+
+    void SetInFlightBeta(G4double val) { inFlightBeta = val; }
+    G4double GetInFlightBeta(void) const { return inFlightBeta;}
+    void SetInFlightDirection(const G4ThreeVector& val) { inFlightDirection = val; }
+    G4ThreeVector GetInFlightDirection(void) const { return inFlightDirection;}
+    void SetInFlightA2(G4double val) { inFlightA2 = val; }
+    G4double GetInFlightA2(void) const { return inFlightA2;}
+    void SetInFlightA4(G4double val) { inFlightA4 = val; }
+    G4double GetInFlightA4(void) const { return inFlightA4;}
+
+    // Velocity of the gamma emitter of the inFlight source, 0 for all other
+    // sources
+    G4double GetEmitterBeta(void) const;
+    G4ThreeVector GetEmitterDirection(void) const;
+
+    void SetPhaseSpaceFile(G4String val) { phaseSpaceFile = val; }
+    G4String GetPhaseSpaceFile(void) const { return phaseSpaceFile;}
+
+    // Every event reseeds the engine from base and its event number, so an
+    // event starts from the same seeds in every run with the same base; the
+    // events of a run are numbered from firstEvent to continue a former run
+    void SetEventSeeding(G4bool val, long base = 0, G4int firstEvent = 0)
+      { fEventSeeding = val; fEventSeedBase = base; fFirstEvent = firstEvent; }
+    G4bool GetEventSeeding(void) const { return fEventSeeding;}
+    long GetEventSeedBase(void) const { return fEventSeedBase;}
+    G4int GetFirstEvent(void) const { return fFirstEvent;}
+    // Replay: event i of the next runs is event events[i] of the seeded
+    // run, an empty list numbers the events from firstEvent again
+    void SetEventList(const std::vector<G4int>& events) { fEventList = events; }
+    // number of the event with this ID in the seeded run, its seeds derive from it
+    G4int GetEventNumber(G4int eventID) const
+      { return (eventID < G4int(fEventList.size())) ? fEventList[eventID] : fFirstEvent + eventID; }
+
+    // The next run starts again at the first event of the phase-space file
+    void ResetSource();
 
   private:
     SpecMATSimDetectorConstruction* sciCryst;
@@ -67,6 +125,38 @@ class SpecMATSimPrimaryGeneratorAction : public G4VUserPrimaryGeneratorAction
 
     G4double distFromCrystSurfToSource;
     G4double gammaEnergy;
+
+    G4double responseEMin;
+    G4double responseEMax;
+    G4int responseNbSteps;
+    G4int responseGridIndex;
+
+    G4int opticalScanPhotons;
+    G4int opticalScanCell;
+
+    G4double inFlightBeta;
+    G4ThreeVector inFlightDirection;
+    G4double inFlightA2;
+    G4double inFlightA4;
+
+    void GenerateInFlight(G4Event* anEvent);
+    void GeneratePhaseSpace(G4Event* anEvent);
+    G4ParticleDefinition* GetPhaseSpaceParticle(G4int pdg);
+
+    G4String phaseSpaceFile;
+    G4int phaseSpaceRecycle;
+    G4String phaseSpaceRotate;
+    SpecMATSimPhaseSpace* fPhaseSpace;
+    SpecMATSimPhaseSpace::Chunk fPhaseSpaceChunk;
+    G4long fPhaseSpaceEventBegin;
+    G4long fPhaseSpaceEventEnd;
+    G4int fPhaseSpaceUse;
+    std::map<G4int, G4ParticleDefinition*> fPhaseSpaceParticles;
+
+    G4bool fEventSeeding;
+    long fEventSeedBase;
+    G4int fFirstEvent;
+    std::vector<G4int> fEventList;
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
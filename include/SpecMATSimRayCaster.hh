@@ -0,0 +1,46 @@
+/// \file SpecMATSimRayCaster.hh
+/// \brief Definition of the SpecMATSimRayCaster class
+
+#ifndef SpecMATSimRayCaster_h
+#define SpecMATSimRayCaster_h 1
+
+#include "globals.hh"
+#include "G4ThreeVector.hh"
+
+#include <map>
+#include <vector>
+#include <utility>
+
+class G4Navigator;
+class G4VPhysicalVolume;
+class G4Material;
+
+/// Follows straight lines through a geometry without any physics.
+///
+/// Cast() steps a G4Navigator from a point to the world boundary and adds
+/// up the path length in every material crossed, keyed by material name so
+/// that the budgets of two separately built geometries can be compared.
+/// The second form keeps the materials in the order they are crossed.
+
+class SpecMATSimRayCaster
+{
+  public:
+    SpecMATSimRayCaster(G4VPhysicalVolume* world);
+    ~SpecMATSimRayCaster();
+
+    // returns the number of navigation steps, path lengths are added to pathLengths
+    G4int Cast(const G4ThreeVector& point, const G4ThreeVector& direction,
+               std::map<G4String, G4double>& pathLengths);
+    // material and path length of every step, segments is cleared first
+    typedef std::vector<std::pair<const G4Material*, G4double> > Segments;
+    G4int Cast(const G4ThreeVector& point, const G4ThreeVector& direction,
+               Segments& segments);
+
+  private:
+    G4Navigator* fNavigator;
+    G4int fMaxSteps;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
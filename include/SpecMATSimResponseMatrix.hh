@@ -0,0 +1,66 @@
+/// \file SpecMATSimResponseMatrix.hh
+/// \brief Definition of the SpecMATSimResponseMatrix class
+
+#ifndef SpecMATSimResponseMatrix_h
+#define SpecMATSimResponseMatrix_h 1
+
+#include "globals.hh"
+
+#include <map>
+#include <vector>
+
+/// Sparse detector response R(E_true -> E_dep).
+///
+/// One row per true-energy grid point and one sparse row of deposited
+/// energy counts per detector. Detectors 1..N are the crystals (same
+/// numbering as the histograms), detector N+1 is the calorimetric sum of
+/// the array. Every row is kept twice: raw deposit and resolution smeared.
+///
+/// Write() produces a binary file with this layout (host byte order):
+///   char[8]   "SMRESP01"
+///   G4int     number of detectors, number of rows, number of columns
+///   G4double  column width [keV], lowest and highest true energy [keV]
+///   G4double  thrown events per row                       [rows]
+///   uint64    offset of each row from the start of data   [detectors*rows*2+1]
+///   data      per row: varint number of non-empty bins, then pairs of
+///             varint column distance to the previous bin and varint count
+/// Row (detector d, row r, kind k) has index ((d-1)*rows + r)*2 + k where
+/// k = 0 is raw and k = 1 is smeared, so ReadRow() seeks directly to it.
+
+class SpecMATSimResponseMatrix
+{
+  public:
+    enum Kind { kRaw = 0, kSmeared = 1 };
+
+    SpecMATSimResponseMatrix(G4int nbDetectors, G4int nbRows, G4int nbColumns,
+                             G4double columnWidth, G4double eMin, G4double eMax);
+    ~SpecMATSimResponseMatrix();
+
+    void CountThrown(G4int row);
+    void Fill(G4int detector, G4int row, G4double rawEdep, G4double smearedEdep);
+    void Write(const G4String& fileName) const;
+
+    G4int GetNbDetectors() const { return fNbDetectors; }
+    G4int GetNbRows() const { return fNbRows; }
+
+    static G4bool ReadRow(const G4String& fileName, G4int detector, G4int row,
+                          Kind kind, std::map<G4int, G4int>& counts);
+
+  private:
+    G4int RowIndex(G4int detector, G4int row, Kind kind) const;
+    void Add(G4int index, G4double edep);
+
+    G4int fNbDetectors;
+    G4int fNbRows;
+    G4int fNbColumns;
+    G4double fColumnWidth;
+    G4double fEMin;
+    G4double fEMax;
+
+    std::vector<G4double> fThrown;
+    std::vector< std::map<G4int, G4int> > fRows;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,79 @@
+/// \file SpecMATSimResultCache.hh
+/// \brief Definition of the SpecMATSimResultCache class
+
+#ifndef SpecMATSimResultCache_h
+#define SpecMATSimResultCache_h 1
+
+#include "globals.hh"
+
+#include <vector>
+
+class SpecMATSimRunAction;
+class SpecMATSimPrimaryGeneratorAction;
+class SpecMATSimPhysicsList;
+
+/// Cache of finished runs, keyed by the hash of the full configuration:
+/// executable, seed, geometry and materials, source, trigger, physics
+/// composition and cuts. The number of events is not part of the key.
+///
+/// A stored result with the requested number of events is copied to the
+/// output names without running. A stored result with fewer events is
+/// continued: only the missing events are run, every event seeded from
+/// its number, and the stored crystal deposits are filled into the new
+/// histograms and ntuple first, so the merged output is the one a single
+/// run of all events gives. The larger result replaces the stored one.
+///
+/// Only runs whose outputs are the ROOT file and the summary are cached,
+/// phase-space runs are reused but not continued.
+
+class SpecMATSimResultCache
+{
+  public:
+    struct Counters {
+      G4long events;
+      G4long goodEvents;
+      G4long fullEnergyEvents;
+      G4long accepted;
+      G4long rejected;
+    };
+    // one crystal deposit [keV], as in the ntuple
+    struct Row {
+      G4int event;
+      G4int crystal;
+      G4double edep;
+    };
+
+    SpecMATSimResultCache(SpecMATSimRunAction* runAction,
+                          SpecMATSimPrimaryGeneratorAction* generator,
+                          SpecMATSimPhysicsList* physicsList);
+    ~SpecMATSimResultCache();
+
+    // runs nbEvents events, or as many as the stored result is missing
+    void BeamOn(G4int nbEvents, long seedBase);
+
+    // While a continued run is going on: the stored part and the number
+    // of the first new event
+    const std::vector<Row>& GetCachedRows() const { return fCachedRows; }
+    const Counters& GetCachedCounters() const { return fCached; }
+    G4int GetFirstEvent() const { return G4int(fCached.events); }
+    // deposits of the new events, stored with the result
+    void Record(G4int event, G4int crystal, G4double edep);
+
+  private:
+    G4bool ReadEntry(const G4String& dir, const G4String& key, Counters& counters) const;
+    G4bool ReadRows(const G4String& dir);
+    G4bool Store(const G4String& dir, const G4String& key, const Counters& counters,
+                 const G4String& fileName, const G4String& summaryFileName) const;
+
+    SpecMATSimRunAction* fRunAction;
+    SpecMATSimPrimaryGeneratorAction* fGenerator;
+    SpecMATSimPhysicsList* fPhysicsList;
+
+    Counters fCached;
+    std::vector<Row> fCachedRows;
+    std::vector<Row> fRows;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -7,10 +7,22 @@
 #include "G4UserRunAction.hh"
 #include "globals.hh"
 #include "G4Material.hh"
+#include "SpecMATSimResultCache.hh"
+
+#include <vector>
 
 class G4Run;
+class G4Timer;
 class SpecMATSimDetectorConstruction;
 class SpecMATSimPrimaryGeneratorAction;
+class SpecMATSimResponseMatrix;
+class SpecMATSimDigitizer;
+class SpecMATSimCoincidences;
+class SpecMATSimSnapshot;
+class SpecMATSimTrigger;
+class SpecMATSimPhysicsList;
+class SpecMATSimDoppler;
+class SpecMATSimSharedHistograms;
 /// Run action class
 
 class SpecMATSimRunAction : public G4UserRunAction
@@ -23,12 +35,90 @@ class SpecMATSimRunAction : public G4UserRunAction
     virtual void EndOfRunAction(const G4Run*);
 
     void CountEvents() { fGoodEvents++;};
+    void CountFullEnergyEvents() { fFullEnergyEvents++; }
+    G4int GetFullEnergyEvents() const { return fFullEnergyEvents; }
+
+    // Outcome of every event of the run, kept for correlated sampling when
+    // enabled: bit 0 triggered, bit 1 full energy, 0 for rejected events
+    void SetRecordEvents(G4bool val) { fRecordEvents = val; }
+    void RecordEvent(G4int eventNb, G4bool fullEnergy)
+      { if (eventNb >= 0 && eventNb < G4int(fEventRecord.size())) fEventRecord[eventNb] = fullEnergy ? 3 : 1; }
+    const std::vector<unsigned char>& GetEventRecord() const { return fEventRecord; }
+
+    // Called by the stepping action when the detector has a tracking envelope
+    void CountEnvelopeStep(G4bool beyond) { fEnvelopeSteps++; if (beyond) fEnvelopeStepsBeyond++; }
+    void CountEnvelopeCrossing() { fEnvelopeCrossings++; }
+    // steps the track took before the kill policy stopped it at the shell
+    void CountEnvelopeKill(G4int trackSteps) { fEnvelopeKilledSteps += trackSteps; }
+    void CountEnvelopeReturn() { fEnvelopeReturns++; }
+
+    // Base name of the output files, replaces the name built from the
+    // geometry and the source when not empty
+    void SetOutputName(const G4String& name) { fOutputName = name; }
+    // Physics list whose table cache is completed at the start of a run
+    void SetPhysicsList(SpecMATSimPhysicsList* physicsList) { fPhysicsList = physicsList; }
+
+    // Smeared energy [keV] of a fired crystal of an accepted event: fills
+    // the spectra and the ntuple, or the rows of a worker process
+    void FillDeposit(G4int eventNb, G4int copyNb, G4double edep);
+
+    // Worker processes of SpecMATSimRunManager: a worker keeps its ntuple
+    // rows and hands them with its counters to the main process in a file,
+    // the spectra are shared
+    G4bool CanRunWorkers() const;
+    void StartWorker() { fWorker = true; fWorkerRows.clear(); }
+    G4bool WriteWorker(const G4String& fileName) const;
+    G4bool MergeWorker(const G4String& fileName);
+    G4String GetFileName() const { return fFileName; }
+
+    // Name of the ROOT file of the next run
+    G4String BuildFileName();
+    // Every setting that changes the physics result, valid once the names are built
+    G4String GetConfiguration() const;
+
+    // "yes" runs the -n events through SpecMATSimResultCache
+    G4String GetResultCache() const { return resultCache; }
+    G4String GetResultCacheDir() const { return resultCacheDir; }
+    // true when the ROOT file and the summary are the only outputs
+    G4bool HasMergeableOutputs() const;
+    // true when the ROOT output is split into numbered pieces
+    G4bool IsRolling() const { return rollEvents > 0 || rollBytes > 0; }
+    // Set by the cache for the run it continues or stores, 0 otherwise
+    void AttachResultCache(SpecMATSimResultCache* cache) { fResultCache = cache; }
+    SpecMATSimResultCache* GetAttachedResultCache() const { return fResultCache; }
+
+    // Only exists for runs with the "gammaGrid" source, 0 otherwise
+    SpecMATSimResponseMatrix* GetResponseMatrix() const { return fResponseMatrix; }
+    // Only exists with digitizer = "yes" in the detector construction, 0 otherwise
+    SpecMATSimDigitizer* GetDigitizer() const { return fDigitizer; }
+    // Only exists with ggMatrix = "yes", 0 otherwise
+    SpecMATSimCoincidences* GetCoincidences() const { return fCoincidences; }
+    // Only exists with snapshotEvery > 0, 0 otherwise
+    SpecMATSimSnapshot* GetSnapshot() const { return fSnapshot; }
+    SpecMATSimTrigger* GetTrigger() const { return fTrigger; }
+    // Only exists for sources with a moving emitter, 0 otherwise; the
+    // corrected spectrum of crystal n is histogram GetDopplerHistoId()+n-1,
+    // the one of all crystals follows the last crystal
+    SpecMATSimDoppler* GetDoppler() const { return fDoppler; }
+    G4int GetDopplerHistoId() const { return fDopplerHistoId; }
 
     G4int fGoodEvents;
 
   private:
-    SpecMATSimDetectorConstruction* sciCryst;
-    SpecMATSimPrimaryGeneratorAction* gammaSource;
+    void FillSpectra(G4int copyNb, G4double edep);
+    void AddNtupleRow(const SpecMATSimResultCache::Row& row);
+    // ROOT file of the run, or of one piece of a rolled run: opened with
+    // all histograms and the ntuple booked, written and closed with the
+    // spectra counted since it was opened
+    void OpenOutput(const G4String& fileName);
+    void CloseOutput();
+    // closes the current piece at nextFirstEvent and opens the next one
+    void RollOutput(G4int nextFirstEvent);
+    G4String GetPieceFileName(G4int piece) const;
+    void WriteIndex(const G4Run* run) const;
+    void WriteSummary(const G4Run* run);
+    void PrintEnvelope(const G4String& policy) const;
+
     G4Material* crystMat;
 
     G4String crystSizeX;
@@ -39,6 +129,69 @@ class SpecMATSimRunAction : public G4UserRunAction
     G4String particleEnergy;
     G4String particleName;
     G4String crystSourceDist;
+
+    SpecMATSimResponseMatrix* fResponseMatrix;
+    G4String fResponseFileName;
+
+    SpecMATSimDigitizer* fDigitizer;
+
+    G4String ggMatrix;
+    G4String ggMatrixAddBack;
+    G4String ggMatrixAngleGroups;
+    SpecMATSimCoincidences* fCoincidences;
+    G4String fCoincidenceFileName;
+
+    G4int snapshotEvery;
+    SpecMATSimSnapshot* fSnapshot;
+
+    SpecMATSimTrigger* fTrigger;
+
+    SpecMATSimDoppler* fDoppler;
+    G4int fDopplerHistoId;
+
+    G4int fNbCryst;
+    SpecMATSimSharedHistograms* fSpectra;
+    G4bool fWorker;
+    std::vector<SpecMATSimResultCache::Row> fWorkerRows;
+    // checksums of the spectra and the ntuple rows, see WriteSummary()
+    unsigned long long fSpectraChecksum;
+    unsigned long long fHitsChecksum;
+    G4long fNbHits;
+
+    // Output rolling, see the constructor
+    G4int rollEvents;
+    G4long rollBytes;
+    struct Piece {
+      G4String fileName;
+      G4int firstEvent;
+      G4int nbEvents;
+      G4long rows;
+    };
+    std::vector<Piece> fPieces;
+    G4int fLastRowEvent;
+
+    SpecMATSimPhysicsList* fPhysicsList;
+
+    G4String resultCache;
+    G4String resultCacheDir;
+    SpecMATSimResultCache* fResultCache;
+
+    G4String fOutputName;
+    G4String fFileName;
+    G4int fFullEnergyEvents;
+    G4long fEnvelopeSteps;
+    G4long fEnvelopeStepsBeyond;
+    G4long fEnvelopeCrossings;
+    G4long fEnvelopeReturns;
+    G4long fEnvelopeKilledSteps;
+    G4String fRngState;
+    G4bool fRecordEvents;
+    std::vector<unsigned char> fEventRecord;
+    G4int fPhaseTimeHistoId;
+    G4int fPhaseRSSHistoId;
+    G4Timer* fTimer;
+    // CPU time of the reaped child processes at the start of the run
+    G4double fChildrenCPUStart;
 };
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
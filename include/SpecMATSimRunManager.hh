@@ -0,0 +1,46 @@
+/// \file SpecMATSimRunManager.hh
+/// \brief Definition of the SpecMATSimRunManager class
+
+#ifndef SpecMATSimRunManager_h
+#define SpecMATSimRunManager_h 1
+
+#include "G4RunManager.hh"
+#include "globals.hh"
+
+/// Run manager that spreads the event loop over worker processes.
+///
+/// The kernel of Geant4 9.6 is sequential, so with more than one worker
+/// the event loop forks after the start of the run. Every worker runs a
+/// contiguous range of event numbers with its copy of the initialised
+/// kernel; the event seeding of the generator gives every event the same
+/// random numbers whichever worker runs it. The workers fill the spectra
+/// of the run action in shared memory. Their ntuple rows and counters come
+/// back in one file per worker, which the main process adds in worker
+/// order, which is event order, before the end of the run.
+///
+/// Runs the workers cannot share (see SpecMATSimRunAction::CanRunWorkers)
+/// and runs without event seeding use the sequential loop.
+
+class SpecMATSimRunManager : public G4RunManager
+{
+  public:
+    SpecMATSimRunManager();
+    virtual ~SpecMATSimRunManager();
+
+    void SetNbWorkers(G4int val) { fNbWorkers = val; }
+    G4int GetNbWorkers() const { return fNbWorkers; }
+
+  protected:
+    // times the physics tables of the first run
+    virtual void RunInitialization();
+    virtual void DoEventLoop(G4int n_event, const char* macroFile = 0, G4int n_select = -1);
+
+  private:
+    void RunWorker(G4int firstEvent, G4int lastEvent, const G4String& fileName);
+
+    G4int fNbWorkers;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
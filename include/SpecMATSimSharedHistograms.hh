@@ -0,0 +1,65 @@
+/// \file SpecMATSimSharedHistograms.hh
+/// \brief Definition of the SpecMATSimSharedHistograms class
+
+#ifndef SpecMATSimSharedHistograms_h
+#define SpecMATSimSharedHistograms_h 1
+
+#include "globals.hh"
+
+/// Spectra with integer bin counts in one shared memory mapping.
+///
+/// The mapping is created before the worker processes are forked and is
+/// not copied by them: every worker adds its fills to the same bins with
+/// atomic increments, without locks and without a merge at the end. The
+/// memory does not grow with the number of workers.
+///
+/// All spectra have the binning of the crystal histograms of the run
+/// action, plus an underflow and an overflow bin. Write() hands the counts
+/// of one spectrum to an empty histogram of the analysis manager: every bin
+/// gets the entries, sum of weights and sum of squared weights of as many
+/// unit-weight fills at its centre as it has counts.
+
+class SpecMATSimSharedHistograms
+{
+  public:
+    SpecMATSimSharedHistograms(G4int nbHistos, G4int nbBins, G4double xMin, G4double xMax);
+    ~SpecMATSimSharedHistograms();
+
+    // false if the mapping could not be created
+    G4bool IsValid() const { return fCounts != 0; }
+
+    // fills of a spectrum outside 0..nbHistos-1 are dropped
+    void Fill(G4int histo, G4double x)
+      { if (histo >= 0 && histo < fNbHistos)
+          __sync_fetch_and_add(&fCounts[histo*(fNbBins+2) + Bin(x)], 1ULL); }
+    // Sets the bins of histogram h1Id of the analysis manager to the counts
+    // of the spectrum
+    void Write(G4int histo, G4int h1Id) const;
+    // Sum over all bins of the count times a hash of the bin: equal counts
+    // give equal checksums, and the checksums of runs over disjoint events
+    // add up (mod 2^64) to the one of the run over all of them
+    unsigned long long Checksum() const;
+    // sets all counts back to 0, not while workers are filling
+    void Reset();
+
+    G4int GetNbHistos() const { return fNbHistos; }
+    // bytes of the mapping
+    size_t GetSize() const { return fSize; }
+
+  private:
+    // 0 underflow, 1..nbBins, nbBins+1 overflow
+    G4int Bin(G4double x) const
+      { return (x < fXMin) ? 0 : (x >= fXMax) ? fNbBins+1 : G4int((x - fXMin)/fBinWidth) + 1; }
+
+    G4int fNbHistos;
+    G4int fNbBins;
+    G4double fXMin;
+    G4double fXMax;
+    G4double fBinWidth;
+    size_t fSize;
+    unsigned long long* fCounts;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,82 @@
+/// \file SpecMATSimSnapshot.hh
+/// \brief Definition of the SpecMATSimSnapshot class
+
+#ifndef SpecMATSimSnapshot_h
+#define SpecMATSimSnapshot_h 1
+
+#include "globals.hh"
+
+#include <vector>
+#include <string>
+#include <pthread.h>
+
+/// Live view of a running simulation.
+///
+/// Keeps its own copy of the per-crystal and total spectra (same binning as
+/// the histograms of the run action) and every everyNEvents events hands
+/// the current state to a writer thread. The writer formats it as JSON and
+/// replaces the snapshot file atomically, so a reader always sees a complete
+/// file. The event loop only pays for the copy of the counts; when the
+/// writer is still busy with the previous snapshot the new one is skipped.
+///
+/// The file holds the number of events, the elapsed wall time, the event
+/// rate and the fired-crystal rate over the whole run and over the last
+/// interval, the fired crystals per crystal and the non-empty bins of every
+/// spectrum as [bin, counts] pairs.
+
+class SpecMATSimSnapshot
+{
+  public:
+    SpecMATSimSnapshot(G4int nbCrystals, const G4String& fileName, G4int everyNEvents);
+    ~SpecMATSimSnapshot();
+
+    // smeared energy [keV] of a fired crystal
+    void Fill(G4int copyNb, G4double energy);
+    // closes the event, starts a snapshot every everyNEvents events
+    void EndOfEvent(G4int nbFired);
+    // stops the writer and writes the final state from the calling thread
+    void Finish();
+
+  private:
+    struct State {
+      G4long events;
+      G4long fired;
+      G4double elapsed;
+      std::vector<unsigned int> counts;
+    };
+
+    static void* RunWriter(void* snapshot);
+    void WriterLoop();
+    void Write(const State& state);
+    G4double Elapsed() const;
+
+    G4int fNbCrystals;
+    G4int fNbBins;
+    G4String fFileName;
+    G4int fEveryNEvents;
+
+    State fLive;
+    G4double fStartTime;
+
+    // shared with the writer thread, guarded by fMutex
+    pthread_t fWriter;
+    pthread_mutex_t fMutex;
+    pthread_cond_t fCondition;
+    State fPending;
+    G4bool fPendingReady;
+    G4bool fStop;
+    G4bool fWriterRunning;
+
+    // only used by the writer thread, and by Finish() after it stopped
+    State fWriting;
+    G4long fLastEvents;
+    G4long fLastFired;
+    G4double fLastElapsed;
+    G4long fNbWritten;
+    G4long fNbFailed;
+    G4long fNbSkipped;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,32 @@
+/// \file SpecMATSimSparseIO.hh
+/// \brief Helpers for the compact binary files written by SpecMATSim
+
+#ifndef SpecMATSimSparseIO_h
+#define SpecMATSimSparseIO_h 1
+
+#include "globals.hh"
+
+#include <string>
+#include <istream>
+#include <ostream>
+
+/// Variable-length integer encoding used by the sparse output files.
+///
+/// Integers are stored 7 bits per byte, least significant group first,
+/// with the high bit set on every byte except the last one. Sparse rows
+/// store the distance to the previous non-empty bin, so most entries of
+/// a spectrum fit in one or two bytes.
+
+namespace SpecMATSimSparseIO
+{
+  void AppendVarint(std::string& buffer, unsigned long long value);
+  unsigned long long ReadVarint(const std::string& buffer, size_t& pos);
+  unsigned long long ReadVarint(std::istream& in);
+
+  void WriteRaw(std::ostream& out, const void* data, size_t size);
+  void ReadRaw(std::istream& in, void* data, size_t size);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,45 @@
+/// \file SpecMATSimSteppingAction.hh
+/// \brief Definition of the SpecMATSimSteppingAction class
+
+#ifndef SpecMATSimSteppingAction_h
+#define SpecMATSimSteppingAction_h 1
+
+#include "G4UserSteppingAction.hh"
+#include "globals.hh"
+
+class SpecMATSimEventAction;
+class SpecMATSimRunAction;
+class SpecMATSimDetectorConstruction;
+
+/// Stepping action class
+///
+/// Registered when the light collection map is tabulated: optical photons
+/// entering the quartz window are counted as collected and killed.
+///
+/// Also registered when the detector has a tracking envelope: particles
+/// crossing the kill shell outwards are killed ("kill") or counted
+/// ("tally"), and the steps taken beyond the shell are counted.
+
+class SpecMATSimSteppingAction : public G4UserSteppingAction
+{
+  public:
+    SpecMATSimSteppingAction(SpecMATSimEventAction* eventAction,
+                             SpecMATSimRunAction* runAction);
+    virtual ~SpecMATSimSteppingAction();
+
+    virtual void UserSteppingAction(const G4Step*);
+
+  private:
+    void TrackEnvelope(const G4Step* step);
+
+    SpecMATSimEventAction* fEventAction;
+    SpecMATSimRunAction* fRunAction;
+    // the envelope policy is only known after the geometry is constructed
+    const SpecMATSimDetectorConstruction* fDetector;
+    G4bool fEnvelopeKill;
+    G4bool fEnvelopeTally;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,67 @@
+/// \file SpecMATSimTrigger.hh
+/// \brief Definition of the SpecMATSimTrigger class
+
+#ifndef SpecMATSimTrigger_h
+#define SpecMATSimTrigger_h 1
+
+#include "globals.hh"
+
+#include <map>
+#include <vector>
+#include <utility>
+
+/// Event filter applied to the smeared crystal energies before any output.
+///
+/// A crystal fires when its energy is above its threshold (the common
+/// threshold unless a crystal threshold is set). The event is accepted when
+/// the number of fired crystals is within [minMultiplicity, maxMultiplicity]
+/// (maxMultiplicity 0 - no upper limit) and, if sum windows are defined, the
+/// summed energy of the fired crystals is inside one of them.
+///
+/// The default (threshold 0, multiplicity >= 1, no windows) only rejects
+/// events without energy in the array, which never produce any output.
+
+class SpecMATSimTrigger
+{
+  public:
+    SpecMATSimTrigger();
+    ~SpecMATSimTrigger();
+
+    // energies [keV] of the crystals of one event, keyed by copy number;
+    // fired receives the crystals above threshold
+    G4bool Accept(const std::map<G4int, G4double>& energies,
+                  std::map<G4int, G4double>& fired);
+
+    void SetThreshold(G4double val) { fThreshold = val; }
+    void SetCrystalThreshold(G4int copyNb, G4double val) { fCrystalThresholds[copyNb] = val; }
+    void SetMultiplicity(G4int min, G4int max) { fMinMultiplicity = min; fMaxMultiplicity = max; }
+    void AddSumWindow(G4double min, G4double max) { fSumWindows.push_back(std::make_pair(min, max)); }
+
+    // text of all trigger settings
+    G4String GetKey() const;
+
+    void ResetCounters();
+    void PrintCounters() const;
+    G4long GetNbAccepted() const { return fNbAccepted; }
+    G4long GetNbRejected() const { return fNbEmpty + fNbMultiplicity + fNbSum; }
+    // accepted, empty, multiplicity and sum rejected events, to add the
+    // counts of a worker process to the run
+    void GetCounters(G4long counters[4]) const;
+    void AddCounters(const G4long counters[4]);
+
+  private:
+    G4double fThreshold;
+    std::map<G4int, G4double> fCrystalThresholds;
+    G4int fMinMultiplicity;
+    G4int fMaxMultiplicity;
+    std::vector<std::pair<G4double, G4double> > fSumWindows;
+
+    G4long fNbAccepted;
+    G4long fNbEmpty;
+    G4long fNbMultiplicity;
+    G4long fNbSum;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
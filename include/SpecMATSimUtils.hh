@@ -0,0 +1,59 @@
+/// \file SpecMATSimUtils.hh
+/// \brief Small file and bookkeeping helpers used by SpecMATSim
+
+#ifndef SpecMATSimUtils_h
+#define SpecMATSimUtils_h 1
+
+#include "globals.hh"
+
+#include <string>
+#include <vector>
+
+/// Helpers shared by the classes that keep files between runs.
+///
+/// Hash() gives a short fingerprint of a configuration string (FNV-1a,
+/// 64 bit, as 16 hex digits); it is used to name cached files, not for
+/// any kind of security.
+
+namespace SpecMATSimUtils
+{
+  G4String Hash(const G4String& text);
+
+  G4bool FileExists(const G4String& fileName);
+  G4bool MakeDirectory(const G4String& dirName);
+  // writes to a temporary file and renames it, readers never see a partial file
+  G4bool WriteFileAtomically(const G4String& fileName, const std::string& content);
+  // whole file into content, false if it cannot be read
+  G4bool ReadFile(const G4String& fileName, std::string& content);
+  // copy through a temporary file, false if either side fails
+  G4bool CopyFile(const G4String& from, const G4String& to);
+  // size in bytes, -1 if the file does not exist
+  G4long FileSize(const G4String& fileName);
+
+  // Ranecu seeds of one event, derived from a base seed and the event number;
+  // neighbouring events get unrelated streams
+  void EventSeeds(long base, G4int eventNb, long seeds[2]);
+  // splitmix64 finaliser, spreads every input bit over the whole word
+  unsigned long long Mix64(unsigned long long z);
+  // event numbers and ranges, e.g. "37,1020-1022"; false if malformed
+  G4bool ParseEventList(const G4String& text, std::vector<G4int>& events);
+
+  // hash of the running executable, identifies the build
+  G4String ExecutableHash();
+
+  // peak resident memory of the process in bytes
+  G4long PeakRSS();
+  // user and system CPU time [s] of the reaped child processes, and the
+  // peak resident memory of the largest of them in bytes
+  G4double ChildrenCPUTime();
+  G4long ChildrenPeakRSS();
+  // current resident memory of the process in bytes, 0 if unknown
+  G4long CurrentRSS();
+
+  // text with quotes and backslashes escaped for a JSON string
+  G4String JsonEscape(const G4String& text);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
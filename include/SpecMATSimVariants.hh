@@ -0,0 +1,92 @@
+/// \file SpecMATSimVariants.hh
+/// \brief Definition of the SpecMATSimVariants class
+
+#ifndef SpecMATSimVariants_h
+#define SpecMATSimVariants_h 1
+
+#include "globals.hh"
+
+#include <vector>
+#include <utility>
+
+class SpecMATSimDetectorConstruction;
+class SpecMATSimPrimaryGeneratorAction;
+class SpecMATSimRunAction;
+
+/// Correlated sampling of geometry variants.
+///
+/// Every variant of the file is run with the same number of events, and
+/// every event reseeds the engine from the seed base and its event number.
+/// Event i therefore starts with the same source kinematics in every
+/// variant, and the efficiency differences to the first (reference)
+/// variant are estimated from the paired events, with a much smaller
+/// variance than from independent runs.
+///
+/// The file has one variant per line, a name followed by settings applied
+/// on top of the detector construction defaults; '#' starts a comment:
+///
+///     reference
+///     crystal25  sciCrystSize=25
+///     noChamber  vacuumChamber=no
+///
+/// Settings: sciCrystSize (all three half-sizes), sciCrystSizeX,
+/// sciCrystSizeY, sciCrystSizeZ [mm], sciCrystMat, vacuumChamber,
+/// vacuumFlangeThickFrontOfScint [mm], nbSegments, nbCrystInSegmentRow,
+/// nbCrystInSegmentColumn, sciReflWallThick (X and Y), sciReflWallThickX,
+/// sciReflWallThickY, sciReflWindThick, sciHousWallThick (X and Y),
+/// sciHousWallThickX, sciHousWallThickY, sciHousWindThick [mm].
+///
+/// The same files describe the layouts of SpecMATSimScreen, which applies
+/// them one by one without running events; SpecMATSimOptimiser applies
+/// the settings of its candidates.
+
+class SpecMATSimVariants
+{
+  public:
+    SpecMATSimVariants(SpecMATSimDetectorConstruction* detector,
+                       SpecMATSimPrimaryGeneratorAction* generator,
+                       SpecMATSimRunAction* runAction);
+    ~SpecMATSimVariants();
+
+    // name and value of one setting of the file
+    typedef std::pair<G4String, G4String> Setting;
+
+    // false if the file cannot be read or has an unknown setting; the
+    // current detector settings become the defaults of every variant
+    G4bool Read(const G4String& fileName);
+    // runs all variants, outputs are named baseName_<variant>
+    void Run(G4int nbEvents, long seedBase, const G4String& baseName);
+
+    size_t GetNbVariants() const { return fVariants.size(); }
+    const G4String& GetName(size_t i) const { return fVariants[i].name; }
+    // sets the detector parameters of variant i, the geometry is not rebuilt
+    void Apply(size_t i) const { Apply(fVariants[i]); }
+
+    // the current detector settings become the defaults of every variant,
+    // called by Read()
+    void SaveDefaults();
+    // sets the defaults, then the settings on top of them
+    void Apply(const std::vector<Setting>& settings) const;
+    G4bool IsKnown(const G4String& key) const;
+
+  private:
+    struct Variant {
+      G4String name;
+      std::vector<Setting> settings;
+    };
+
+    void Apply(const Variant& variant) const;
+    void Report(const std::vector<std::vector<unsigned char> >& records,
+                long seedBase, const G4String& baseName) const;
+
+    SpecMATSimDetectorConstruction* fDetector;
+    SpecMATSimPrimaryGeneratorAction* fGenerator;
+    SpecMATSimRunAction* fRunAction;
+    std::vector<Variant> fVariants;
+    // settings of the detector before the first variant
+    Variant fDefaults;
+};
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+#endif
@@ -0,0 +1,106 @@
+/// \file SpecMATSimCoincidenceMatrix.cc
+/// \brief Implementation of the SpecMATSimCoincidenceMatrix class
+
+#include "SpecMATSimCoincidenceMatrix.hh"
+#include "SpecMATSimSparseIO.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimCoincidenceMatrix::SpecMATSimCoincidenceMatrix(const G4String& name,
+                                                         G4int nbBins,
+                                                         G4double binWidth,
+                                                         G4int blockSize)
+ : fName(name),
+   fNbBins(nbBins),
+   fBinWidth(binWidth),
+   fBlockSize(blockSize),
+   fNbBlocks((nbBins + blockSize - 1)/blockSize),
+   fNbAllocatedBlocks(0)
+{
+  // upper triangle of blocks, diagonal included
+  fBlocks.assign(fNbBlocks*(fNbBlocks+1)/2, (std::vector<unsigned int>*)0);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimCoincidenceMatrix::~SpecMATSimCoincidenceMatrix()
+{
+  for (size_t i = 0; i < fBlocks.size(); i++) delete fBlocks[i];
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SpecMATSimCoincidenceMatrix::BlockIndex(G4int blockX, G4int blockY) const
+{
+  // row blockX of the triangle holds the blocks blockY = blockX..fNbBlocks-1
+  return blockX*fNbBlocks - blockX*(blockX-1)/2 + (blockY - blockX);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimCoincidenceMatrix::Fill(G4double energy1, G4double energy2)
+{
+  if (energy1 < 0. || energy2 < 0.) return;
+  G4int x = G4int(energy1/fBinWidth);
+  G4int y = G4int(energy2/fBinWidth);
+  if (x >= fNbBins || y >= fNbBins) return;
+  if (x > y) { G4int tmp = x; x = y; y = tmp; }
+
+  std::vector<unsigned int>*& block = fBlocks[BlockIndex(x/fBlockSize, y/fBlockSize)];
+  if (!block) {
+    block = new std::vector<unsigned int>(fBlockSize*fBlockSize, 0);
+    fNbAllocatedBlocks++;
+  }
+  (*block)[(x%fBlockSize)*fBlockSize + (y%fBlockSize)]++;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimCoincidenceMatrix::Write(std::ostream& out) const
+{
+  // name, number of non-empty blocks, then per block: varint block X and Y,
+  // varint byte length and the varint (distance to previous cell, count) pairs
+  G4int nameLength = fName.size();
+  SpecMATSimSparseIO::WriteRaw(out, &nameLength, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, fName.data(), nameLength);
+  SpecMATSimSparseIO::WriteRaw(out, &fNbAllocatedBlocks, sizeof(G4int));
+
+  std::string buffer;
+  for (G4int blockX = 0; blockX < fNbBlocks; blockX++) {
+    for (G4int blockY = blockX; blockY < fNbBlocks; blockY++) {
+      const std::vector<unsigned int>* block = fBlocks[BlockIndex(blockX, blockY)];
+      if (!block) continue;
+      std::string cells;
+      G4int previous = 0;
+      for (G4int cell = 0; cell < fBlockSize*fBlockSize; cell++) {
+        if ((*block)[cell] == 0) continue;
+        SpecMATSimSparseIO::AppendVarint(cells, cell - previous);
+        SpecMATSimSparseIO::AppendVarint(cells, (*block)[cell]);
+        previous = cell;
+      }
+      buffer.clear();
+      SpecMATSimSparseIO::AppendVarint(buffer, blockX);
+      SpecMATSimSparseIO::AppendVarint(buffer, blockY);
+      SpecMATSimSparseIO::AppendVarint(buffer, cells.size());
+      SpecMATSimSparseIO::WriteRaw(out, buffer.data(), buffer.size());
+      SpecMATSimSparseIO::WriteRaw(out, cells.data(), cells.size());
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimCoincidenceMatrix::GetAllocatedBytes() const
+{
+  return G4double(fNbAllocatedBlocks)*fBlockSize*fBlockSize*sizeof(unsigned int)
+         + G4double(fBlocks.size())*sizeof(void*);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimCoincidenceMatrix::GetDenseBytes() const
+{
+  return G4double(fNbBins)*fNbBins*sizeof(unsigned int);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,167 @@
+/// \file SpecMATSimCoincidences.cc
+/// \brief Implementation of the SpecMATSimCoincidences class
+
+#include "SpecMATSimCoincidences.hh"
+#include "SpecMATSimCoincidenceMatrix.hh"
+#include "SpecMATSimSparseIO.hh"
+
+#include "G4UIcommand.hh"
+
+#include <fstream>
+#include <cstdlib>
+
+namespace {
+  // Same binning as the energy histograms of the run action
+  const G4int kCoincidenceNbBins = 15500;
+  const G4double kCoincidenceBinWidth = 1.;   // keV
+  const G4int kCoincidenceBlockSize = 64;
+  const char kCoincidenceMagic[8] = {'S','M','G','G','M','A','T','1'};
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimCoincidences::SpecMATSimCoincidences(G4int nbSegments,
+                                               G4int nbCrystInSegmentRow,
+                                               G4int nbCrystInSegmentColumn,
+                                               G4bool addBack,
+                                               G4bool angleGroups)
+ : fNbSegments(nbSegments),
+   fNbCrystInSegmentRow(nbCrystInSegmentRow),
+   fNbCrystInSegmentColumn(nbCrystInSegmentColumn),
+   fMatrix(0),
+   fAddBackMatrix(0),
+   fNbEvents(0)
+{
+  fMatrix = new SpecMATSimCoincidenceMatrix("gg", kCoincidenceNbBins, kCoincidenceBinWidth, kCoincidenceBlockSize);
+  if (addBack) {
+    fAddBackMatrix = new SpecMATSimCoincidenceMatrix("gg_addback", kCoincidenceNbBins, kCoincidenceBinWidth, kCoincidenceBlockSize);
+  }
+  if (angleGroups) {
+    for (G4int dSeg = 0; dSeg <= fNbSegments/2; dSeg++) {
+      fAngleMatrices.push_back(
+        new SpecMATSimCoincidenceMatrix("gg_dSeg" + G4UIcommand::ConvertToString(dSeg),
+                                        kCoincidenceNbBins, kCoincidenceBinWidth, kCoincidenceBlockSize));
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimCoincidences::~SpecMATSimCoincidences()
+{
+  delete fMatrix;
+  delete fAddBackMatrix;
+  for (size_t i = 0; i < fAngleMatrices.size(); i++) delete fAngleMatrices[i];
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SpecMATSimCoincidences::Segment(G4int copyNb) const
+{
+  return (copyNb-1)/(fNbCrystInSegmentRow*fNbCrystInSegmentColumn);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimCoincidences::AreNeighbours(G4int copyNb1, G4int copyNb2) const
+{
+  if (Segment(copyNb1) != Segment(copyNb2)) return false;
+  // copy numbers run along a segment row first, see Construct()
+  G4int local1 = (copyNb1-1)%(fNbCrystInSegmentRow*fNbCrystInSegmentColumn);
+  G4int local2 = (copyNb2-1)%(fNbCrystInSegmentRow*fNbCrystInSegmentColumn);
+  G4int dCol = std::abs(local1%fNbCrystInSegmentRow - local2%fNbCrystInSegmentRow);
+  G4int dRow = std::abs(local1/fNbCrystInSegmentRow - local2/fNbCrystInSegmentRow);
+  return dCol + dRow == 1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimCoincidences::FillEvent(const std::map<G4int, G4double>& energies)
+{
+  if (energies.size() < 2) return;
+  fNbEvents++;
+
+  std::vector<G4int> copyNbs;
+  std::vector<G4double> values;
+  std::map<G4int, G4double>::const_iterator it;
+  for (it = energies.begin(); it != energies.end(); it++) {
+    copyNbs.push_back(it->first);
+    values.push_back(it->second);
+  }
+
+  const size_t nbFired = copyNbs.size();
+  for (size_t i = 0; i < nbFired; i++) {
+    for (size_t j = i+1; j < nbFired; j++) {
+      fMatrix->Fill(values[i], values[j]);
+      if (!fAngleMatrices.empty()) {
+        G4int dSeg = std::abs(Segment(copyNbs[i]) - Segment(copyNbs[j]));
+        if (dSeg > fNbSegments - dSeg) dSeg = fNbSegments - dSeg;
+        fAngleMatrices[dSeg]->Fill(values[i], values[j]);
+      }
+    }
+  }
+
+  if (fAddBackMatrix) {
+    // Clusters of touching crystals, merged by relabelling
+    std::vector<size_t> cluster(nbFired);
+    for (size_t i = 0; i < nbFired; i++) cluster[i] = i;
+    for (size_t i = 0; i < nbFired; i++) {
+      for (size_t j = i+1; j < nbFired; j++) {
+        if (cluster[i] == cluster[j] || !AreNeighbours(copyNbs[i], copyNbs[j])) continue;
+        size_t from = cluster[j], to = cluster[i];
+        for (size_t k = 0; k < nbFired; k++) {
+          if (cluster[k] == from) cluster[k] = to;
+        }
+      }
+    }
+    std::map<size_t, G4double> sums;
+    for (size_t i = 0; i < nbFired; i++) sums[cluster[i]] += values[i];
+
+    std::map<size_t, G4double>::const_iterator first, second;
+    for (first = sums.begin(); first != sums.end(); first++) {
+      second = first;
+      for (second++; second != sums.end(); second++) {
+        fAddBackMatrix->Fill(first->second, second->second);
+      }
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimCoincidences::Write(const G4String& fileName) const
+{
+  std::vector<const SpecMATSimCoincidenceMatrix*> matrices;
+  matrices.push_back(fMatrix);
+  if (fAddBackMatrix) matrices.push_back(fAddBackMatrix);
+  for (size_t i = 0; i < fAngleMatrices.size(); i++) matrices.push_back(fAngleMatrices[i]);
+
+  // Layout: char[8] "SMGGMAT1", G4int number of matrices, number of bins,
+  // block size, G4double bin width [keV], then the matrices one after the other
+  std::ofstream out(fileName.c_str(), std::ios::binary);
+  if (!out) {
+    G4cerr << "Cannot open coincidence matrix file " << fileName << G4endl;
+    return;
+  }
+  G4int nbMatrices = matrices.size();
+  G4int nbBins = kCoincidenceNbBins;
+  G4int blockSize = kCoincidenceBlockSize;
+  G4double binWidth = kCoincidenceBinWidth;
+  SpecMATSimSparseIO::WriteRaw(out, kCoincidenceMagic, sizeof(kCoincidenceMagic));
+  SpecMATSimSparseIO::WriteRaw(out, &nbMatrices, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, &nbBins, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, &blockSize, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, &binWidth, sizeof(G4double));
+
+  G4cout << "\nGamma-gamma matrices (" << fNbEvents << " events with multiplicity >= 2) written to "
+         << fileName << G4endl;
+  for (size_t i = 0; i < matrices.size(); i++) {
+    matrices[i]->Write(out);
+    G4cout << "  " << matrices[i]->GetName() << ": "
+           << matrices[i]->GetNbAllocatedBlocks() << " blocks, "
+           << matrices[i]->GetAllocatedBytes()/1048576. << " MB in memory instead of "
+           << matrices[i]->GetDenseBytes()/1048576. << " MB dense" << G4endl;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -2,6 +2,9 @@
 /// \brief Implementation of the SpecMATSimDetectorConstruction class
 
 #include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimLightMap.hh"
+#include "SpecMATSimPSLightCollection.hh"
+#include "SpecMATSimPSFirstHitTime.hh"
 
 #include "G4NistManager.hh"
 #include "G4Box.hh"
@@ -21,13 +24,41 @@
 #include "G4SystemOfUnits.hh"
 #include "G4SubtractionSolid.hh"
 #include "G4VSensitiveDetector.hh"
+#include "G4MaterialPropertiesTable.hh"
+#include "G4OpticalSurface.hh"
+#include "G4LogicalSkinSurface.hh"
+#include "G4LogicalVolumeStore.hh"
+#include "G4PhysicalVolumeStore.hh"
+#include "G4SolidStore.hh"
+#include "G4GeometryManager.hh"
+#include "G4RunManager.hh"
+#include "SpecMATSimUtils.hh"
+#include "SpecMATSimPhases.hh"
+
+#ifdef G4LIB_USE_GDML
+#include "G4GDMLParser.hh"
+#endif
+
+#include <algorithm>
+#include <cstdio>
+#include <set>
+#include <sstream>
 
 // ###################################################################################
 
 SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 : G4VUserDetectorConstruction(),
-  fCheckOverlaps(true)
+  fCheckOverlaps(true),
+  fLightMap(0),
+  fGeometryFromGDML(false),
+  envelopeRadius(0.),
+  envelopeHalfZ(0.),
+  killShellSideLog(0),
+  killShellCapLog(0)
 {
+  // The constructor only defines parameters, materials and derived dimensions,
+  // all solids and volumes are built in Construct() from the values set here
+
   //****************************************************************************//
   //********************************* World ************************************//
   //****************************************************************************//
@@ -35,44 +66,9 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
   //half-size
   worldSizeXY = 60*cm;
   worldSizeZ  = 60*cm;
+  fWorldSizeXY = worldSizeXY;
+  fWorldSizeZ = worldSizeZ;
 
-  G4double z1, a1, fractionmass1, density1;
-    G4String name1, symbol1;
-      G4int ncomponents1;
-
-        a1 = 14.01*g/mole;
-	  G4Element* elN  = new G4Element(name1="Nitrogen",symbol1="N" , z1= 7., a1);
-
-	    a1 = 16.00*g/mole;
-	      G4Element* elO  = new G4Element(name1="Oxygen"  ,symbol1="O" , z1= 8., a1);
-
-	        density1 = 0.2E-5*mg/cm3;
-		  Air = new G4Material(name1="Air",density1,ncomponents1=2);
-		    Air->AddElement(elN, fractionmass1=70*perCent);
-		      Air->AddElement(elO, fractionmass1=30*perCent);
-
-  // Define world material
-  G4NistManager* nist = G4NistManager::Instance();
-  default_mat = nist->FindOrBuildMaterial("G4_AIR", false);
-
-  solidWorld =
-    new G4Box("World",                       //its name
-       worldSizeXY, worldSizeXY, worldSizeZ); //its size
-
-  logicWorld =
-    new G4LogicalVolume(solidWorld,          //its solid
-                        Air,         //its material
-                        "World");            //its name
-
-  physWorld =
-    new G4PVPlacement(0,                     //no rotation
-                      G4ThreeVector(),       //at (0,0,0)
-                      logicWorld,            //its logical volume
-                      "World",               //its name
-                      0,                     //its mother  volume
-                      false,                 //no boolean operation
-                      0,                     //copy number
-                      fCheckOverlaps);       // checking overlaps
   //****************************************************************************//
   //******************************* Detector Array *****************************//
   //****************************************************************************//
@@ -88,25 +84,129 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
   vacuumFlangeSizeZ = 10*mm;
   vacuumFlangeThickFrontOfScint = 1*mm;
 
-  dPhi = twopi/nbSegments;
-  half_dPhi = 0.5*dPhi;
-  tandPhi = std::tan(half_dPhi);
   //****************************************************************************//
-  //**************** CeBr3 cubic scintillator 1.5"x1.5"x1.5" *******************//
+  //***************************** Cell geometry ********************************//
   //****************************************************************************//
+  // "boolean" - reflector, housing and flange are subtraction solids placed
+  //             next to the crystal and the segment
+  // "nested"  - the same material layout from plain boxes: the crystal sits in
+  //             the reflector box, which sits in the housing box, and the flange
+  //             is a front plate with rim boxes. Faster to navigate, but the
+  //             reflector box also covers the window face of the crystal, so
+  //             the light collection tabulation always uses "boolean"
+  cellGeometry = "boolean"; //"boolean"/"nested"
 
-  //--------------------------------------------------------//
-  //***************** Scintillation crystal ****************//
-  //--------------------------------------------------------//
+  //****************************************************************************//
+  //**************************** Tracking envelope *****************************//
+  //****************************************************************************//
+  // A thin cylindrical shell of world material fitted around the segments and
+  // the chamber flanges
+  // "off"   - no shell, particles are tracked to the world boundary
+  // "kill"  - particles crossing the shell outwards are killed
+  // "tally" - particles are tracked on; steps beyond the shell and returns
+  //           through it are counted, for back-scatter studies
+  envelope = "off"; //"off"/"kill"/"tally"
+  envelopeMargin = 1*mm;         // gap between the array and the shell
+  envelopeThickness = 1*mm;
+
+  //****************************************************************************//
+  //******************************* GDML ***************************************//
+  //****************************************************************************//
+  // "no"    - the array is built procedurally
+  // "write" - the array is built procedurally and written to gdmlFile
+  // "read"  - the world is read from gdmlFile, construction is skipped
+  // "cache" - the world is read from gdmlCacheDir if the same geometry
+  //           parameters were used before, otherwise it is built and stored
+  // Needs Geant4 with GDML support (cmake -DWITH_GEANT4_GDML=ON)
+  gdmlGeometry = "no"; //"no"/"write"/"read"/"cache"
+  gdmlFile = "SpecMATSim.gdml";
+  gdmlCacheDir = "geometryCache";
+
+  //****************************************************************************//
+  //************************** Light collection ********************************//
+  //****************************************************************************//
+  // "no"       - light collection is folded into the resolution formula
+  // "tabulate" - optical photons from a grid of points in crystal Nb1 are
+  //              tracked once and the map is written to lightMapFile
+  // "map"      - deposits are weighted with the map read from lightMapFile
+  lightCollection = "no"; //"no"/"tabulate"/"map"
+  lightMapFile = "lightCollectionMap.dat";
+  lightMapNbBinsX = 5;
+  lightMapNbBinsY = 5;
+  lightMapNbBinsZ = 10;
+
+  //****************************************************************************//
+  //***************************** Digitizer ************************************//
+  //****************************************************************************//
+  // "yes" records the time of the first deposit in every crystal and streams
+  // digitized signals, see SpecMATSimDigitizer for the read-out parameters
+  digitizer = "no"; //"yes"/"no"
+
+  //****************************************************************************//
+  //**************** CeBr3 cubic scintillator 1.5"x1.5"x1.5" *******************//
+  //****************************************************************************//
   // Dimensions of the crystal
   sciCrystSizeX = 19.*mm;								//Size and position of all components depends on Crystal size and position.
   sciCrystSizeY = 19.*mm;
   sciCrystSizeZ = 19.*mm;
 
+  // Position of the crystal
+  sciCrystPosX = 0;									//Position of the Crystal along the X axis
+  sciCrystPosY = 0;									//Position of the Crystal along the Y axis
+  sciCrystPosZ = 0; 			 						//Position of the Crystal along the Z axis
+
+  // Thickness of reflector walls
+  sciReflWallThickX = 0.5*mm;
+  sciReflWallThickY = 0.5*mm;
+  sciReflWindThick = 1.2*mm;
+
+  // Thickness of housing walls
+  sciHousWallThickX = 3.5*mm;
+  sciHousWallThickY = 3.5*mm;
+  sciHousWindThick = 0.8*mm;
+
+  // Thickness of the Window (half-side)
+  sciWindSizeZ = 1.*mm;									        //Z half-size of the Window
+
+  SpecMATSimPhases::Instance()->Start("materials");
+  DefineMaterials();
+  SpecMATSimPhases::Instance()->Stop("materials");
+  ComputeDimensions();
+}
+
+// ###################################################################################
+
+SpecMATSimDetectorConstruction::~SpecMATSimDetectorConstruction()
+{
+  delete fLightMap;
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::DefineMaterials()
+{
+  G4double z1, a1, fractionmass1, density1;
+    G4String name1, symbol1;
+      G4int ncomponents1;
+
+        a1 = 14.01*g/mole;
+	  G4Element* elN  = new G4Element(name1="Nitrogen",symbol1="N" , z1= 7., a1);
+
+	    a1 = 16.00*g/mole;
+	      G4Element* elO  = new G4Element(name1="Oxygen"  ,symbol1="O" , z1= 8., a1);
+
+	        density1 = 0.2E-5*mg/cm3;
+		  Air = new G4Material(name1="Air",density1,ncomponents1=2);
+		    Air->AddElement(elN, fractionmass1=70*perCent);
+		      Air->AddElement(elO, fractionmass1=30*perCent);
+
+  // Define world material
+  G4NistManager* nist = G4NistManager::Instance();
+  default_mat = nist->FindOrBuildMaterial("G4_AIR", false);
+
   // Define Scintillation material and its compounds
 
-  /*
-  // LaBr3 material
+  // LaBr3 material, selectable with SetSciCrystMat()
   La =
       new G4Element("Lanthanum",
             "La",
@@ -127,20 +227,12 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
   LaBr3->AddElement (La, natoms=1);
   LaBr3->AddElement (Br, natoms=3);
 
-  sciCrystMat = LaBr3;
-  */
-
   // CeBr3 material
   Ce =
 	  new G4Element("Cerium",
 		  	"Ce",
 			z=58.,
 			a=140.116*g/mole);
-  Br =
-	  new G4Element("Bromine",
-		  	"Br",
-			z=35.,
-			a=79.904*g/mole);
 
   density = 5.1*g/cm3;
   CeBr3 =
@@ -152,48 +244,6 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 
   sciCrystMat = CeBr3;
 
-  // Position of the crystal
-  sciCrystPosX = 0;									//Position of the Crystal along the X axis
-  sciCrystPosY = 0;									//Position of the Crystal along the Y axis
-  sciCrystPosZ = 0; 			 						//Position of the Crystal along the Z axis
-
-  sciCrystPos = G4ThreeVector(sciCrystPosX,
-		  	      sciCrystPosY,
-			      sciCrystPosZ);
-  // Define box for Crystal
-  sciCrystSolid =
-	  new G4Box("sciCrystSolid",
-		    sciCrystSizeX,
-		    sciCrystSizeY,
-		    sciCrystSizeZ);
-
-  // Define Logical Volume for Crystal
-  sciCrystLog =
-	  new G4LogicalVolume(sciCrystSolid,
-			      sciCrystMat,
-			      "crystal");
-
-
-  // Visualization attributes for the Crystal logical volume
-  sciCrystVisAtt =
-	  new G4VisAttributes(G4Colour(0.0, 0.0, 1.0));					//Instantiation of visualization attributes with blue colour
-  sciCrystVisAtt->SetVisibility(true);							//Pass this object to Visualization Manager for visualization
-  sciCrystVisAtt->SetForceWireframe(true);						//I still believe that it might make Crystal transparent
-  sciCrystLog->SetVisAttributes(sciCrystVisAtt);					//Assignment of visualization attributes to the logical volume of the Crystal
-
-  //--------------------------------------------------------//
-  //*********************** Reflector **********************//
-  //--------------------------------------------------------//
-  // Thickness of reflector walls
-  sciReflWallThickX = 0.5*mm;
-  sciReflWallThickY = 0.5*mm;
-  sciReflWindThick = 1.2*mm;
-
-  // Outer dimensions of the reflector relative to the crystal size
-  sciReflSizeX = sciCrystSizeX + sciReflWallThickX;
-  sciReflSizeY = sciCrystSizeY + sciReflWallThickY;
-  sciReflSizeZ = sciCrystSizeZ + sciReflWindThick/2;
-
   // Define Reflector (white powder TiO2) material and its compounds
   Ti =
 	  new G4Element("Titanium",
@@ -214,6 +264,74 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
   TiO2->AddElement (Ti, natoms=1);
   TiO2->AddElement (O, natoms=2);
 
+  // Define Housing material and its compounds
+  Al =
+	  new G4Element("Aluminum",
+			"Al",
+			z=13.,
+			a=26.98*g/mole);
+
+  density = 2.7*g/cm3;
+  Al_Alloy =
+          new G4Material("Aluminum_Alloy",
+			 density,
+			 ncomponents=1);
+  Al_Alloy->AddElement (Al, natoms=1);
+
+  // Define compound elements for Quartz material
+
+  Si =
+	  new G4Element("Silicon",
+		  	"Si",
+			z=14.,
+			a=28.09*g/mole);
+
+  // Define Quartz material
+  density = 2.66*g/cm3;									//Assign density of Quartz ot the density variable
+  Quartz = 										//Define object for the Qartz material
+	  new G4Material("Quartz", 							//Name of the material
+		  	 density, 							//Density of the material
+			 ncomponents=2);						//Number of the compound elements in the material
+  Quartz->AddElement (Si, natoms=1);							//Adds chemical element and number of atoms of this element to the material
+  Quartz->AddElement (O, natoms=2);
+
+  // Define segment which will conain crystals
+  segment_mat = nist->FindOrBuildMaterial("G4_Galactic", false);
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::SetSciCrystMat(G4String materialName)
+{
+  G4Material* material = G4Material::GetMaterial(materialName, false);
+  if (!material) {
+      G4ExceptionDescription msg;
+      msg << "Crystal material " << materialName << " is not defined, keeping "
+          << sciCrystMat->GetName() << ".";
+      G4Exception("SpecMATSimDetectorConstruction::SetSciCrystMat()",
+                  "SpecMATSim006", JustWarning, msg);
+      return;
+  }
+  sciCrystMat = material;
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::ComputeDimensions()
+{
+  dPhi = twopi/nbSegments;
+  half_dPhi = 0.5*dPhi;
+  tandPhi = std::tan(half_dPhi);
+
+  sciCrystPos = G4ThreeVector(sciCrystPosX,
+		  	      sciCrystPosY,
+			      sciCrystPosZ);
+
+  // Outer dimensions of the reflector relative to the crystal size
+  sciReflSizeX = sciCrystSizeX + sciReflWallThickX;
+  sciReflSizeY = sciCrystSizeY + sciReflWallThickY;
+  sciReflSizeZ = sciCrystSizeZ + sciReflWindThick/2;
+
   // Position of the reflector relative to the crystal position
   sciReflPosX = sciCrystPosX;
   sciReflPosY = sciCrystPosY;
@@ -223,6 +341,206 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 		  	     sciReflPosY,
 			     sciReflPosZ);
 
+  // Outer dimensions of the housing relative to the crystal size and to the thickness of the reflector
+  sciHousSizeX = sciCrystSizeX + sciReflWallThickX + sciHousWallThickX;
+  sciHousSizeY = sciCrystSizeY + sciReflWallThickY + sciHousWallThickY;
+  sciHousSizeZ = sciCrystSizeZ + sciReflWindThick/2 + sciHousWindThick/2;
+
+  // Position of the housing relative to the crystal position
+  sciHousPosX = sciCrystPosX;
+  sciHousPosY = sciCrystPosY;
+  sciHousPosZ = sciCrystPosZ - (sciReflWindThick/2 + sciHousWindThick/2);
+
+  // Dimensions of the Window (half-side)
+  sciWindSizeX = sciCrystSizeX + sciReflWallThickX + sciHousWallThickX;						//X half-size of the Window
+  sciWindSizeY = sciCrystSizeY + sciReflWallThickY + sciHousWallThickY;						//Y half-size of the Window
+
+  // Position of the window relative to the crystal
+  sciWindPosX = sciCrystPosX ;								//Position of the Window along the X axis
+  sciWindPosY = sciCrystPosY ;								//Position of the Window along the Y axis
+  sciWindPosZ = sciCrystPosZ + sciCrystSizeZ + sciWindSizeZ;	 			//Position of the Window relative to the Al Housing along the Z axis
+
+  sciWindPos = G4ThreeVector(sciWindPosX, 				//Position of the Window in space relative to the Al Housing
+		  	     sciWindPosY,
+			     sciWindPosZ);
+
+  if (vacuumFlangeSizeY<sciHousSizeY*nbCrystInSegmentColumn) {
+                vacuumFlangeSizeY=sciHousSizeY*nbCrystInSegmentColumn;
+  }
+}
+
+// ###################################################################################
+
+G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
+{
+  if (cellGeometry == "nested" && lightCollection == "tabulate") {
+      G4Exception("SpecMATSimDetectorConstruction::Construct()", "SpecMATSim003", JustWarning,
+                  "Optical photons need the open window face of the boolean cells, using cellGeometry = \"boolean\".");
+      cellGeometry = "boolean";
+  }
+
+  ComputeDimensions();
+  circleR1 = SpecMATSimDetectorConstruction::ComputeCircleR1();
+
+  // Arrays larger than the default world get a world that holds them
+  G4double arrayRadius, arrayHalfZ;
+  ComputeArrayExtent(arrayRadius, arrayHalfZ);
+  G4double worldMargin = 10*cm + ((envelope != "off") ? envelopeMargin+envelopeThickness : 0.);
+  fWorldSizeXY = std::max(worldSizeXY, arrayRadius+worldMargin);
+  fWorldSizeZ = std::max(worldSizeZ, arrayHalfZ+worldMargin);
+
+  G4String cacheFile = gdmlCacheDir + "/SpecMATSim_" + SpecMATSimUtils::Hash(GetGeometryKey()) + ".gdml";
+
+  SpecMATSimPhases::Instance()->Start("geometry");
+  fGeometryFromGDML = false;
+  if (gdmlGeometry == "read") {
+      fGeometryFromGDML = ReadGDML(gdmlFile);
+      if (!fGeometryFromGDML) {
+          G4ExceptionDescription msg;
+          msg << "Cannot build the array from the GDML file " << gdmlFile << ".";
+          G4Exception("SpecMATSimDetectorConstruction::Construct()",
+                      "SpecMATSim002", FatalException, msg);
+      }
+  }
+  else if (gdmlGeometry == "cache" && SpecMATSimUtils::FileExists(cacheFile)) {
+      fGeometryFromGDML = ReadGDML(cacheFile);
+  }
+
+  if (!fGeometryFromGDML) {
+      // The placements are checked afterwards in one pass, timed on its own
+      G4bool checkOverlaps = fCheckOverlaps;
+      fCheckOverlaps = false;
+      ConstructGeometry();
+      fCheckOverlaps = checkOverlaps;
+      if (gdmlGeometry == "write") {
+          WriteGDML(gdmlFile);
+      }
+      else if (gdmlGeometry == "cache") {
+          SpecMATSimUtils::MakeDirectory(gdmlCacheDir);
+          WriteGDML(cacheFile);
+      }
+  }
+  SpecMATSimPhases::Instance()->Stop("geometry");
+
+  if (!fGeometryFromGDML && fCheckOverlaps) {
+      SpecMATSimPhases::Instance()->Start("overlaps");
+      std::set<const G4LogicalVolume*> checked;
+      CheckOverlaps(physWorld->GetLogicalVolume(), checked);
+      SpecMATSimPhases::Instance()->Stop("overlaps");
+  }
+
+  SetVisAttributes();
+
+  if (lightCollection == "tabulate") {
+      DefineOpticalProperties();
+  }
+
+  // Print materials
+  //G4cout << *(G4Material::GetMaterialTable()) << G4endl;
+  //
+  // Print dimensions of the scintillator array
+  G4cout <<""<< G4endl;
+  G4cout <<"$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"<< G4endl;
+  G4cout <<"$$$$"<< G4endl;
+  G4cout <<"$$$$"<<" Crystal material: "<<sciCrystMat->GetName()<< G4endl;
+  G4cout <<"$$$$"<<" Single crystal dimensions: "<<sciCrystSizeX*2<<"mmx"<<sciCrystSizeY*2<<"mmx"<<sciCrystSizeZ*2<<"mm "<< G4endl;
+  G4cout <<"$$$$"<<" Dimensions of a single crystal housing: "<<sciHousSizeX*2<<"mmx"<<sciHousSizeY*2<<"mmx"<<sciHousSizeZ*2<<"mm "<< G4endl;
+  G4cout <<"$$$$"<<" Number of segments in the array: "<<nbSegments<<" "<< G4endl;
+  G4cout <<"$$$$"<<" Number of crystals in a segment row: "<<nbCrystInSegmentRow<<" "<< G4endl;
+  G4cout <<"$$$$"<<" Number of crystals in a segment column: "<<nbCrystInSegmentColumn<<" "<< G4endl;
+  G4cout <<"$$$$"<<" Number of crystals in the array: "<<nbSegments*nbCrystInSegmentRow*nbCrystInSegmentColumn<<" "<< G4endl;
+  G4cout <<"$$$$"<<" Radius of a circle inscribed in the array: "<<circleR1<<"mm "<< G4endl;
+  G4cout <<"$$$$"<<" Segment width: : "<<sciHousSizeY*nbCrystInSegmentColumn<<"mm "<< G4endl;
+  G4cout <<"$$$$"<<" Flange width: : "<<vacuumFlangeSizeY<<"mm "<< G4endl;
+  if (fGeometryFromGDML) {
+      G4cout <<"$$$$"<<" Geometry read from GDML, construction and overlap checks skipped"<< G4endl;
+  }
+  G4cout <<"$$$$"<< G4endl;
+  G4cout <<"$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"<< G4endl;
+  G4cout <<""<< G4endl;
+
+  if (envelope != "off") {
+      G4cout <<"$$$$"<<" Tracking envelope ("<<envelope<<"): radius "<<envelopeRadius
+             <<"mm, half length "<<envelopeHalfZ<<"mm "<< G4endl;
+  }
+
+  fCrystalTransforms.clear();
+  FillCrystalTransforms(physWorld, G4Transform3D());
+
+  CreateScorers();
+
+  //
+  //always return the physical World
+  //
+  return physWorld;
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::UpdateGeometry()
+{
+  ClearGeometry();
+  G4RunManager::GetRunManager()->DefineWorldVolume(Construct());
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::ClearGeometry()
+{
+  // The stores own the old volumes, the scorers and materials are kept
+  G4GeometryManager::GetInstance()->OpenGeometry();
+  G4PhysicalVolumeStore::GetInstance()->Clean();
+  G4LogicalVolumeStore::GetInstance()->Clean();
+  G4SolidStore::GetInstance()->Clean();
+  G4LogicalSkinSurface::CleanSurfaceTable();
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::ConstructGeometry()
+{
+  //****************************************************************************//
+  //********************************* World ************************************//
+  //****************************************************************************//
+  solidWorld =
+    new G4Box("World",                       //its name
+       fWorldSizeXY, fWorldSizeXY, fWorldSizeZ); //its size
+
+  logicWorld =
+    new G4LogicalVolume(solidWorld,          //its solid
+                        Air,         //its material
+                        "World");            //its name
+
+  physWorld =
+    new G4PVPlacement(0,                     //no rotation
+                      G4ThreeVector(),       //at (0,0,0)
+                      logicWorld,            //its logical volume
+                      "World",               //its name
+                      0,                     //its mother  volume
+                      false,                 //no boolean operation
+                      0,                     //copy number
+                      fCheckOverlaps);       // checking overlaps
+
+  //--------------------------------------------------------//
+  //***************** Scintillation crystal ****************//
+  //--------------------------------------------------------//
+  // Define box for Crystal
+  sciCrystSolid =
+	  new G4Box("sciCrystSolid",
+		    sciCrystSizeX,
+		    sciCrystSizeY,
+		    sciCrystSizeZ);
+
+  // Define Logical Volume for Crystal
+  sciCrystLog =
+	  new G4LogicalVolume(sciCrystSolid,
+			      sciCrystMat,
+			      "crystal");
+
+
+  //--------------------------------------------------------//
+  //*********************** Reflector **********************//
+  //--------------------------------------------------------//
   // Define box for Reflector
   reflBoxSolid =
 	  new G4Box("reflBoxSolid",
@@ -230,13 +548,18 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 		    sciReflSizeY,
 		    sciReflSizeZ);
 
-  // Subtracts Crystal box from Reflector box
+  // Subtracts Crystal box from Reflector box, nested cells contain the crystal instead
+  if (cellGeometry == "nested") {
+      sciReflSolid = reflBoxSolid;
+  }
+  else {
   sciReflSolid =
 	  new G4SubtractionSolid("sciReflSolid",
 		  		 reflBoxSolid,
 				 sciCrystSolid,
 				 0,
 				 G4ThreeVector(sciCrystPosX, sciCrystPosY, sciReflWindThick/2));
+  }
 
 
   // Define Logical Volume for Reflector//
@@ -245,49 +568,9 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 			      TiO2,
 			      "sciReflLog");
 
-  // Visualization attributes for the Reflector logical volume
-  sciReflVisAtt =
-	  new G4VisAttributes(G4Colour(1.0, 1.0, 0.0));					//Instantiation of visualization attributes with yellow colour
-  sciReflVisAtt->SetVisibility(true);							//Pass this object to Visualization Manager for visualization
-  sciReflLog->SetVisAttributes(sciReflVisAtt);						//Assignment of visualization attributes to the logical volume of the Reflector
-
   //--------------------------------------------------------//
   //******************** Aluminum Housing ******************//
   //--------------------------------------------------------//
-  // Dimensions of Housing (half-side)
-  sciHousWallThickX = 3.5*mm;
-  sciHousWallThickY = 3.5*mm;
-  sciHousWindThick = 0.8*mm;
-
-
-  // Outer dimensions of the housing relative to the crystal size and to the thickness of the reflector
-  sciHousSizeX = sciCrystSizeX + sciReflWallThickX + sciHousWallThickX;
-  sciHousSizeY = sciCrystSizeY + sciReflWallThickY + sciHousWallThickY;
-  sciHousSizeZ = sciCrystSizeZ + sciReflWindThick/2 + sciHousWindThick/2;
-
-  // Define Housing material and its compounds
-  Al =
-	  new G4Element("Aluminum",
-			"Al",
-			z=13.,
-			a=26.98*g/mole);
-
-  density = 2.7*g/cm3;
-  Al_Alloy =
-          new G4Material("Aluminum_Alloy",
-			 density,
-			 ncomponents=1);
-  Al_Alloy->AddElement (Al, natoms=1);
-
-  // Position of the housing relative to the crystal position
-  sciHousPosX = sciCrystPosX;
-  sciHousPosY = sciCrystPosY;
-  sciHousPosZ = sciCrystPosZ - (sciReflWindThick/2 + sciHousWindThick/2);
-
-  G4ThreeVector sciHousPos = G4ThreeVector(sciHousPosX,
-		  			   sciHousPosY,
-					   sciHousPosZ);
-
   // Define box for Housing
   housBoxASolid =
 	  new G4Box("housBoxASolid",
@@ -295,13 +578,18 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 		    sciHousSizeY,
 		    sciHousSizeZ);
 
-  // Subtracts Reflector box from Housing box
+  // Subtracts Reflector box from Housing box, nested cells contain the reflector instead
+  if (cellGeometry == "nested") {
+      sciHousSolid = housBoxASolid;
+  }
+  else {
   sciHousSolid =
 	  new G4SubtractionSolid("housBoxBSolid",
 	  			 housBoxASolid,
 				 reflBoxSolid,
 				 0,
 				 G4ThreeVector(sciReflPosX, sciReflPosY, sciHousWindThick/2));
+  }
 
   // Define Logical Volume for Housing
   sciHousLog =
@@ -309,46 +597,9 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 			      Al_Alloy,              						//Housing material
 			      "sciCaseLog");         						//Housing logic volume name
 
-  // Visualization attributes for the Housing logical volume
-  sciHousVisAtt =
-	  new G4VisAttributes(G4Colour(0.5, 0.5, 0.5));				//Instantiation of visualization attributes with grey colour
-  sciHousVisAtt->SetVisibility(true);						//Pass this object to Visualization Manager for visualization
-  sciHousLog->SetVisAttributes(sciHousVisAtt);					//Assignment of visualization attributes to the logical volume of the Housing
-
   //--------------------------------------------------------//
   //******************** Quartz window *********************//
-  //--------------------------------------------------------//
-  // Dimensions of the Window (half-side)
-  sciWindSizeX = sciCrystSizeX + sciReflWallThickX + sciHousWallThickX;						//X half-size of the Window
-  sciWindSizeY = sciCrystSizeY + sciReflWallThickY + sciHousWallThickY;						//Y half-size of the Window
-  sciWindSizeZ = 1.*mm;									        //Z half-size of the Window
-
-  // Define compound elements for Quartz material
-
-  Si =
-	  new G4Element("Silicon",
-		  	"Si",
-			z=14.,
-			a=28.09*g/mole);
-
-  // Define Quartz material
-  density = 2.66*g/cm3;									//Assign density of Quartz ot the density variable
-  Quartz = 										//Define object for the Qartz material
-	  new G4Material("Quartz", 							//Name of the material
-		  	 density, 							//Density of the material
-			 ncomponents=2);						//Number of the compound elements in the material
-  Quartz->AddElement (Si, natoms=1);							//Adds chemical element and number of atoms of this element to the material
-  Quartz->AddElement (O, natoms=2);
-
-  // Position of the window relative to the crystal
-  sciWindPosX = sciCrystPosX ;								//Position of the Window along the X axis
-  sciWindPosY = sciCrystPosY ;								//Position of the Window along the Y axis
-  sciWindPosZ = sciCrystPosZ + sciCrystSizeZ + sciWindSizeZ;	 			//Position of the Window relative to the Al Housing along the Z axis
-
-  sciWindPos = G4ThreeVector(sciWindPosX, 				//Position of the Window in space relative to the Al Housing
-		  	     sciWindPosY,
-			     sciWindPosZ);
-
+  //--------------------------------------------------------//
   // Define solid for the Window
   G4VSolid* sciWindSolid = 								//Define object for the Window's box
 	  new G4Box("sciWindSolid",							//Name of the Window's box
@@ -363,80 +614,44 @@ SpecMATSimDetectorConstruction::SpecMATSimDetectorConstruction()
 		  	      Quartz,
 			      "sciWindLog");
 
+  // Nested cells: crystal in the reflector in the housing, at the positions
+  // of the subtracted boxes. The copy number of the cell is the one of the housing.
+  if (cellGeometry == "nested") {
+      new G4PVPlacement(0,
+                    G4ThreeVector(sciReflPosX, sciReflPosY, sciHousWindThick/2),
+                    sciReflLog,                //its logical volume
+                    "sciReflPl",               //its name
+                    sciHousLog,                //its mother  volume
+                    false,                     //no boolean operation
+                    0,                         //copy number
+                    fCheckOverlaps);           // checking overlaps
+      new G4PVPlacement(0,
+                    G4ThreeVector(sciCrystPosX, sciCrystPosY, sciReflWindThick/2),
+                    sciCrystLog,               //its logical volume
+                    "sciCrystPl",              //its name
+                    sciReflLog,                //its mother  volume
+                    false,                     //no boolean operation
+                    0,                         //copy number
+                    fCheckOverlaps);           // checking overlaps
+  }
 
-  // Visualization attributes for the Window
-  sciWindVisAtt =
-	  new G4VisAttributes(G4Colour(0.0, 1.0, 1.0));					//Instantiation of visualization attributes with cyan colour
-  sciWindVisAtt->SetVisibility(true);							//Pass this object to Visualization Manager for visualization
-  sciWindVisAtt->SetForceWireframe(true);						//I believe that it might make Window transparent
-  sciWindLog->SetVisAttributes(sciWindVisAtt);						//Assignment of visualization attributes to the logical volume of the Window
-
-}
-
-// ###################################################################################
-
-SpecMATSimDetectorConstruction::~SpecMATSimDetectorConstruction()
-{
-
-}
-
-// ###################################################################################
-
-void SpecMATSimDetectorConstruction::DefineMaterials()
-{
-}
-
-// ###################################################################################
-
-G4double SpecMATSimDetectorConstruction::ComputeCircleR1()
-{
-    if (nbSegments == 1) {
-        circleR1 = 0;
-    }
-    else if (nbSegments == 2) {
-        circleR1 = 100;
-    }
-    else {
-        if (vacuumChamber == "yes") {
-            if (vacuumFlangeSizeY>sciHousSizeY*nbCrystInSegmentColumn) {
-                circleR1 = vacuumFlangeSizeY/(tandPhi);
-            }
-            else {
-                circleR1 = sciHousSizeY*nbCrystInSegmentColumn/(tandPhi);
-            }
-        }
-        else {
-            circleR1 = sciHousSizeY*nbCrystInSegmentColumn/(tandPhi);
-        }
-    }
-    return circleR1;
-}
-
-// ###################################################################################
 
-G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
-{
   //#####################################################################//
   //#### Positioning of scintillation crystals in the detector array ####//
   //#####################################################################//
 
-  circleR1 = SpecMATSimDetectorConstruction::ComputeCircleR1();
-
   // Define segment which will conain crystals
-  G4NistManager* nist = G4NistManager::Instance();
-  segment_mat = nist->FindOrBuildMaterial("G4_Galactic", false);
   G4VSolid* segmentBox = new G4Box("segmentBox",
 				sciHousSizeX*nbCrystInSegmentRow,
 				sciHousSizeY*nbCrystInSegmentColumn,
 				sciHousSizeZ+sciWindSizeZ);
 
-
-  if (vacuumFlangeSizeY<sciHousSizeY*nbCrystInSegmentColumn) {
-                vacuumFlangeSizeY=sciHousSizeY*nbCrystInSegmentColumn;
-  }
-
   //Define the vacuum chamber flange
   if (vacuumChamber == "yes") {
+    if (cellGeometry == "nested") {
+      ConstructNestedFlange();
+    }
+    else {
       G4VSolid* vacuumFlangeBox = new G4Box("vacuumFlangeBox",
     				vacuumFlangeSizeX,
     				vacuumFlangeSizeY,
@@ -450,6 +665,7 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
       vacuumFlangeBoxLog = new G4LogicalVolume(vacuumFlangeSolid,
                     Al_Alloy,
                     "vacuumFlangeBoxLog");
+    }
 
       G4RotationMatrix rotSideFlnge  = G4RotationMatrix();
       rotSideFlnge.rotateZ(dPhi/2);
@@ -516,6 +732,7 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
 						G4Transform3D transformHous = G4Transform3D(rotm1,positionHous);
 
 						// Crystal position
+						if (cellGeometry != "nested") {
 						new G4PVPlacement(transformCryst,			//rotation,position
 										  sciCrystLog,           //its logical volume
 										  "sciCrystPl",             //its name
@@ -523,6 +740,7 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
 										  false,                 //no boolean operation
 										  crysNb,                 //copy number
 										  fCheckOverlaps);       // checking overlaps
+						}
 
 						new G4PVPlacement(transformWind,				 //rotation,position
 										  sciWindLog,           //its logical volume
@@ -532,6 +750,7 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
 										  crysNb,                 //copy number
 										  fCheckOverlaps);       // checking overlaps
 
+						if (cellGeometry != "nested") {
 						new G4PVPlacement(transformRefl,				 //rotation,position
 										  sciReflLog,           //its logical volume
 										  "sciReflPl",             //its name
@@ -539,6 +758,7 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
 										  false,                 //no boolean operation
 										  crysNb,                 //copy number
 										  fCheckOverlaps);       // checking overlaps
+						}
 
 						new G4PVPlacement(transformHous,				 //rotation,position
 										  sciHousLog,           //its logical volume
@@ -556,6 +776,18 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
             if (vacuumChamber == "yes") {
                 G4ThreeVector positionVacuumFlange = (circleR1+vacuumFlangeSizeZ)*uz;
     			G4Transform3D transformVacuumFlange = G4Transform3D(rotm, positionVacuumFlange);
+                if (cellGeometry == "nested") {
+                  for (size_t ipiece = 0; ipiece < fFlangePieces.size(); ipiece++) {
+                    new G4PVPlacement(transformVacuumFlange*G4Translate3D(fFlangePieceOffsets[ipiece]),
+    				  fFlangePieces[ipiece],             //its logical volume
+    				  "VacuumFlange",                    //its name
+    				  logicWorld,                         //its mother  volume
+    				  false,                              //no boolean operation
+    				  iseg,                               //copy number
+    				  fCheckOverlaps);                    // checking overlaps
+                  }
+                }
+                else {
                 new G4PVPlacement(transformVacuumFlange, //position
     				  vacuumFlangeBoxLog,                //its logical volume
     				  "VacuumFlange",                    //its name
@@ -563,6 +795,7 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
     				  false,                              //no boolean operation
     				  iseg,                               //copy number
     				  fCheckOverlaps);                    // checking overlaps
+                }
     			G4ThreeVector positionSegment = (circleR1+2*vacuumFlangeSizeZ+(sciHousSizeZ+sciWindSizeZ)-(2*vacuumFlangeSizeZ-vacuumFlangeThickFrontOfScint))*uz;
     			G4Transform3D transformSegment = G4Transform3D(rotm, positionSegment);
     			new G4PVPlacement(transformSegment, //position
@@ -586,49 +819,486 @@ G4VPhysicalVolume* SpecMATSimDetectorConstruction::Construct()
             }
 	}
 
-  // Print materials
-  //G4cout << *(G4Material::GetMaterialTable()) << G4endl;
-  //
-  // Print dimensions of the scintillator array
-  G4cout <<""<< G4endl;
-  G4cout <<"$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"<< G4endl;
-  G4cout <<"$$$$"<< G4endl;
-  G4cout <<"$$$$"<<" Crystal material: "<<sciCrystMat->GetName()<< G4endl;
-  G4cout <<"$$$$"<<" Single crystal dimensions: "<<sciCrystSizeX*2<<"mmx"<<sciCrystSizeY*2<<"mmx"<<sciCrystSizeZ*2<<"mm "<< G4endl;
-  G4cout <<"$$$$"<<" Dimensions of a single crystal housing: "<<sciHousSizeX*2<<"mmx"<<sciHousSizeY*2<<"mmx"<<sciHousSizeZ*2<<"mm "<< G4endl;
-  G4cout <<"$$$$"<<" Number of segments in the array: "<<nbSegments<<" "<< G4endl;
-  G4cout <<"$$$$"<<" Number of crystals in a segment row: "<<nbCrystInSegmentRow<<" "<< G4endl;
-  G4cout <<"$$$$"<<" Number of crystals in a segment column: "<<nbCrystInSegmentColumn<<" "<< G4endl;
-  G4cout <<"$$$$"<<" Number of crystals in the array: "<<nbSegments*nbCrystInSegmentRow*nbCrystInSegmentColumn<<" "<< G4endl;
-  G4cout <<"$$$$"<<" Radius of a circle inscribed in the array: "<<circleR1<<"mm "<< G4endl;
-  G4cout <<"$$$$"<<" Segment width: : "<<sciHousSizeY*nbCrystInSegmentColumn<<"mm "<< G4endl;
-  G4cout <<"$$$$"<<" Flange width: : "<<vacuumFlangeSizeY<<"mm "<< G4endl;
-  G4cout <<"$$$$"<< G4endl;
-  G4cout <<"$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$$"<< G4endl;
-  G4cout <<""<< G4endl;
-  CreateScorers();
+  if (envelope != "off") {
+      ConstructEnvelope();
+  }
+}
 
-  //
-  //always return the physical World
-  //
-  return physWorld;
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::ComputeArrayExtent(G4double& radius, G4double& halfZ) const
+{
+  // Extent of the array: segments and flanges are boxes with the half sizes
+  // axial (x), tangential (y) and radial (z) in the frame of the segment
+  G4double segX = sciHousSizeX*nbCrystInSegmentRow;
+  G4double segY = sciHousSizeY*nbCrystInSegmentColumn;
+  G4double segZ = sciHousSizeZ+sciWindSizeZ;
+  radius = 0.;
+  halfZ = segX;
+  if (vacuumChamber == "yes") {
+      G4double segmentFar = circleR1+2*segZ+vacuumFlangeThickFrontOfScint;
+      G4double flangeFar = circleR1+2*vacuumFlangeSizeZ;
+      radius = std::sqrt(segmentFar*segmentFar + segY*segY);
+      radius = std::max(radius, std::sqrt(flangeFar*flangeFar + vacuumFlangeSizeY*vacuumFlangeSizeY));
+      // corners of the polygonal side flanges
+      if (nbSegments > 2) radius = std::max(radius, flangeFar/std::cos(half_dPhi));
+      halfZ = std::max(halfZ, vacuumFlangeSizeX+2*vacuumFlangeSizeZ);
+  }
+  else {
+      G4double segmentFar = circleR1+2*segZ;
+      radius = std::sqrt(segmentFar*segmentFar + segY*segY);
+  }
 }
 
 // ###################################################################################
 
-void SpecMATSimDetectorConstruction::CreateScorers()
+void SpecMATSimDetectorConstruction::ConstructEnvelope()
+{
+  G4double radius, halfZ;
+  ComputeArrayExtent(radius, halfZ);
+  envelopeRadius = radius+envelopeMargin;
+  envelopeHalfZ = halfZ+envelopeMargin;
+
+  if (envelopeRadius+envelopeThickness > fWorldSizeXY || envelopeHalfZ+envelopeThickness > fWorldSizeZ) {
+      G4Exception("SpecMATSimDetectorConstruction::ConstructEnvelope()", "SpecMATSim004", JustWarning,
+                  "The tracking envelope does not fit in the world, envelope = \"off\".");
+      envelope = "off";
+      return;
+  }
+
+  // Side of the shell, closed by two caps
+  G4VSolid* killShellSide = new G4Tubs("killShellSide",
+                    envelopeRadius,
+                    envelopeRadius+envelopeThickness,
+                    envelopeHalfZ+envelopeThickness,
+                    0,
+                    twopi);
+  killShellSideLog = new G4LogicalVolume(killShellSide,
+                    Air,
+                    "killShellSideLog");
+  G4VSolid* killShellCap = new G4Tubs("killShellCap",
+                    0,
+                    envelopeRadius,
+                    envelopeThickness/2,
+                    0,
+                    twopi);
+  killShellCapLog = new G4LogicalVolume(killShellCap,
+                    Air,
+                    "killShellCapLog");
+
+  new G4PVPlacement(0,
+                    G4ThreeVector(),
+                    killShellSideLog,          //its logical volume
+                    "KillShell",               //its name
+                    logicWorld,                //its mother  volume
+                    false,                     //no boolean operation
+                    0,                         //copy number
+                    fCheckOverlaps);           // checking overlaps
+  for (G4int icap = 0; icap < 2; icap++) {
+      G4double capZ = (icap == 0 ? -1 : 1)*(envelopeHalfZ+envelopeThickness/2);
+      new G4PVPlacement(0,
+                    G4ThreeVector(0, 0, capZ),
+                    killShellCapLog,           //its logical volume
+                    "KillShell",               //its name
+                    logicWorld,                //its mother  volume
+                    false,                     //no boolean operation
+                    icap+1,                    //copy number
+                    fCheckOverlaps);           // checking overlaps
+  }
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::ConstructNestedFlange()
+{
+  // The subtraction of the segment box leaves a front plate of thickness
+  // vacuumFlangeThickFrontOfScint, rims on the sides of the segment and a
+  // back plate if the segment does not reach through the flange.
+  // Offsets are in the frame of the flange box.
+  G4double segX = sciHousSizeX*nbCrystInSegmentRow;
+  G4double segY = sciHousSizeY*nbCrystInSegmentColumn;
+  G4double segZ = sciHousSizeZ+sciWindSizeZ;
+  G4double holeBottom = -vacuumFlangeSizeZ+vacuumFlangeThickFrontOfScint;
+  G4double holeTop = std::min(vacuumFlangeSizeZ, 2*segZ+holeBottom);
+  G4double rimHalfZ = 0.5*(holeTop-holeBottom);
+  G4double rimZ = 0.5*(holeTop+holeBottom);
+
+  fFlangePieces.clear();
+  fFlangePieceOffsets.clear();
+  if (vacuumFlangeThickFrontOfScint > 0) {
+      AddFlangePiece("vacuumFlangeFront", vacuumFlangeSizeX, vacuumFlangeSizeY, 0.5*vacuumFlangeThickFrontOfScint,
+                     G4ThreeVector(0, 0, -vacuumFlangeSizeZ+0.5*vacuumFlangeThickFrontOfScint), 0);
+  }
+  if (holeTop < vacuumFlangeSizeZ) {
+      AddFlangePiece("vacuumFlangeBack", vacuumFlangeSizeX, vacuumFlangeSizeY, 0.5*(vacuumFlangeSizeZ-holeTop),
+                     G4ThreeVector(0, 0, 0.5*(vacuumFlangeSizeZ+holeTop)), 0);
+  }
+  if (vacuumFlangeSizeX > segX && rimHalfZ > 0) {
+      G4LogicalVolume* rimLog = AddFlangePiece("vacuumFlangeRimX", 0.5*(vacuumFlangeSizeX-segX), vacuumFlangeSizeY, rimHalfZ,
+                                               G4ThreeVector(0.5*(vacuumFlangeSizeX+segX), 0, rimZ), 0);
+      AddFlangePiece("", 0, 0, 0, G4ThreeVector(-0.5*(vacuumFlangeSizeX+segX), 0, rimZ), rimLog);
+  }
+  if (vacuumFlangeSizeY > segY && rimHalfZ > 0) {
+      G4double rimX = std::min(segX, vacuumFlangeSizeX);
+      G4LogicalVolume* rimLog = AddFlangePiece("vacuumFlangeRimY", rimX, 0.5*(vacuumFlangeSizeY-segY), rimHalfZ,
+                                               G4ThreeVector(0, 0.5*(vacuumFlangeSizeY+segY), rimZ), 0);
+      AddFlangePiece("", 0, 0, 0, G4ThreeVector(0, -0.5*(vacuumFlangeSizeY+segY), rimZ), rimLog);
+  }
+}
+
+// ###################################################################################
+
+G4LogicalVolume* SpecMATSimDetectorConstruction::AddFlangePiece(const G4String& name,
+                                                                G4double halfX, G4double halfY, G4double halfZ,
+                                                                const G4ThreeVector& offset,
+                                                                G4LogicalVolume* pieceLog)
+{
+  // A new box is only built when no logical volume is given
+  if (!pieceLog) {
+      G4VSolid* pieceBox = new G4Box(name+"Box", halfX, halfY, halfZ);
+      pieceLog = new G4LogicalVolume(pieceBox, Al_Alloy, name+"Log");
+  }
+  fFlangePieces.push_back(pieceLog);
+  fFlangePieceOffsets.push_back(offset);
+  return pieceLog;
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::SetVisAttributes()
+{
+  // Visualization attributes for the Crystal logical volume
+  sciCrystVisAtt =
+	  new G4VisAttributes(G4Colour(0.0, 0.0, 1.0));					//Instantiation of visualization attributes with blue colour
+  sciCrystVisAtt->SetVisibility(true);							//Pass this object to Visualization Manager for visualization
+  sciCrystVisAtt->SetForceWireframe(true);						//I still believe that it might make Crystal transparent
+  sciCrystLog->SetVisAttributes(sciCrystVisAtt);					//Assignment of visualization attributes to the logical volume of the Crystal
+
+  // Visualization attributes for the Reflector logical volume
+  sciReflVisAtt =
+	  new G4VisAttributes(G4Colour(1.0, 1.0, 0.0));					//Instantiation of visualization attributes with yellow colour
+  sciReflVisAtt->SetVisibility(true);							//Pass this object to Visualization Manager for visualization
+  sciReflLog->SetVisAttributes(sciReflVisAtt);						//Assignment of visualization attributes to the logical volume of the Reflector
+
+  // Visualization attributes for the Housing logical volume
+  sciHousVisAtt =
+	  new G4VisAttributes(G4Colour(0.5, 0.5, 0.5));				//Instantiation of visualization attributes with grey colour
+  sciHousVisAtt->SetVisibility(true);						//Pass this object to Visualization Manager for visualization
+  sciHousLog->SetVisAttributes(sciHousVisAtt);					//Assignment of visualization attributes to the logical volume of the Housing
+
+  // Visualization attributes for the Window
+  sciWindVisAtt =
+	  new G4VisAttributes(G4Colour(0.0, 1.0, 1.0));					//Instantiation of visualization attributes with cyan colour
+  sciWindVisAtt->SetVisibility(true);							//Pass this object to Visualization Manager for visualization
+  sciWindVisAtt->SetForceWireframe(true);						//I believe that it might make Window transparent
+  sciWindLog->SetVisAttributes(sciWindVisAtt);						//Assignment of visualization attributes to the logical volume of the Window
+
+  // The tracking envelope is not part of the detector
+  if (killShellSideLog) killShellSideLog->SetVisAttributes(G4VisAttributes::Invisible);
+  if (killShellCapLog) killShellCapLog->SetVisAttributes(G4VisAttributes::Invisible);
+}
+
+// ###################################################################################
+
+G4bool SpecMATSimDetectorConstruction::IsInsideEnvelope(const G4ThreeVector& position) const
+{
+  G4double tolerance = 1e-9*mm;
+  return position.perp() <= envelopeRadius+tolerance && std::fabs(position.z()) <= envelopeHalfZ+tolerance;
+}
+
+// ###################################################################################
+
+G4String SpecMATSimDetectorConstruction::GetGeometryKey() const
+{
+  // Every parameter that changes the constructed volumes or materials
+  std::ostringstream key;
+  key.precision(10);
+  key << "SpecMATSim geometry 1"
+      << " world " << worldSizeXY << " " << worldSizeZ
+      << " array " << nbSegments << " " << nbCrystInSegmentRow << " " << nbCrystInSegmentColumn
+      << " chamber " << vacuumChamber << " " << vacuumFlangeSizeX << " " << vacuumFlangeSizeY
+      << " " << vacuumFlangeSizeZ << " " << vacuumFlangeThickFrontOfScint
+      << " crystal " << sciCrystMat->GetName() << " " << sciCrystSizeX << " " << sciCrystSizeY
+      << " " << sciCrystSizeZ << " " << sciCrystPosX << " " << sciCrystPosY << " " << sciCrystPosZ
+      << " reflector " << sciReflWallThickX << " " << sciReflWallThickY << " " << sciReflWindThick
+      << " housing " << sciHousWallThickX << " " << sciHousWallThickY << " " << sciHousWindThick
+      << " window " << sciWindSizeZ
+      << " cells " << cellGeometry
+      << " envelope " << (envelope != "off") << " " << envelopeMargin << " " << envelopeThickness;
+  return key.str();
+}
+
+// ###################################################################################
+
+#ifdef G4LIB_USE_GDML
+
+G4bool SpecMATSimDetectorConstruction::ReadGDML(const G4String& fileName)
+{
+  if (!SpecMATSimUtils::FileExists(fileName)) return false;
+
+  G4cout << "Reading the geometry from " << fileName << G4endl;
+  G4GDMLParser parser;
+  parser.Read(fileName, false);
+  physWorld = parser.GetWorldVolume();
+  if (!physWorld) return false;
+  logicWorld = physWorld->GetLogicalVolume();
+
+  // Volumes used by the scorers, the light map and the vis attributes
+  G4LogicalVolumeStore* store = G4LogicalVolumeStore::GetInstance();
+  sciCrystLog = store->GetVolume("crystal", false);
+  sciWindLog = store->GetVolume("sciWindLog", false);
+  sciReflLog = store->GetVolume("sciReflLog", false);
+  sciHousLog = store->GetVolume("sciCaseLog", false);
+  if (!sciCrystLog || !sciWindLog || !sciReflLog || !sciHousLog) {
+      G4cerr << "The GDML file " << fileName << " does not contain the SpecMATSim crystal volumes" << G4endl;
+      return false;
+  }
+  sciCrystMat = sciCrystLog->GetMaterial();
+  Quartz = sciWindLog->GetMaterial();
+  // The scorers follow the cell layout of the file
+  cellGeometry = (sciReflLog->GetNoDaughters() > 0) ? "nested" : "boolean";
+  // and the stepping action its tracking envelope
+  killShellSideLog = store->GetVolume("killShellSideLog", false);
+  killShellCapLog = store->GetVolume("killShellCapLog", false);
+  if (killShellSideLog && killShellCapLog) {
+      envelopeRadius = static_cast<const G4Tubs*>(killShellSideLog->GetSolid())->GetInnerRadius();
+      envelopeHalfZ = static_cast<const G4Tubs*>(killShellSideLog->GetSolid())->GetZHalfLength()
+                      - static_cast<const G4Tubs*>(killShellCapLog->GetSolid())->GetZHalfLength()*2;
+  }
+  else if (envelope != "off") {
+      G4cerr << "The GDML file " << fileName << " has no tracking envelope, envelope = \"off\"" << G4endl;
+      envelope = "off";
+  }
+
+  // Crystal numbering relies on the copy numbers surviving the round trip
+  fCrystalTransforms.clear();
+  FillCrystalTransforms(physWorld, G4Transform3D());
+  G4int nbCryst = nbSegments*nbCrystInSegmentRow*nbCrystInSegmentColumn;
+  if ((G4int)fCrystalTransforms.size() != nbCryst
+      || fCrystalTransforms.begin()->first != 1
+      || fCrystalTransforms.rbegin()->first != nbCryst) {
+      G4cerr << "The GDML file " << fileName << " does not match the array parameters" << G4endl;
+      return false;
+  }
+  return true;
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::WriteGDML(const G4String& fileName)
+{
+  // The parser refuses to overwrite, and a half written cache file must never be read
+  G4String tmpFileName = fileName + ".tmp.gdml";
+  std::remove(tmpFileName.c_str());
+
+  G4GDMLParser parser;
+  parser.Write(tmpFileName, physWorld);
+  if (std::rename(tmpFileName.c_str(), fileName.c_str()) != 0) {
+      G4cerr << "Cannot write the geometry to " << fileName << G4endl;
+      return;
+  }
+  G4cout << "Geometry written to " << fileName << G4endl;
+}
+
+#else
+
+G4bool SpecMATSimDetectorConstruction::ReadGDML(const G4String& fileName)
+{
+  G4cerr << "Cannot read " << fileName << ": SpecMATSim was built without GDML support" << G4endl;
+  return false;
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::WriteGDML(const G4String& fileName)
+{
+  G4cerr << "Cannot write " << fileName << ": SpecMATSim was built without GDML support" << G4endl;
+}
+
+#endif
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::DefineOpticalProperties()
+{
+  // Optical properties are only needed to tabulate the light collection map.
+  // They are added after the geometry is written, so GDML files stay plain.
+  // Flat spectra around the CeBr3 emission maximum (~370 nm) are sufficient,
+  // only the geometry of the light path is of interest here.
+  const G4int nbEntries = 2;
+  G4double photonEnergy[nbEntries] = {2.0*eV, 4.0*eV};
+
+  G4double crystRIndex[nbEntries] = {2.09, 2.09};
+  G4double crystAbsLength[nbEntries] = {50.*cm, 50.*cm};
+  G4MaterialPropertiesTable* crystMPT = new G4MaterialPropertiesTable();
+  crystMPT->AddProperty("RINDEX", photonEnergy, crystRIndex, nbEntries);
+  crystMPT->AddProperty("ABSLENGTH", photonEnergy, crystAbsLength, nbEntries);
+  sciCrystMat->SetMaterialPropertiesTable(crystMPT);
+
+  G4double windRIndex[nbEntries] = {1.46, 1.46};
+  G4double windAbsLength[nbEntries] = {1.*m, 1.*m};
+  G4MaterialPropertiesTable* windMPT = new G4MaterialPropertiesTable();
+  windMPT->AddProperty("RINDEX", photonEnergy, windRIndex, nbEntries);
+  windMPT->AddProperty("ABSLENGTH", photonEnergy, windAbsLength, nbEntries);
+  Quartz->SetMaterialPropertiesTable(windMPT);
+
+  // TiO2 powder reflector: diffuse (Lambertian) reflection on the crystal faces
+  G4double reflReflectivity[nbEntries] = {0.95, 0.95};
+  G4double reflLobe[nbEntries] = {0., 0.};
+  G4double reflSpike[nbEntries] = {0., 0.};
+  G4double reflBackScatter[nbEntries] = {0., 0.};
+  G4MaterialPropertiesTable* reflMPT = new G4MaterialPropertiesTable();
+  reflMPT->AddProperty("REFLECTIVITY", photonEnergy, reflReflectivity, nbEntries);
+  reflMPT->AddProperty("SPECULARLOBECONSTANT", photonEnergy, reflLobe, nbEntries);
+  reflMPT->AddProperty("SPECULARSPIKECONSTANT", photonEnergy, reflSpike, nbEntries);
+  reflMPT->AddProperty("BACKSCATTERCONSTANT", photonEnergy, reflBackScatter, nbEntries);
+
+  G4OpticalSurface* reflSurface = new G4OpticalSurface("sciReflSurface");
+  reflSurface->SetType(dielectric_metal);
+  reflSurface->SetModel(unified);
+  reflSurface->SetFinish(ground);
+  reflSurface->SetSigmaAlpha(0.1);
+  reflSurface->SetMaterialPropertiesTable(reflMPT);
+  new G4LogicalSkinSurface("sciReflSkin", sciReflLog, reflSurface);
+}
+
+// ###################################################################################
+
+G4double SpecMATSimDetectorConstruction::ComputeCircleR1()
 {
+    if (nbSegments == 1) {
+        circleR1 = 0;
+    }
+    else if (nbSegments == 2) {
+        circleR1 = 100;
+    }
+    else {
+        if (vacuumChamber == "yes") {
+            if (vacuumFlangeSizeY>sciHousSizeY*nbCrystInSegmentColumn) {
+                circleR1 = vacuumFlangeSizeY/(tandPhi);
+            }
+            else {
+                circleR1 = sciHousSizeY*nbCrystInSegmentColumn/(tandPhi);
+            }
+        }
+        else {
+            circleR1 = sciHousSizeY*nbCrystInSegmentColumn/(tandPhi);
+        }
+    }
+    return circleR1;
+}
+
+// ###################################################################################
 
+void SpecMATSimDetectorConstruction::CreateScorers()
+{
   G4SDManager* SDman = G4SDManager::GetSDMpointer();
   SDman->SetVerboseLevel(1);
 
   // declare crystal as a MultiFunctionalDetector scorer
   //
-  G4MultiFunctionalDetector* cryst = new G4MultiFunctionalDetector("crystal");
-  G4PSEnergyDeposit* primitiv = new G4PSEnergyDeposit("edep");
+  // A geometry rebuilt in the same session keeps the detector of the first
+  // one, but its primitives are made again: the copy-number depth and the
+  // light and time options may have changed
+  //
+  G4MultiFunctionalDetector* cryst
+    = static_cast<G4MultiFunctionalDetector*>(SDman->FindSensitiveDetector("crystal", false));
+  G4bool existing = (cryst != 0);
+  if (existing) {
+      while (cryst->GetNumberOfPrimitives() > 0) {
+          G4VPrimitiveScorer* old = cryst->GetPrimitive(0);
+          cryst->RemovePrimitive(old);
+          delete old;
+      }
+  }
+  else {
+      cryst = new G4MultiFunctionalDetector("crystal");
+  }
+
+  // Crystal number is the copy number of the crystal, or of the housing two
+  // levels up for nested cells
+  G4int depth = (cellGeometry == "nested") ? 2 : 0;
+
+  G4PSEnergyDeposit* primitiv = new G4PSEnergyDeposit("edep", depth);
   cryst->RegisterPrimitive(primitiv);
-  SDman->AddNewDetector(cryst);
+
+  // Light collection map: tabulated in "tabulate" mode, applied in "map" mode
+  //
+  if (lightCollection == "tabulate") {
+      delete fLightMap;
+      fLightMap = new SpecMATSimLightMap(lightMapNbBinsX, lightMapNbBinsY, lightMapNbBinsZ,
+                                         sciCrystSizeX, sciCrystSizeY, sciCrystSizeZ);
+  }
+  else if (lightCollection == "map") {
+      delete fLightMap;
+      fLightMap = new SpecMATSimLightMap(1, 1, 1, sciCrystSizeX, sciCrystSizeY, sciCrystSizeZ);
+      if (!fLightMap->Read(lightMapFile)) {
+          G4ExceptionDescription msg;
+          msg << "Cannot read the light collection map " << lightMapFile
+              << ", run once with lightCollection = \"tabulate\" to create it.";
+          G4Exception("SpecMATSimDetectorConstruction::CreateScorers()",
+                      "SpecMATSim001", FatalException, msg);
+      }
+      cryst->RegisterPrimitive(new SpecMATSimPSLightCollection("light", fLightMap, depth));
+  }
+
+  // Time of the first deposit for the digitizer
+  //
+  if (digitizer == "yes") {
+      cryst->RegisterPrimitive(new SpecMATSimPSFirstHitTime("time", depth));
+  }
+
+  if (!existing) SDman->AddNewDetector(cryst);
   sciCrystLog->SetSensitiveDetector(cryst);
 }
 
 // ###################################################################################
+
+void SpecMATSimDetectorConstruction::FillCrystalTransforms(G4VPhysicalVolume* mother,
+                                                           const G4Transform3D& motherTransform,
+                                                           G4int cellCopyNb)
+{
+  G4LogicalVolume* motherLog = mother->GetLogicalVolume();
+  for (G4int i = 0; i < motherLog->GetNoDaughters(); i++) {
+      G4VPhysicalVolume* daughter = motherLog->GetDaughter(i);
+      G4Transform3D transform = motherTransform*G4Transform3D(daughter->GetObjectRotationValue(),
+                                                              daughter->GetObjectTranslation());
+      if (daughter->GetLogicalVolume() == sciCrystLog) {
+          fCrystalTransforms[(cellCopyNb >= 0) ? cellCopyNb : daughter->GetCopyNo()] = transform;
+      }
+      else if (daughter->GetLogicalVolume() == sciHousLog) {
+          // nested cells carry the crystal number on the housing
+          FillCrystalTransforms(daughter, transform, daughter->GetCopyNo());
+      }
+      else {
+          FillCrystalTransforms(daughter, transform, cellCopyNb);
+      }
+  }
+}
+
+// ###################################################################################
+
+void SpecMATSimDetectorConstruction::CheckOverlaps(const G4LogicalVolume* mother,
+                                                   std::set<const G4LogicalVolume*>& checked) const
+{
+  // Same check as the placements do with fCheckOverlaps; every placement
+  // belongs to one mother, so a shared logical volume is visited once
+  if (!checked.insert(mother).second) return;
+  for (G4int i = 0; i < mother->GetNoDaughters(); i++) {
+      G4VPhysicalVolume* daughter = mother->GetDaughter(i);
+      daughter->CheckOverlaps();
+      CheckOverlaps(daughter->GetLogicalVolume(), checked);
+  }
+}
+
+// ###################################################################################
+
+G4bool SpecMATSimDetectorConstruction::GetCrystalTransform(G4int copyNb, G4Transform3D& transform) const
+{
+  std::map<G4int, G4Transform3D>::const_iterator it = fCrystalTransforms.find(copyNb);
+  if (it == fCrystalTransforms.end()) return false;
+  transform = it->second;
+  return true;
+}
+
+// ###################################################################################
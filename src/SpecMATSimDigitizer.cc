@@ -0,0 +1,202 @@
+/// \file SpecMATSimDigitizer.cc
+/// \brief Implementation of the SpecMATSimDigitizer class
+
+#include "SpecMATSimDigitizer.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <limits>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimDigitizer::SpecMATSimDigitizer(G4int nbCrystals, const G4String& fileName)
+ : fNbCrystals(nbCrystals),
+   fTime(0.),
+   fTimeEngine(20160721),
+   fOutput(fileName.c_str()),
+   fOpenPulses(nbCrystals+1),
+   fPulseOpen(nbCrystals+1, false),
+   fDeadUntil(nbCrystals+1, -std::numeric_limits<G4double>::max()),
+   fNbEvents(0),
+   fNbHits(0),
+   fNbPileUp(0),
+   fNbDead(0),
+   fNbBelowThreshold(0),
+   fNbOverflow(0),
+   fNbAccepted(0)
+{
+  // Source and read-out parameters
+  sourceActivity = 10*kilobecquerel;
+  threshold = 20*keV;
+  deadTime = 2*microsecond;
+  integrationTime = 500*ns;
+  adcGain = 1*keV;          // energy per ADC channel
+  adcBits = 14;
+
+  if (!fOutput) {
+    G4cerr << "Cannot open digitizer output " << fileName << G4endl;
+  }
+  fOutput << "# time[ns] crystal channel energy[keV] hits event" << "\n";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimDigitizer::~SpecMATSimDigitizer()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimDigitizer::ProcessEvent(G4int eventNb,
+                                       const std::map<G4int, G4double>& energies,
+                                       const std::map<G4int, G4double>& times)
+{
+  fNbEvents++;
+  fTime += CLHEP::RandExponential::shoot(&fTimeEngine, 1./sourceActivity);
+
+  // Hit delays are taken relative to the first deposit of the event, so that
+  // the decay time of an ion source does not enter the timeline
+  G4double firstTime = std::numeric_limits<G4double>::max();
+  std::map<G4int, G4double>::const_iterator it;
+  for (it = times.begin(); it != times.end(); it++) {
+    if (it->second < firstTime) firstTime = it->second;
+  }
+
+  for (it = energies.begin(); it != energies.end(); it++) {
+    if (it->first < 1 || it->first > fNbCrystals) continue;
+    std::map<G4int, G4double>::const_iterator time = times.find(it->first);
+    Hit hit;
+    hit.time = fTime + ((time != times.end()) ? time->second - firstTime : 0.);
+    hit.energy = it->second*keV;
+    hit.crystal = it->first;
+    hit.event = eventNb;
+    fPendingHits.push(hit);
+    fNbHits++;
+  }
+
+  // No later event can produce a hit before the current event time
+  Release(fTime);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimDigitizer::Release(G4double upToTime)
+{
+  while (!fPendingHits.empty() && fPendingHits.top().time <= upToTime) {
+    Hit hit = fPendingHits.top();
+    fPendingHits.pop();
+    ProcessHit(hit);
+  }
+
+  // Pulses can no longer grow once their integration window has passed
+  for (G4int crystal = 1; crystal <= fNbCrystals; crystal++) {
+    if (fPulseOpen[crystal] && fOpenPulses[crystal].start + integrationTime <= upToTime) {
+      ClosePulse(crystal);
+    }
+  }
+
+  // Every pulse starting before this time is closed now, so these are in order
+  G4double writeUpTo = upToTime - integrationTime;
+  while (!fClosedPulses.empty() && fClosedPulses.top().start <= writeUpTo) {
+    Write(fClosedPulses.top());
+    fClosedPulses.pop();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimDigitizer::ProcessHit(const Hit& hit)
+{
+  G4int crystal = hit.crystal;
+
+  // Pile-up: the hit arrives while the pulse of the crystal is integrated
+  if (fPulseOpen[crystal] && hit.time < fOpenPulses[crystal].start + integrationTime) {
+    fOpenPulses[crystal].energy += hit.energy;
+    fOpenPulses[crystal].nbHits++;
+    fNbPileUp++;
+    return;
+  }
+  if (fPulseOpen[crystal]) ClosePulse(crystal);
+
+  // Non-paralyzable dead time: the hit is lost without extending it
+  if (hit.time < fDeadUntil[crystal]) {
+    fNbDead++;
+    return;
+  }
+
+  Pulse& pulse = fOpenPulses[crystal];
+  pulse.start = hit.time;
+  pulse.energy = hit.energy;
+  pulse.crystal = crystal;
+  pulse.event = hit.event;
+  pulse.nbHits = 1;
+  fPulseOpen[crystal] = true;
+  fDeadUntil[crystal] = hit.time + deadTime;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimDigitizer::ClosePulse(G4int crystal)
+{
+  fPulseOpen[crystal] = false;
+  if (fOpenPulses[crystal].energy < threshold) {
+    fNbBelowThreshold++;
+    return;
+  }
+  fClosedPulses.push(fOpenPulses[crystal]);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimDigitizer::Write(const Pulse& pulse)
+{
+  const G4int maxChannel = (1 << adcBits) - 1;
+  G4int channel = G4int(pulse.energy/adcGain);
+  if (channel > maxChannel) {
+    channel = maxChannel;
+    fNbOverflow++;
+  }
+  fNbAccepted++;
+  fOutput << pulse.start/ns << " " << pulse.crystal << " " << channel << " "
+          << pulse.energy/keV << " " << pulse.nbHits << " " << pulse.event << "\n";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimDigitizer::Finish()
+{
+  while (!fPendingHits.empty()) {
+    ProcessHit(fPendingHits.top());
+    fPendingHits.pop();
+  }
+  for (G4int crystal = 1; crystal <= fNbCrystals; crystal++) {
+    if (fPulseOpen[crystal]) ClosePulse(crystal);
+  }
+  while (!fClosedPulses.empty()) {
+    Write(fClosedPulses.top());
+    fClosedPulses.pop();
+  }
+  fOutput.close();
+
+  G4double seconds = fTime/second;
+  G4cout
+     << "\n--------------------Digitizer-------------------------------\n"
+     << " Source activity: " << sourceActivity/becquerel << " Bq, "
+     << "simulated time: " << seconds << " s\n"
+     << " Events: " << fNbEvents << ", crystal hits: " << fNbHits << "\n"
+     << " Piled up: " << fNbPileUp << ", lost in dead time: " << fNbDead
+     << ", below threshold: " << fNbBelowThreshold
+     << ", ADC overflow: " << fNbOverflow << "\n"
+     << " Accepted signals: " << fNbAccepted;
+  if (seconds > 0.) {
+    G4cout << " (" << fNbAccepted/seconds << " /s)";
+  }
+  if (fNbHits > 0) {
+    G4cout << "\n Crystal hits lost to dead time and pile-up: "
+           << 100.*(fNbDead + fNbPileUp)/fNbHits << " %";
+  }
+  G4cout << "\n------------------------------------------------------------\n"
+         << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
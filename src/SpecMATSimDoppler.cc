@@ -0,0 +1,44 @@
+/// \file SpecMATSimDoppler.cc
+/// \brief Implementation of the SpecMATSimDoppler class
+
+#include "SpecMATSimDoppler.hh"
+#include "SpecMATSimDetectorConstruction.hh"
+
+#include "G4Point3D.hh"
+#include "G4UIcommand.hh"
+
+#include <cmath>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimDoppler::SpecMATSimDoppler(const SpecMATSimDetectorConstruction* detector, G4int nbCryst,
+                                     G4double beta, const G4ThreeVector& direction,
+                                     const G4ThreeVector& emissionPoint)
+ : fBeta(beta),
+   fCosTheta(nbCryst+1, 0.),
+   fFactors(nbCryst+1, 1.)
+{
+  G4double gamma = 1./std::sqrt(1. - beta*beta);
+  G4ThreeVector flight = direction.unit();
+  for (G4int copyNb = 1; copyNb <= nbCryst; copyNb++) {
+      G4Transform3D transform;
+      if (!detector->GetCrystalTransform(copyNb, transform)) {
+          G4Exception("SpecMATSimDoppler::SpecMATSimDoppler()", "SpecMATSim007", JustWarning,
+                      ("No placement of crystal " + G4UIcommand::ConvertToString(copyNb)
+                       + ", its energies are not corrected").c_str());
+          continue;
+      }
+      G4Point3D centre = transform*G4Point3D(0., 0., 0.);
+      G4ThreeVector line = G4ThreeVector(centre.x(), centre.y(), centre.z()) - emissionPoint;
+      fCosTheta[copyNb] = line.unit().dot(flight);
+      fFactors[copyNb] = gamma*(1. - beta*fCosTheta[copyNb]);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimDoppler::~SpecMATSimDoppler()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
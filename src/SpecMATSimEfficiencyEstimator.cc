@@ -0,0 +1,215 @@
+/// \file SpecMATSimEfficiencyEstimator.cc
+/// \brief Implementation of the SpecMATSimEfficiencyEstimator class
+
+#include "SpecMATSimEfficiencyEstimator.hh"
+#include "SpecMATSimRayCaster.hh"
+#include "SpecMATSimUtils.hh"
+
+#include "G4Material.hh"
+#include "G4Gamma.hh"
+#include "G4PEEffectFluoModel.hh"
+#include "G4KleinNishinaCompton.hh"
+#include "G4BetheHeitlerModel.hh"
+#include "G4Timer.hh"
+#include "G4PhysicalConstants.hh"
+#include "G4SystemOfUnits.hh"
+#include "Randomize.hh"
+
+#include <cmath>
+#include <cstdio>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimEfficiencyEstimator::SpecMATSimEfficiencyEstimator(G4double energy)
+ : fEnergy(energy),
+   fSource(0., 0., 0.),
+   fNbWorkers(1),
+   fBatchSize(4096)
+{
+  fModels.push_back(new G4PEEffectFluoModel());
+  fModels.push_back(new G4KleinNishinaCompton());
+  fModels.push_back(new G4BetheHeitlerModel());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimEfficiencyEstimator::~SpecMATSimEfficiencyEstimator()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimEfficiencyEstimator::GetAttenuation(const G4Material* material)
+{
+  size_t index = material->GetIndex();
+  if (index >= fAttenuation.size()) fAttenuation.resize(G4Material::GetNumberOfMaterials(), -1.);
+  if (fAttenuation[index] < 0.) {
+    G4double mu = 0.;
+    for (size_t i = 0; i < fModels.size(); i++) {
+      mu += fModels[i]->CrossSectionPerVolume(material, G4Gamma::Gamma(), fEnergy);
+    }
+    fAttenuation[index] = mu;
+  }
+  return fAttenuation[index];
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimEfficiencyEstimator::Result
+SpecMATSimEfficiencyEstimator::Estimate(G4VPhysicalVolume* world, const G4Material* crystalMaterial,
+                                        G4long nbRays, long seed)
+{
+  G4Timer timer;
+  timer.Start();
+
+  // Every material is known before the workers are forked
+  const G4MaterialTable* materials = G4Material::GetMaterialTable();
+  for (size_t i = 0; i < materials->size(); i++) GetAttenuation((*materials)[i]);
+
+  G4int nbBatches = G4int((nbRays + fBatchSize - 1)/fBatchSize);
+  G4int nbWorkers = (fNbWorkers < nbBatches) ? fNbWorkers : nbBatches;
+  size_t size = nbBatches*sizeof(BatchSums);
+  void* map = (nbWorkers > 1)
+    ? mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+  std::vector<BatchSums> local;
+  BatchSums* sums = 0;
+  if (map != MAP_FAILED) {
+    sums = static_cast<BatchSums*>(map);
+  }
+  else {
+    nbWorkers = 1;
+    local.resize(nbBatches);
+    sums = &local[0];
+  }
+
+  // Worker w casts the batches w, w+nbWorkers, ...; the sums are added up
+  // in batch order afterwards
+  if (nbWorkers == 1) {
+    for (G4int batch = 0; batch < nbBatches; batch++) {
+      G4long rays = (batch == nbBatches-1) ? nbRays - G4long(batch)*fBatchSize : fBatchSize;
+      CastBatch(world, crystalMaterial, rays, seed, batch, sums[batch]);
+    }
+  }
+  else {
+    std::fflush(0);
+    std::vector<pid_t> workers(nbWorkers, -1);
+    for (G4int w = 0; w < nbWorkers; w++) {
+      workers[w] = fork();
+      if (workers[w] == 0) {
+        for (G4int batch = w; batch < nbBatches; batch += nbWorkers) {
+          G4long rays = (batch == nbBatches-1) ? nbRays - G4long(batch)*fBatchSize : fBatchSize;
+          CastBatch(world, crystalMaterial, rays, seed, batch, sums[batch]);
+        }
+        std::fflush(0);
+        _exit(0);
+      }
+    }
+    G4bool ok = true;
+    for (G4int w = 0; w < nbWorkers; w++) {
+      G4int status = 0;
+      if (workers[w] < 0 || waitpid(workers[w], &status, 0) != workers[w]
+          || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        ok = false;
+      }
+    }
+    if (!ok) {
+      munmap(map, size);
+      G4Exception("SpecMATSimEfficiencyEstimator::Estimate()", "SpecMATSim010", FatalException,
+                  "A ray casting worker process failed.");
+    }
+  }
+
+  BatchSums total = {0, 0, 0., 0., 0.};
+  for (G4int batch = 0; batch < nbBatches; batch++) {
+    total.rays += sums[batch].rays;
+    total.hits += sums[batch].hits;
+    total.sumP += sums[batch].sumP;
+    total.sumP2 += sums[batch].sumP2;
+    total.sumTransmission += sums[batch].sumTransmission;
+  }
+  if (map != MAP_FAILED) munmap(map, size);
+
+  Result result;
+  G4double n = (total.rays > 0) ? G4double(total.rays) : 1.;
+  result.rays = total.rays;
+  result.geometric = total.hits/n;
+  result.geometricError = std::sqrt(result.geometric*(1. - result.geometric)/n);
+  result.firstInteraction = total.sumP/n;
+  G4double variance = total.sumP2/n - result.firstInteraction*result.firstInteraction;
+  result.firstInteractionError = (variance > 0.) ? std::sqrt(variance/n) : 0.;
+  result.transmission = (total.hits > 0) ? total.sumTransmission/total.hits : 0.;
+  timer.Stop();
+  result.seconds = timer.GetRealElapsed();
+  return result;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimEfficiencyEstimator::CastBatch(G4VPhysicalVolume* world, const G4Material* crystalMaterial,
+                                              G4long nbRays, long seed, G4int batch, BatchSums& sums)
+{
+  // The directions of the batch at once, from its own engine
+  long seeds[3];
+  SpecMATSimUtils::EventSeeds(seed, batch, seeds);
+  seeds[2] = 0;
+  CLHEP::RanecuEngine engine;
+  engine.setSeeds(seeds, -1);
+  std::vector<G4double> random(2*nbRays);
+  engine.flatArray(2*nbRays, &random[0]);
+
+  // Optical depth at the entry and the exit of every crystal segment, and
+  // the ray it belongs to
+  std::vector<G4double> depthIn;
+  std::vector<G4double> depthOut;
+  std::vector<G4int> segmentRay;
+  std::vector<G4double> firstDepth(nbRays, -1.);
+  SpecMATSimRayCaster caster(world);
+  SpecMATSimRayCaster::Segments segments;
+  for (G4long i = 0; i < nbRays; i++) {
+    G4double cosTheta = 2.*random[2*i] - 1.;
+    G4double sinTheta = std::sqrt(1. - cosTheta*cosTheta);
+    G4double phi = twopi*random[2*i+1];
+    caster.Cast(fSource, G4ThreeVector(sinTheta*std::cos(phi), sinTheta*std::sin(phi), cosTheta), segments);
+
+    G4double depth = 0.;
+    for (size_t k = 0; k < segments.size(); k++) {
+      G4double next = depth + fAttenuation[segments[k].first->GetIndex()]*segments[k].second;
+      if (segments[k].first == crystalMaterial) {
+        if (firstDepth[i] < 0.) firstDepth[i] = depth;
+        depthIn.push_back(depth);
+        depthOut.push_back(next);
+        segmentRay.push_back(G4int(i));
+      }
+      depth = next;
+    }
+  }
+
+  // Interaction probabilities of all segments in one loop without branches
+  size_t nbSegments = depthIn.size();
+  std::vector<G4double> p(nbSegments);
+  for (size_t k = 0; k < nbSegments; k++) {
+    p[k] = std::exp(-depthIn[k]) - std::exp(-depthOut[k]);
+  }
+  std::vector<G4double> rayP(nbRays, 0.);
+  for (size_t k = 0; k < nbSegments; k++) rayP[segmentRay[k]] += p[k];
+
+  sums.rays = nbRays;
+  sums.hits = 0;
+  sums.sumP = 0.;
+  sums.sumP2 = 0.;
+  sums.sumTransmission = 0.;
+  for (G4long i = 0; i < nbRays; i++) {
+    sums.sumP += rayP[i];
+    sums.sumP2 += rayP[i]*rayP[i];
+    if (firstDepth[i] >= 0.) {
+      sums.hits++;
+      sums.sumTransmission += std::exp(-firstDepth[i]);
+    }
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -5,9 +5,16 @@
 #include "SpecMATSimRunAction.hh"
 #include "SpecMATSimAnalysis.hh"
 #include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimPrimaryGeneratorAction.hh"
+#include "SpecMATSimResponseMatrix.hh"
+#include "SpecMATSimLightMap.hh"
+#include "SpecMATSimDigitizer.hh"
+#include "SpecMATSimCoincidences.hh"
+#include "SpecMATSimSnapshot.hh"
 
 #include "G4RunManager.hh"
 #include "G4Event.hh"
+#include "G4Run.hh"
 #include "G4SDManager.hh"
 #include "G4HCofThisEvent.hh"
 #include "G4GenericMessenger.hh"
@@ -25,12 +32,15 @@
 
 SpecMATSimEventAction::SpecMATSimEventAction(SpecMATSimRunAction* runAction)
  : G4UserEventAction(),
-   sciCryst(0),
    fRunAct(runAction),
-   fCollID_cryst(0.),
-   fPrintModulo(1)
+   fCollID_cryst(-1),
+   fCollID_light(-1),
+   fCollID_time(-1),
+   fCollIDRun(-1),
+   fDetectedPhotons(0),
+   fPrintModulo(1),
+   fVerboseLevel(2)
 {
-  sciCryst = new SpecMATSimDetectorConstruction();
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -74,17 +84,45 @@ G4double SpecMATSimEventAction::GetSum(G4THitsMap<G4double>* hitsMap) const
 void SpecMATSimEventAction::BeginOfEventAction(const G4Event* event )
 {
   G4int eventNb = event->GetEventID();
-  G4cout << "\n###########################################################" << G4endl;
-  G4cout << "Event №" << eventNb << G4endl;
+  if (fVerboseLevel > 1) {
+    G4cout << "\n###########################################################" << G4endl;
+    const SpecMATSimPrimaryGeneratorAction* gun
+      = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+          G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+    G4cout << "Event №" << eventNb;
+    if (gun->GetEventNumber(eventNb) != eventNb) {
+      G4cout << " (event " << gun->GetEventNumber(eventNb) << " of the seeded run)";
+    }
+    G4cout << G4endl;
+  }
 
-  if (eventNb == 0) {
+  // Once per run, at its first event in this process: a worker process
+  // starts at the first event of its range, not at event 0
+  G4int runID = G4RunManager::GetRunManager()->GetCurrentRun()->GetRunID();
+  if (runID != fCollIDRun) {
+    fCollIDRun = runID;
     G4SDManager* SDMan = G4SDManager::GetSDMpointer();
     fCollID_cryst   = SDMan->GetCollectionID("crystal/edep");
+    // only registered when the light collection map is applied
+    fCollID_light   = SDMan->GetCollectionID("crystal/light");
+    // only registered when the digitizer is used
+    fCollID_time    = SDMan->GetCollectionID("crystal/time");
   }
+  fDetectedPhotons = 0;
 
-  if (eventNb%fPrintModulo == 0) {
+  if (fVerboseLevel > 1 && eventNb%fPrintModulo == 0) {
     G4cout << "\n---> Begin of event: " << eventNb << G4endl;
   }
+
+  // Progress in steps of 1% of the run
+  //
+  if (fVerboseLevel == 1) {
+    G4int nbEvents = G4RunManager::GetRunManager()->GetCurrentRun()->GetNumberOfEventToBeProcessed();
+    G4int step = (nbEvents > 100) ? nbEvents/100 : 1;
+    if (eventNb%step == 0 || eventNb == nbEvents-1) {
+      G4cout << "---> Progress: " << eventNb+1 << "/" << nbEvents << " events" << G4endl;
+    }
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -98,23 +136,74 @@ void SpecMATSimEventAction::EndOfEventAction(const G4Event* event )
   G4HCofThisEvent* HCE = event->GetHCofThisEvent();
   if(!HCE) return;
 
-  //Energy in crystals : identify 'good events'
-  //
-  const G4double eThreshold = 0*eV;
-  G4int nbOfFired = 0;
-
   G4THitsMap<G4double>* eventMapCryst =
                      (G4THitsMap<G4double>*)(HCE->GetHC(fCollID_cryst));
+  G4THitsMap<G4double>* eventMapLight = 0;
+  if (fCollID_light >= 0) {
+    eventMapLight = (G4THitsMap<G4double>*)(HCE->GetHC(fCollID_light));
+  }
+
+  // Digitizer input: smeared energy and first hit time per crystal
+  //
+  SpecMATSimDigitizer* digitizer = fRunAct->GetDigitizer();
+  G4THitsMap<G4double>* eventMapTime = 0;
+  if (digitizer && fCollID_time >= 0) {
+    eventMapTime = (G4THitsMap<G4double>*)(HCE->GetHC(fCollID_time));
+  }
+  std::map<G4int, G4double> digiTimes;
+
+  // Light collection map tabulation: photons reaching the window of crystal Nb1
+  //
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  if (detector->GetLightCollection() == "tabulate") {
+    const SpecMATSimPrimaryGeneratorAction* generator
+      = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+          G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+    if (generator->GetSource() == "opticalScan" && detector->GetLightMap()) {
+      detector->GetLightMap()->AddTabulation(generator->GetOpticalScanCell(),
+                                             generator->GetOpticalScanPhotons(),
+                                             fDetectedPhotons);
+    }
+  }
   //G4THitsMap<G4double>* eventMapRing =
   //                   (G4THitsMap<G4double>*)(HCE->GetHC(fCollID_ring));
   std::map<G4int,G4double*>::iterator itr;
   //std::map<G4int,G4double*>::iterator itr2;
 
+  // Response matrix mode: the row is the true-energy grid point of this event
+  //
+  SpecMATSimResponseMatrix* responseMatrix = fRunAct->GetResponseMatrix();
+  G4int responseRow = -1;
+  G4double sumEdep = 0.;
+  G4double sumAbsoEdep = 0.;
+  if (responseMatrix) {
+    const SpecMATSimPrimaryGeneratorAction* generator
+      = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+          G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+    responseRow = generator->GetResponseGridIndex();
+    responseMatrix->CountThrown(responseRow);
+  }
+
+  // Resolution corrected energy of every crystal with a deposit [keV]
+  //
+  std::map<G4int, G4double> crystEnergies;
+
   for (itr = eventMapCryst->GetMap()->begin(); itr != eventMapCryst->GetMap()->end(); itr++) {
     G4int copyNb  = (itr->first);
     G4double edep = *(itr->second);
-    if (edep > eThreshold) nbOfFired++;
-    crystMat = sciCryst->GetSciCrystMat();
+
+    // Position dependent light collection: smear the collected light instead
+    // of the deposit, the true deposit is kept for the response matrix
+    G4double trueEdep = edep;
+    if (eventMapLight) {
+      G4double* light = (*eventMapLight)[copyNb];
+      edep = light ? *light : 0.;
+    }
+    // the material of the registered detector, a variant or an
+    // optimisation candidate may have changed it
+    crystMat = detector->GetSciCrystMat();
 
     if (crystMat->GetName() == "CeBr3") {
     //Resolution correction of registered gamma energy for CeBr3.   
@@ -131,23 +220,90 @@ void SpecMATSimEventAction::EndOfEventAction(const G4Event* event )
 
     //Without resolution correction
     //G4double absoEdep = edep/keV;
-    G4cout << "\n" << crystMat->GetName() +  " Nb" << copyNb << ": E " << edep/keV << " keV, Resolution Corrected E "<< absoEdep << " keV, " << "FWHM " << ((edep/keV)*(108*pow(edep/keV,-0.498))/100) << G4endl;
+    if (fVerboseLevel > 1) {
+      G4cout << "\n" << crystMat->GetName() +  " Nb" << copyNb << ": E " << edep/keV << " keV, Resolution Corrected E "<< absoEdep << " keV, " << "FWHM " << ((edep/keV)*(108*pow(edep/keV,-0.498))/100) << G4endl;
+    }
+    crystEnergies[copyNb] = absoEdep;
 
-    // get analysis manager
-    //
-    G4AnalysisManager* analysisManager = G4AnalysisManager::Instance();
+    if (digitizer && eventMapTime) {
+      G4double* time = (*eventMapTime)[copyNb];
+      if (time) digiTimes[copyNb] = *time;
+    }
+
+    if (responseMatrix) {
+      responseMatrix->Fill(copyNb, responseRow, trueEdep/keV, absoEdep);
+    }
+    sumEdep += trueEdep/keV;
+    sumAbsoEdep += absoEdep;
+  }
+
+  // Calorimetric sum of the array is the last detector of the response matrix
+  //
+  if (responseMatrix && !eventMapCryst->GetMap()->empty()) {
+    responseMatrix->Fill(responseMatrix->GetNbDetectors(), responseRow, sumEdep, sumAbsoEdep);
+  }
+
+  // Every event advances the digitizer timeline, also without hits
+  //
+  if (digitizer) {
+    digitizer->ProcessEvent(eventNb, crystEnergies, digiTimes);
+  }
+
+  // Trigger: rejected events skip all analysis output
+  //
+  std::map<G4int, G4double> firedEnergies;
+  SpecMATSimSnapshot* snapshot = fRunAct->GetSnapshot();
+  if (!fRunAct->GetTrigger()->Accept(crystEnergies, firedEnergies)) {
+    if (snapshot) snapshot->EndOfEvent(0);
+    return;
+  }
+  G4int nbOfFired = firedEnergies.size();
+
+  // A shard, a continued cached run or a replay writes the event numbers
+  // of the seeded run, the ones its seeds derive from
+  const SpecMATSimPrimaryGeneratorAction* gun
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+
+  // Only the fired crystals reach the outputs: a crystal below its
+  // threshold has no hit, also in an accepted event
+  std::map<G4int, G4double>::const_iterator it;
+  for (it = firedEnergies.begin(); it != firedEnergies.end(); it++) {
+    G4int copyNb = it->first;
+    absoEdep = it->second;
 
-    // fill histograms
+    // fill histograms and ntuple
     //
-    analysisManager->FillH1((sciCryst->GetNbCrystInSegmentRow())*(sciCryst->GetNbCrystInSegmentColumn())*(sciCryst->GetNbSegments())+1, absoEdep);
-    analysisManager->FillH1(copyNb, absoEdep);
+    fRunAct->FillDeposit(gun->GetEventNumber(eventNb), copyNb, absoEdep);
 
-    // fill ntuple
+    // Live snapshot, filled like the histograms
     //
-    analysisManager->FillNtupleDColumn(0, eventNb);
-    analysisManager->FillNtupleDColumn(1, copyNb);
-    analysisManager->FillNtupleDColumn(2, absoEdep);
-    analysisManager->AddNtupleRow();
+    if (snapshot) {
+      snapshot->Fill(copyNb, absoEdep);
+    }
+  }
+
+  // Efficiency figures of the run summary: triggered events, and the full
+  // gamma energy deposited in the array
+  //
+  fRunAct->CountEvents();
+  G4bool fullEnergy = (gun->GetSource() == "gamma" || gun->GetSource() == "gammaGrid"
+                       || gun->GetSource() == "inFlight")
+                      && sumEdep > gun->GetParticleGun()->GetParticleEnergy()/keV - 1.;
+  if (fullEnergy) {
+    fRunAct->CountFullEnergyEvents();
+  }
+  fRunAct->RecordEvent(eventNb, fullEnergy);
+
+  // Fired crystals for the gamma-gamma matrices
+  //
+  SpecMATSimCoincidences* coincidences = fRunAct->GetCoincidences();
+  if (coincidences) {
+    coincidences->FillEvent(firedEnergies);
+  }
+
+  if (snapshot) {
+    snapshot->EndOfEvent(nbOfFired);
   }
 }
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
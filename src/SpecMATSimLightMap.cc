@@ -0,0 +1,182 @@
+/// \file SpecMATSimLightMap.cc
+/// \brief Implementation of the SpecMATSimLightMap class
+
+#include "SpecMATSimLightMap.hh"
+
+#include <fstream>
+#include <sstream>
+#include <cmath>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimLightMap::SpecMATSimLightMap(G4int nbBinsX, G4int nbBinsY, G4int nbBinsZ,
+                                       G4double sizeX, G4double sizeY, G4double sizeZ)
+ : fNbBinsX(nbBinsX),
+   fNbBinsY(nbBinsY),
+   fNbBinsZ(nbBinsZ),
+   fSizeX(sizeX),
+   fSizeY(sizeY),
+   fSizeZ(sizeZ),
+   fEmitted(nbBinsX*nbBinsY*nbBinsZ, 0.),
+   fDetected(nbBinsX*nbBinsY*nbBinsZ, 0.),
+   fRelative(nbBinsX*nbBinsY*nbBinsZ, 1.)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimLightMap::~SpecMATSimLightMap()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SpecMATSimLightMap::CellIndex(G4int ix, G4int iy, G4int iz) const
+{
+  return (iz*fNbBinsY + iy)*fNbBinsX + ix;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector SpecMATSimLightMap::GetCellHalfSize() const
+{
+  return G4ThreeVector(fSizeX/fNbBinsX, fSizeY/fNbBinsY, fSizeZ/fNbBinsZ);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector SpecMATSimLightMap::GetCellCentre(G4int cell) const
+{
+  G4int ix = cell%fNbBinsX;
+  G4int iy = (cell/fNbBinsX)%fNbBinsY;
+  G4int iz = cell/(fNbBinsX*fNbBinsY);
+  G4ThreeVector half = GetCellHalfSize();
+  return G4ThreeVector(-fSizeX + (2*ix+1)*half.x(),
+                       -fSizeY + (2*iy+1)*half.y(),
+                       -fSizeZ + (2*iz+1)*half.z());
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimLightMap::AddTabulation(G4int cell, G4double emitted, G4double detected)
+{
+  if (cell < 0 || cell >= GetNbCells()) return;
+  fEmitted[cell] += emitted;
+  fDetected[cell] += detected;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimLightMap::Efficiency(G4int cell) const
+{
+  return (fEmitted[cell] > 0.) ? fDetected[cell]/fEmitted[cell] : 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimLightMap::Normalise()
+{
+  // All cells have the same volume, so the volume average is the plain mean
+  G4double mean = 0.;
+  for (G4int cell = 0; cell < GetNbCells(); cell++) mean += Efficiency(cell);
+  mean /= GetNbCells();
+  for (G4int cell = 0; cell < GetNbCells(); cell++) {
+    fRelative[cell] = (mean > 0.) ? Efficiency(cell)/mean : 1.;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimLightMap::Write(const G4String& fileName) const
+{
+  std::ofstream out(fileName.c_str());
+  if (!out) {
+    G4cerr << "Cannot open light collection map " << fileName << G4endl;
+    return false;
+  }
+  out << "# SpecMATSim light collection map" << "\n";
+  out << "# nbBinsX nbBinsY nbBinsZ crystal half-sizes X Y Z [mm]" << "\n";
+  out << fNbBinsX << " " << fNbBinsY << " " << fNbBinsZ << " "
+      << fSizeX << " " << fSizeY << " " << fSizeZ << "\n";
+  out << "# ix iy iz efficiency emitted detected" << "\n";
+  for (G4int iz = 0; iz < fNbBinsZ; iz++) {
+    for (G4int iy = 0; iy < fNbBinsY; iy++) {
+      for (G4int ix = 0; ix < fNbBinsX; ix++) {
+        G4int cell = CellIndex(ix, iy, iz);
+        out << ix << " " << iy << " " << iz << " " << Efficiency(cell) << " "
+            << fEmitted[cell] << " " << fDetected[cell] << "\n";
+      }
+    }
+  }
+  G4cout << "Light collection map written to " << fileName << G4endl;
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimLightMap::Read(const G4String& fileName)
+{
+  std::ifstream in(fileName.c_str());
+  if (!in) return false;
+
+  std::string line;
+  G4bool haveHeader = false;
+  while (std::getline(in, line)) {
+    if (line.empty() || line[0] == '#') continue;
+    std::istringstream fields(line);
+    if (!haveHeader) {
+      fields >> fNbBinsX >> fNbBinsY >> fNbBinsZ >> fSizeX >> fSizeY >> fSizeZ;
+      if (!fields || fNbBinsX < 1 || fNbBinsY < 1 || fNbBinsZ < 1) return false;
+      fEmitted.assign(GetNbCells(), 0.);
+      fDetected.assign(GetNbCells(), 0.);
+      fRelative.assign(GetNbCells(), 1.);
+      haveHeader = true;
+      continue;
+    }
+    G4int ix, iy, iz;
+    G4double efficiency, emitted, detected;
+    fields >> ix >> iy >> iz >> efficiency >> emitted >> detected;
+    if (!fields) return false;
+    if (ix < 0 || ix >= fNbBinsX || iy < 0 || iy >= fNbBinsY || iz < 0 || iz >= fNbBinsZ) continue;
+    fEmitted[CellIndex(ix, iy, iz)] = emitted;
+    fDetected[CellIndex(ix, iy, iz)] = detected;
+  }
+  if (!haveHeader) return false;
+  Normalise();
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimLightMap::GetRelativeEfficiency(const G4ThreeVector& localPosition) const
+{
+  // Continuous cell coordinates with cell centres at integer values,
+  // clamped so that the outermost half cells take the edge value
+  G4double u[3] = { (localPosition.x() + fSizeX)/(2*fSizeX)*fNbBinsX - 0.5,
+                    (localPosition.y() + fSizeY)/(2*fSizeY)*fNbBinsY - 0.5,
+                    (localPosition.z() + fSizeZ)/(2*fSizeZ)*fNbBinsZ - 0.5 };
+  const G4int nbBins[3] = { fNbBinsX, fNbBinsY, fNbBinsZ };
+  G4int lo[3], hi[3];
+  G4double frac[3];
+  for (G4int i = 0; i < 3; i++) {
+    if (u[i] < 0.) u[i] = 0.;
+    if (u[i] > nbBins[i]-1) u[i] = nbBins[i]-1;
+    lo[i] = G4int(std::floor(u[i]));
+    hi[i] = (lo[i]+1 < nbBins[i]) ? lo[i]+1 : lo[i];
+    frac[i] = u[i] - lo[i];
+  }
+
+  G4double value = 0.;
+  for (G4int corner = 0; corner < 8; corner++) {
+    G4int ix = (corner & 1) ? hi[0] : lo[0];
+    G4int iy = (corner & 2) ? hi[1] : lo[1];
+    G4int iz = (corner & 4) ? hi[2] : lo[2];
+    G4double weight = ((corner & 1) ? frac[0] : 1.-frac[0])
+                    * ((corner & 2) ? frac[1] : 1.-frac[1])
+                    * ((corner & 4) ? frac[2] : 1.-frac[2]);
+    value += weight*fRelative[CellIndex(ix, iy, iz)];
+  }
+  return value;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,465 @@
+/// \file SpecMATSimOptimiser.cc
+/// \brief Implementation of the SpecMATSimOptimiser class
+
+#include "SpecMATSimOptimiser.hh"
+#include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimPrimaryGeneratorAction.hh"
+#include "SpecMATSimRunAction.hh"
+#include "SpecMATSimRunManager.hh"
+#include "SpecMATSimUtils.hh"
+
+#include "G4Material.hh"
+#include "G4UIcommand.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <algorithm>
+#include <cmath>
+#include <cstdio>
+#include <fstream>
+#include <iomanip>
+#include <set>
+#include <sstream>
+#include <sys/mman.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+namespace {
+
+  // Sorts candidate indices by decreasing objective, equal ones by index
+  struct ByObjective {
+    const std::vector<G4double>* objective;
+    bool operator()(size_t a, size_t b) const
+      { return ((*objective)[a] != (*objective)[b]) ? (*objective)[a] > (*objective)[b] : a < b; }
+  };
+
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimOptimiser::SpecMATSimOptimiser(SpecMATSimDetectorConstruction* detector,
+                                         SpecMATSimPrimaryGeneratorAction* generator,
+                                         SpecMATSimRunAction* runAction)
+ : fDetector(detector),
+   fGenerator(generator),
+   fRunAction(runAction),
+   fVariants(detector, generator, runAction),
+   fObjective("fullEnergy"),
+   fEnergy(0.),
+   fMaxCrystals(0),
+   fMaxCost(0.),
+   fMaxCandidates(100),
+   fFirstEvents(1000),
+   fReduction(3)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimOptimiser::~SpecMATSimOptimiser()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimOptimiser::Read(const G4String& fileName)
+{
+  std::ifstream in(fileName.c_str());
+  if (!in) {
+    G4cerr << "Cannot read the optimisation file " << fileName << G4endl;
+    return false;
+  }
+
+  fParameters.clear();
+  fCosts.clear();
+  std::string line;
+  G4int lineNb = 0;
+  while (std::getline(in, line)) {
+    lineNb++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string keyword;
+    if (!(words >> keyword)) continue;
+
+    G4bool ok = true;
+    if (keyword == "parameter") {
+      Parameter parameter;
+      std::string value;
+      ok = (words >> parameter.name) && fVariants.IsKnown(parameter.name);
+      while (ok && words >> value) parameter.values.push_back(value);
+      ok = ok && !parameter.values.empty();
+      // SetSciCrystMat() keeps the old material for an unknown one, the
+      // candidate would be the same layout under another name
+      for (size_t i = 0; ok && parameter.name == "sciCrystMat" && i < parameter.values.size(); i++) {
+        if (!G4Material::GetMaterial(parameter.values[i], false)) {
+          G4cerr << fileName << ":" << lineNb << ": crystal material "
+                 << parameter.values[i] << " is not defined" << G4endl;
+          return false;
+        }
+      }
+      if (ok) fParameters.push_back(parameter);
+    }
+    else if (keyword == "objective") {
+      ok = (words >> fObjective) && (fObjective == "fullEnergy" || fObjective == "detection");
+    }
+    else if (keyword == "energy") {
+      ok = (words >> fEnergy) && fEnergy > 0.;
+      fEnergy *= keV;
+    }
+    else if (keyword == "maxCrystals") ok = (words >> fMaxCrystals) && fMaxCrystals >= 0;
+    else if (keyword == "maxCost") ok = (words >> fMaxCost) && fMaxCost >= 0.;
+    else if (keyword == "cost") {
+      std::string material;
+      G4double cost = 0.;
+      ok = (words >> material >> cost) && cost >= 0.;
+      if (ok) fCosts[material] = cost;
+    }
+    else if (keyword == "candidates") ok = (words >> fMaxCandidates) && fMaxCandidates > 0;
+    else if (keyword == "events") ok = (words >> fFirstEvents) && fFirstEvents > 0;
+    else if (keyword == "reduction") ok = (words >> fReduction) && fReduction > 1;
+    else ok = false;
+
+    if (!ok) {
+      G4cerr << fileName << ":" << lineNb << ": cannot read " << line << G4endl;
+      return false;
+    }
+  }
+
+  if (fParameters.empty()) {
+    G4cerr << fileName << " has no parameters" << G4endl;
+    return false;
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimOptimiser::Evaluate(Candidate& candidate) const
+{
+  fVariants.Apply(candidate.settings);
+  candidate.crystals = fDetector->GetNbCrystals();
+  // the crystal sizes are half-sizes
+  G4double volume = 8.*fDetector->GetSciCrystSizeX()*fDetector->GetSciCrystSizeY()
+                      *fDetector->GetSciCrystSizeZ();
+  std::map<G4String, G4double>::const_iterator cost
+    = fCosts.find(fDetector->GetSciCrystMat()->GetName());
+  candidate.cost = candidate.crystals*volume/cm3*((cost != fCosts.end()) ? cost->second : 1.);
+  candidate.events = 0;
+  candidate.detected = 0;
+  candidate.fullEnergy = 0;
+  candidate.rounds = 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimOptimiser::MakeCandidates(long seedBase)
+{
+  fCandidates.clear();
+  fVariants.SaveDefaults();
+
+  // A grid point is one value index per parameter
+  G4double gridSize = 1.;
+  for (size_t p = 0; p < fParameters.size(); p++) gridSize *= fParameters[p].values.size();
+
+  std::vector<std::vector<size_t> > points;
+  if (gridSize <= 100000.) {
+    std::vector<size_t> point(fParameters.size(), 0);
+    for (G4int n = 0; n < G4int(gridSize); n++) {
+      points.push_back(point);
+      for (size_t p = 0; p < point.size(); p++) {
+        if (++point[p] < fParameters[p].values.size()) break;
+        point[p] = 0;
+      }
+    }
+  }
+  else {
+    // Too many to list: random points, each one once
+    std::set<std::vector<size_t> > seen;
+    unsigned long long z = SpecMATSimUtils::Mix64(seedBase);
+    for (G4int attempt = 0; attempt < 100*fMaxCandidates && G4int(points.size()) < 10*fMaxCandidates; attempt++) {
+      std::vector<size_t> point(fParameters.size());
+      for (size_t p = 0; p < point.size(); p++) {
+        z = SpecMATSimUtils::Mix64(z);
+        point[p] = size_t(z%fParameters[p].values.size());
+      }
+      if (seen.insert(point).second) points.push_back(point);
+    }
+  }
+
+  std::vector<Candidate> feasible;
+  for (size_t n = 0; n < points.size(); n++) {
+    Candidate candidate;
+    for (size_t p = 0; p < fParameters.size(); p++) {
+      candidate.settings.push_back(SpecMATSimVariants::Setting(fParameters[p].name,
+                                                               fParameters[p].values[points[n][p]]));
+    }
+    Evaluate(candidate);
+    if (fMaxCrystals > 0 && candidate.crystals > fMaxCrystals) continue;
+    if (fMaxCost > 0. && candidate.cost > fMaxCost) continue;
+    feasible.push_back(candidate);
+  }
+
+  // A random sample of the feasible points, kept in grid order
+  std::vector<size_t> order(feasible.size());
+  for (size_t n = 0; n < order.size(); n++) order[n] = n;
+  unsigned long long z = SpecMATSimUtils::Mix64(~(unsigned long long)seedBase);
+  size_t nbCandidates = std::min(order.size(), size_t(fMaxCandidates));
+  for (size_t n = 0; n < nbCandidates; n++) {
+    z = SpecMATSimUtils::Mix64(z);
+    std::swap(order[n], order[n + size_t(z%(order.size() - n))]);
+  }
+  order.resize(nbCandidates);
+  std::sort(order.begin(), order.end());
+  for (size_t n = 0; n < order.size(); n++) fCandidates.push_back(feasible[order[n]]);
+
+  G4cout << "Optimisation: " << G4long(gridSize) << " grid points, " << points.size()
+         << " examined, " << feasible.size() << " within the constraints, "
+         << fCandidates.size() << " candidates" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimOptimiser::Run(G4int nbWorkers, long seedBase, const G4String& baseName)
+{
+  if (fEnergy > 0. && fGenerator->GetSource() != "gamma") {
+    G4cerr << "The energy of the optimisation needs the gamma source, not "
+           << fGenerator->GetSource() << G4endl;
+    return;
+  }
+  MakeCandidates(seedBase);
+  if (fCandidates.empty()) {
+    fVariants.Apply(std::vector<SpecMATSimVariants::Setting>());
+    return;
+  }
+
+  G4String base = (baseName != "") ? baseName : G4String("optimisation");
+  G4double energy = fGenerator->GetGammaEnergy();
+  if (fEnergy > 0.) fGenerator->SetGammaEnergy(fEnergy);
+  G4bool checkOverlaps = fDetector->GetCheckOverlaps();
+  fDetector->SetCheckOverlaps(false);
+
+  // Successive halving, every round continues the events of the last one
+  std::vector<size_t> selected(fCandidates.size());
+  for (size_t i = 0; i < selected.size(); i++) selected[i] = i;
+  G4int nbEvents = fFirstEvents;
+  G4int firstEvent = 0;
+  for (G4int round = 1; ; round++) {
+    G4cout << "\n### Optimisation round " << round << ": " << selected.size()
+           << " candidates, events " << firstEvent << " to " << firstEvent + nbEvents - 1 << G4endl;
+    RunRound(selected, nbEvents, firstEvent, nbWorkers, seedBase, base);
+    if (selected.size() == 1) break;
+
+    std::vector<G4double> objective(fCandidates.size(), 0.);
+    for (size_t i = 0; i < selected.size(); i++) objective[selected[i]] = GetObjective(fCandidates[selected[i]]);
+    ByObjective byObjective;
+    byObjective.objective = &objective;
+    std::sort(selected.begin(), selected.end(), byObjective);
+    selected.resize((selected.size() + fReduction - 1)/fReduction);
+
+    firstEvent += nbEvents;
+    if (G4double(nbEvents)*fReduction + firstEvent > 2.e9) break;
+    nbEvents *= fReduction;
+  }
+
+  // The detector and the source as they were
+  fVariants.Apply(std::vector<SpecMATSimVariants::Setting>());
+  fDetector->SetCheckOverlaps(checkOverlaps);
+  fDetector->UpdateGeometry();
+  fGenerator->SetGammaEnergy(energy);
+  fGenerator->ResetSource();
+  fRunAction->SetOutputName(baseName);
+
+  Report(seedBase, base);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimOptimiser::RunRound(const std::vector<size_t>& selected, G4int nbEvents, G4int firstEvent,
+                                   G4int nbWorkers, long seedBase, const G4String& baseName)
+{
+  // Candidates in parallel, the workers left over run the event loops
+  SpecMATSimRunManager* runManager = static_cast<SpecMATSimRunManager*>(G4RunManager::GetRunManager());
+  G4int eventWorkers = runManager->GetNbWorkers();
+  G4int nbChildren = std::min(nbWorkers, G4int(selected.size()));
+  runManager->SetNbWorkers(std::max(1, nbWorkers/std::max(1, nbChildren)));
+
+  size_t size = selected.size()*sizeof(Counts);
+  void* map = (nbChildren > 1)
+    ? mmap(0, size, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0) : MAP_FAILED;
+  std::vector<Counts> local;
+  Counts* counts = 0;
+  if (map != MAP_FAILED) {
+    counts = static_cast<Counts*>(map);
+  }
+  else {
+    nbChildren = 1;
+    local.resize(selected.size());
+    counts = &local[0];
+  }
+
+  if (nbChildren == 1) {
+    for (size_t k = 0; k < selected.size(); k++) {
+      RunCandidate(selected[k], nbEvents, firstEvent, seedBase, baseName, counts[k]);
+    }
+  }
+  else {
+    // Worker c runs the candidates c, c+nbChildren, ... of the round
+    std::fflush(0);
+    std::vector<pid_t> workers(nbChildren, -1);
+    for (G4int c = 0; c < nbChildren; c++) {
+      workers[c] = fork();
+      if (workers[c] == 0) {
+        for (size_t k = c; k < selected.size(); k += nbChildren) {
+          RunCandidate(selected[k], nbEvents, firstEvent, seedBase, baseName, counts[k]);
+        }
+        std::fflush(0);
+        _exit(0);
+      }
+    }
+    G4bool ok = true;
+    for (G4int c = 0; c < nbChildren; c++) {
+      G4int status = 0;
+      if (workers[c] < 0 || waitpid(workers[c], &status, 0) != workers[c]
+          || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+        ok = false;
+      }
+    }
+    if (!ok) {
+      munmap(map, size);
+      G4Exception("SpecMATSimOptimiser::RunRound()", "SpecMATSim011", FatalException,
+                  "A candidate worker process failed.");
+      return;
+    }
+  }
+
+  for (size_t k = 0; k < selected.size(); k++) {
+    Candidate& candidate = fCandidates[selected[k]];
+    candidate.events += nbEvents;
+    candidate.detected += counts[k].detected;
+    candidate.fullEnergy += counts[k].fullEnergy;
+    candidate.rounds++;
+  }
+  if (map != MAP_FAILED) munmap(map, size);
+  runManager->SetNbWorkers(eventWorkers);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimOptimiser::RunCandidate(size_t index, G4int nbEvents, G4int firstEvent, long seedBase,
+                                       const G4String& baseName, Counts& counts)
+{
+  G4cout << "\n### Candidate " << GetName(index) << G4endl;
+  fVariants.Apply(fCandidates[index].settings);
+  fDetector->UpdateGeometry();
+  fGenerator->ResetSource();
+  fGenerator->SetEventSeeding(true, seedBase, firstEvent);
+  fRunAction->SetOutputName(baseName + "_" + GetName(index));
+  G4RunManager::GetRunManager()->BeamOn(nbEvents);
+  fGenerator->SetEventSeeding(false);
+  counts.detected = fRunAction->fGoodEvents;
+  counts.fullEnergy = fRunAction->GetFullEnergyEvents();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimOptimiser::GetObjective(const Candidate& candidate) const
+{
+  if (candidate.events == 0) return 0.;
+  G4long count = (fObjective == "detection") ? candidate.detected : candidate.fullEnergy;
+  return G4double(count)/candidate.events;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimOptimiser::GetObjectiveError(const Candidate& candidate) const
+{
+  if (candidate.events == 0) return 0.;
+  G4double p = GetObjective(candidate);
+  return std::sqrt(p*(1. - p)/candidate.events);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimOptimiser::GetName(size_t index) const
+{
+  std::ostringstream name;
+  name << "candidate" << std::setw(4) << std::setfill('0') << index;
+  return name.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimOptimiser::Report(long seedBase, const G4String& baseName) const
+{
+  // Ranked by the last round reached, then by the objective
+  std::vector<size_t> ranking;
+  G4int lastRound = 0;
+  G4long totalEvents = 0;
+  for (size_t i = 0; i < fCandidates.size(); i++) {
+    lastRound = std::max(lastRound, fCandidates[i].rounds);
+    totalEvents += fCandidates[i].events;
+  }
+  for (G4int round = lastRound; round > 0; round--) {
+    std::vector<size_t> reached;
+    std::vector<G4double> objective(fCandidates.size(), 0.);
+    for (size_t i = 0; i < fCandidates.size(); i++) {
+      if (fCandidates[i].rounds != round) continue;
+      reached.push_back(i);
+      objective[i] = GetObjective(fCandidates[i]);
+    }
+    ByObjective byObjective;
+    byObjective.objective = &objective;
+    std::sort(reached.begin(), reached.end(), byObjective);
+    ranking.insert(ranking.end(), reached.begin(), reached.end());
+  }
+
+  G4cout
+     << "\n--------------------Design optimisation---------------------\n"
+     << " " << fCandidates.size() << " candidates, " << totalEvents << " events in total, seed base "
+     << seedBase << ", objective " << fObjective << "\n"
+     << std::setw(15) << std::left << " candidate" << std::right
+     << std::setw(7) << "rounds" << std::setw(10) << "events"
+     << std::setw(24) << "efficiency" << std::setw(9) << "crystals" << std::setw(10) << "cost"
+     << "  settings";
+  for (size_t r = 0; r < ranking.size(); r++) {
+    const Candidate& candidate = fCandidates[ranking[r]];
+    G4cout << "\n " << std::setw(14) << std::left << GetName(ranking[r]) << std::right
+           << std::setw(7) << candidate.rounds << std::setw(10) << candidate.events
+           << std::setw(12) << GetObjective(candidate) << " +- " << std::setw(8) << GetObjectiveError(candidate)
+           << std::setw(9) << candidate.crystals << std::setw(10) << candidate.cost << " ";
+    for (size_t s = 0; s < candidate.settings.size(); s++) {
+      G4cout << " " << candidate.settings[s].first << "=" << candidate.settings[s].second;
+    }
+  }
+  G4cout << "\n------------------------------------------------------------\n"
+         << G4endl;
+
+  G4String fileName = baseName + "_optimisation.json";
+  std::ofstream json(fileName.c_str());
+  json << "{\n"
+       << "  \"objective\": \"" << fObjective << "\",\n"
+       << "  \"seedBase\": " << seedBase << ",\n"
+       << "  \"events\": " << totalEvents << ",\n"
+       << "  \"candidates\": [";
+  for (size_t r = 0; r < ranking.size(); r++) {
+    const Candidate& candidate = fCandidates[ranking[r]];
+    json << (r ? "," : "") << "\n    {\"name\": \"" << GetName(ranking[r]) << "\""
+         << ", \"rounds\": " << candidate.rounds << ", \"events\": " << candidate.events
+         << ", \"efficiency\": " << GetObjective(candidate)
+         << ", \"error\": " << GetObjectiveError(candidate)
+         << ", \"crystals\": " << candidate.crystals << ", \"cost\": " << candidate.cost
+         << ", \"settings\": {";
+    for (size_t s = 0; s < candidate.settings.size(); s++) {
+      json << (s ? ", " : "") << "\"" << SpecMATSimUtils::JsonEscape(candidate.settings[s].first)
+           << "\": \"" << SpecMATSimUtils::JsonEscape(candidate.settings[s].second) << "\"";
+    }
+    json << "}}";
+  }
+  json << "\n  ]\n}\n";
+  json.close();
+  G4cout << "Optimisation result written to " << fileName << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,88 @@
+/// \file SpecMATSimPSFirstHitTime.cc
+/// \brief Implementation of the SpecMATSimPSFirstHitTime class
+
+#include "SpecMATSimPSFirstHitTime.hh"
+
+#include "G4Step.hh"
+#include "G4MultiFunctionalDetector.hh"
+#include "G4HCofThisEvent.hh"
+#include "G4UnitsTable.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPSFirstHitTime::SpecMATSimPSFirstHitTime(G4String name, G4int depth)
+ : G4VPrimitiveScorer(name, depth),
+   HCID(-1),
+   EvtMap(0)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPSFirstHitTime::~SpecMATSimPSFirstHitTime()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimPSFirstHitTime::ProcessHits(G4Step* aStep, G4TouchableHistory*)
+{
+  if (aStep->GetTotalEnergyDeposit() == 0.) return false;
+
+  G4double time = aStep->GetPreStepPoint()->GetGlobalTime();
+  G4int index = GetIndex(aStep);
+  std::map<G4int,G4double*>* hitsMap = EvtMap->GetMap();
+  std::map<G4int,G4double*>::iterator itr = hitsMap->find(index);
+  if (itr == hitsMap->end()) {
+    EvtMap->add(index, time);
+  }
+  else if (time < *(itr->second)) {
+    *(itr->second) = time;
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSFirstHitTime::Initialize(G4HCofThisEvent* HCE)
+{
+  EvtMap = new G4THitsMap<G4double>(GetMultiFunctionalDetector()->GetName(), GetName());
+  if (HCID < 0) HCID = GetCollectionID(0);
+  HCE->AddHitsCollection(HCID, (G4VHitsCollection*)EvtMap);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSFirstHitTime::EndOfEvent(G4HCofThisEvent*)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSFirstHitTime::clear()
+{
+  EvtMap->clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSFirstHitTime::DrawAll()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSFirstHitTime::PrintAll()
+{
+  G4cout << " MultiFunctionalDet  " << detector->GetName() << G4endl;
+  G4cout << " PrimitiveScorer " << GetName() << G4endl;
+  G4cout << " Number of entries " << EvtMap->entries() << G4endl;
+  std::map<G4int,G4double*>::iterator itr = EvtMap->GetMap()->begin();
+  for (; itr != EvtMap->GetMap()->end(); itr++) {
+    G4cout << "  copy no.: " << itr->first
+           << "  first hit time: "
+           << G4BestUnit(*(itr->second), "Time") << G4endl;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
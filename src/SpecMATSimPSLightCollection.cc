@@ -0,0 +1,98 @@
+/// \file SpecMATSimPSLightCollection.cc
+/// \brief Implementation of the SpecMATSimPSLightCollection class
+
+#include "SpecMATSimPSLightCollection.hh"
+#include "SpecMATSimLightMap.hh"
+
+#include "G4Step.hh"
+#include "G4VTouchable.hh"
+#include "G4NavigationHistory.hh"
+#include "G4AffineTransform.hh"
+#include "G4MultiFunctionalDetector.hh"
+#include "G4HCofThisEvent.hh"
+#include "G4UnitsTable.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPSLightCollection::SpecMATSimPSLightCollection(G4String name,
+                                                         const SpecMATSimLightMap* lightMap,
+                                                         G4int depth)
+ : G4VPrimitiveScorer(name, depth),
+   fLightMap(lightMap),
+   HCID(-1),
+   EvtMap(0)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPSLightCollection::~SpecMATSimPSLightCollection()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimPSLightCollection::ProcessHits(G4Step* aStep, G4TouchableHistory*)
+{
+  G4double edep = aStep->GetTotalEnergyDeposit();
+  if (edep == 0.) return false;
+  edep *= aStep->GetPreStepPoint()->GetWeight();
+
+  // Deposit is assigned to the middle of the step, in the crystal frame
+  G4StepPoint* preStepPoint = aStep->GetPreStepPoint();
+  G4ThreeVector globalPosition = 0.5*(preStepPoint->GetPosition()
+                                      + aStep->GetPostStepPoint()->GetPosition());
+  const G4AffineTransform& toLocal
+    = preStepPoint->GetTouchable()->GetHistory()->GetTopTransform();
+  G4ThreeVector localPosition = toLocal.TransformPoint(globalPosition);
+
+  G4double light = edep*fLightMap->GetRelativeEfficiency(localPosition);
+  G4int index = GetIndex(aStep);
+  EvtMap->add(index, light);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSLightCollection::Initialize(G4HCofThisEvent* HCE)
+{
+  EvtMap = new G4THitsMap<G4double>(GetMultiFunctionalDetector()->GetName(), GetName());
+  if (HCID < 0) HCID = GetCollectionID(0);
+  HCE->AddHitsCollection(HCID, (G4VHitsCollection*)EvtMap);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSLightCollection::EndOfEvent(G4HCofThisEvent*)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSLightCollection::clear()
+{
+  EvtMap->clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSLightCollection::DrawAll()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPSLightCollection::PrintAll()
+{
+  G4cout << " MultiFunctionalDet  " << detector->GetName() << G4endl;
+  G4cout << " PrimitiveScorer " << GetName() << G4endl;
+  G4cout << " Number of entries " << EvtMap->entries() << G4endl;
+  std::map<G4int,G4double*>::iterator itr = EvtMap->GetMap()->begin();
+  for (; itr != EvtMap->GetMap()->end(); itr++) {
+    G4cout << "  copy no.: " << itr->first
+           << "  light (energy equivalent): "
+           << G4BestUnit(*(itr->second), "Energy") << G4endl;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,149 @@
+/// \file SpecMATSimPhaseSpace.cc
+/// \brief Implementation of the SpecMATSimPhaseSpace class
+
+#include "SpecMATSimPhaseSpace.hh"
+
+#include <algorithm>
+#include <cstring>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+
+namespace {
+  const char kPhaseSpaceMagic[8] = {'S','M','P','H','S','P','0','1'};
+  const size_t kPhaseSpaceHeaderSize = 32;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPhaseSpace::SpecMATSimPhaseSpace(const G4String& fileName, G4long chunkSize)
+ : fFileName(fileName),
+   fFile(-1),
+   fMap(0),
+   fMapSize(0),
+   fRecords(0),
+   fNbRecords(0),
+   fChunkSize(chunkSize > 0 ? chunkSize : 1),
+   fNext(0),
+   fPass(0)
+{
+  pthread_mutex_init(&fMutex, 0);
+
+  // Records are read in place, so the file must match the memory layout
+  const uint32_t one = 1;
+  if (sizeof(Record) != 48 || *(const char*)&one != 1) {
+    G4cerr << "Phase-space files need a little endian platform with 48 byte records" << G4endl;
+    return;
+  }
+
+  fFile = open(fileName.c_str(), O_RDONLY);
+  struct stat info;
+  if (fFile < 0 || fstat(fFile, &info) != 0 || size_t(info.st_size) < kPhaseSpaceHeaderSize) {
+    G4cerr << "Cannot read the phase-space file " << fileName << G4endl;
+    return;
+  }
+  fMapSize = info.st_size;
+  fMap = mmap(0, fMapSize, PROT_READ, MAP_SHARED, fFile, 0);
+  if (fMap == MAP_FAILED) {
+    fMap = 0;
+    G4cerr << "Cannot map the phase-space file " << fileName << G4endl;
+    return;
+  }
+
+  const char* header = static_cast<const char*>(fMap);
+  int32_t recordSize;
+  int64_t nbRecords;
+  std::memcpy(&recordSize, header + 8, sizeof(recordSize));
+  std::memcpy(&nbRecords, header + 16, sizeof(nbRecords));
+  if (std::memcmp(header, kPhaseSpaceMagic, sizeof(kPhaseSpaceMagic)) != 0
+      || recordSize != int32_t(sizeof(Record))
+      || nbRecords < 0
+      || kPhaseSpaceHeaderSize + nbRecords*sizeof(Record) > fMapSize) {
+    G4cerr << "The phase-space file " << fileName << " has a wrong header or is truncated" << G4endl;
+    return;
+  }
+  fNbRecords = nbRecords;
+  fRecords = reinterpret_cast<const Record*>(header + kPhaseSpaceHeaderSize);
+
+  // Read ahead sequentially, the first chunk right away
+  madvise(fMap, fMapSize, MADV_SEQUENTIAL);
+  Advise(0, fChunkSize, MADV_WILLNEED);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPhaseSpace::~SpecMATSimPhaseSpace()
+{
+  if (fMap) munmap(fMap, fMapSize);
+  if (fFile >= 0) close(fFile);
+  pthread_mutex_destroy(&fMutex);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4long SpecMATSimPhaseSpace::GetEventEnd(G4long begin, G4long limit) const
+{
+  G4long end = begin + 1;
+  while (end < limit && fRecords[end].event == fRecords[begin].event) end++;
+  return end;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimPhaseSpace::NextChunk(Chunk& chunk)
+{
+  if (fNbRecords == 0) return false;
+
+  pthread_mutex_lock(&fMutex);
+  if (fNext >= fNbRecords) {
+    fNext = 0;
+    fPass++;
+    G4cout << "Phase-space file " << fFileName << " exhausted, starting pass "
+           << fPass+1 << G4endl;
+  }
+  chunk.begin = fNext;
+  chunk.end = std::min(fNext + fChunkSize, fNbRecords);
+  // an event is never split between two chunks
+  if (chunk.end < fNbRecords) chunk.end = GetEventEnd(chunk.end - 1, fNbRecords);
+  chunk.pass = fPass;
+  fNext = chunk.end;
+  pthread_mutex_unlock(&fMutex);
+
+  Advise(chunk.end, chunk.end + fChunkSize, MADV_WILLNEED);
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhaseSpace::ReleaseChunk(const Chunk& chunk)
+{
+  Advise(chunk.begin, chunk.end, MADV_DONTNEED);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhaseSpace::Advise(G4long begin, G4long end, int advice)
+{
+  if (!fRecords) return;
+  begin = std::max(begin, G4long(0));
+  end = std::min(end, fNbRecords);
+  if (begin >= end) return;
+
+  // madvise works on whole pages, only pages completely inside the range are
+  // dropped, so a neighbouring chunk never loses its pages
+  size_t pageSize = sysconf(_SC_PAGESIZE);
+  size_t first = kPhaseSpaceHeaderSize + begin*sizeof(Record);
+  size_t last = kPhaseSpaceHeaderSize + end*sizeof(Record);
+  if (advice == MADV_DONTNEED) {
+    first = (first + pageSize - 1)/pageSize*pageSize;
+    last = last/pageSize*pageSize;
+  }
+  else {
+    first = first/pageSize*pageSize;
+  }
+  if (first >= last) return;
+  madvise(static_cast<char*>(fMap) + first, last - first, advice);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,160 @@
+/// \file SpecMATSimPhases.cc
+/// \brief Implementation of the SpecMATSimPhases class
+
+#include "SpecMATSimPhases.hh"
+#include "SpecMATSimUtils.hh"
+
+#include <sstream>
+#include <iomanip>
+#include <sys/time.h>
+#include <sys/resource.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPhases* SpecMATSimPhases::Instance()
+{
+  static SpecMATSimPhases instance;
+  return &instance;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPhases::SpecMATSimPhases()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhases::Start(const G4String& name)
+{
+  Phase* phase = Find(name);
+  if (!phase) {
+    Phase newPhase;
+    newPhase.name = name;
+    newPhase.calls = 0;
+    newPhase.running = false;
+    newPhase.wallTime = 0.;
+    newPhase.cpuTime = 0.;
+    newPhase.peakRSS = 0;
+    fPhases.push_back(newPhase);
+    phase = &fPhases.back();
+  }
+  if (phase->running) return;
+  phase->running = true;
+  phase->calls++;
+  phase->wallStart = WallClock();
+  phase->cpuStart = CpuClock();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhases::Stop(const G4String& name)
+{
+  Phase* phase = Find(name);
+  if (!phase || !phase->running) return;
+  phase->running = false;
+  phase->wallTime += WallClock() - phase->wallStart;
+  phase->cpuTime += CpuClock() - phase->cpuStart;
+  phase->peakRSS = SpecMATSimUtils::PeakRSS();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimPhases::GetWallTime(const G4String& name) const
+{
+  const Phase* phase = Find(name);
+  return phase ? phase->wallTime : 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4long SpecMATSimPhases::GetPeakRSS(const G4String& name) const
+{
+  const Phase* phase = Find(name);
+  return phase ? phase->peakRSS : 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhases::Print() const
+{
+  G4cout
+     << "\n--------------------Phases----------------------------------\n"
+     << std::setw(16) << std::left << " phase" << std::right
+     << std::setw(8) << "calls" << std::setw(12) << "wall [s]"
+     << std::setw(12) << "cpu [s]" << std::setw(14) << "peak RSS [MB]";
+  for (size_t i = 0; i < fPhases.size(); i++) {
+    const Phase& phase = fPhases[i];
+    G4cout << "\n " << std::setw(15) << std::left << phase.name << std::right
+           << std::setw(8) << phase.calls
+           << std::setw(12) << std::fixed << std::setprecision(3) << phase.wallTime
+           << std::setw(12) << phase.cpuTime
+           << std::setw(14) << std::setprecision(1) << phase.peakRSS/1048576.;
+    if (phase.running) G4cout << " (running)";
+  }
+  G4cout.unsetf(std::ios::fixed);
+  G4cout << std::setprecision(6)
+         << "\n------------------------------------------------------------\n"
+         << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimPhases::ToJson(G4int indent) const
+{
+  std::string pad(indent, ' ');
+  std::ostringstream json;
+  json << "[";
+  for (size_t i = 0; i < fPhases.size(); i++) {
+    const Phase& phase = fPhases[i];
+    json << (i ? "," : "") << "\n" << pad
+         << "{\"name\": \"" << SpecMATSimUtils::JsonEscape(phase.name) << "\""
+         << ", \"calls\": " << phase.calls
+         << ", \"wallTime_s\": " << phase.wallTime
+         << ", \"cpuTime_s\": " << phase.cpuTime
+         << ", \"peakRSS_bytes\": " << phase.peakRSS << "}";
+  }
+  json << "\n" << pad.substr(0, pad.size() >= 2 ? pad.size()-2 : 0) << "]";
+  return json.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimPhases::Phase* SpecMATSimPhases::Find(const G4String& name)
+{
+  for (size_t i = 0; i < fPhases.size(); i++) {
+    if (fPhases[i].name == name) return &fPhases[i];
+  }
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+const SpecMATSimPhases::Phase* SpecMATSimPhases::Find(const G4String& name) const
+{
+  for (size_t i = 0; i < fPhases.size(); i++) {
+    if (fPhases[i].name == name) return &fPhases[i];
+  }
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimPhases::WallClock()
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return now.tv_sec + 1e-6*now.tv_usec;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimPhases::CpuClock()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0.;
+  return usage.ru_utime.tv_sec + 1e-6*usage.ru_utime.tv_usec
+       + usage.ru_stime.tv_sec + 1e-6*usage.ru_stime.tv_usec;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -2,31 +2,69 @@
 /// \brief Implementation of the SpecMATSimPhysicsList class
 
 #include "SpecMATSimPhysicsList.hh"
+#include "SpecMATSimUtils.hh"
+#include "SpecMATSimPhases.hh"
 
 #include "G4DecayPhysics.hh"
 #include "G4RadioactiveDecayPhysics.hh"
 #include "G4EmStandardPhysics.hh"
+#include "G4OpticalPhysics.hh"
+
+#include "G4Material.hh"
+#include "G4Element.hh"
+#include "G4Timer.hh"
+#include "G4Version.hh"
+
+#include <cstdio>
+#include <sstream>
+#include <unistd.h>
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
-SpecMATSimPhysicsList::SpecMATSimPhysicsList() 
-: G4VModularPhysicsList(){
+SpecMATSimPhysicsList::SpecMATSimPhysicsList(G4bool opticalPhysics) 
+: G4VModularPhysicsList(),
+  fTableCacheStatus("off"),
+  fTableInitTime(0.),
+  fTableTimer(0),
+  fTableTimerStarted(false)
+{
   SetVerboseLevel(1);
 
+  // Physics tables of the first run are stored in physicsTableCacheDir and
+  // retrieved by later starts with the same physics, cuts and materials
+  physicsTableCache = "no"; //"yes"/"no"
+  physicsTableCacheDir = "physicsCache";
+
+  fTableTimer = new G4Timer;
+
   // Default physics
-  RegisterPhysics(new G4DecayPhysics());
+  RegisterNamedPhysics(new G4DecayPhysics());
 
   // Radioactive decay
-  RegisterPhysics(new G4RadioactiveDecayPhysics());
+  RegisterNamedPhysics(new G4RadioactiveDecayPhysics());
 
   // EM physics
-  RegisterPhysics(new G4EmStandardPhysics());
+  RegisterNamedPhysics(new G4EmStandardPhysics());
+
+  // Optical photons
+  if (opticalPhysics) {
+    RegisterNamedPhysics(new G4OpticalPhysics());
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 SpecMATSimPhysicsList::~SpecMATSimPhysicsList()
 { 
+  delete fTableTimer;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhysicsList::RegisterNamedPhysics(G4VPhysicsConstructor* physics)
+{
+  fComposition += " " + physics->GetPhysicsName();
+  RegisterPhysics(physics);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -34,6 +72,108 @@ SpecMATSimPhysicsList::~SpecMATSimPhysicsList()
 void SpecMATSimPhysicsList::SetCuts()
 {
   G4VUserPhysicsList::SetCuts();
+
+  // The geometry and its materials exist at this point, the tables are built
+  // or retrieved at the start of the first run
+  if (physicsTableCache != "yes") return;
+
+  fTableKey = GetTableKey();
+  fTableDir = physicsTableCacheDir + "/physics_" + SpecMATSimUtils::Hash(fTableKey);
+
+  // Only a complete directory with the same key is used, the key file is
+  // written last
+  std::string storedKey;
+  if (SpecMATSimUtils::ReadFile(fTableDir + "/key.txt", storedKey)
+      && storedKey.substr(0, storedKey.find('\n')) == fTableKey) {
+      SetPhysicsTableRetrieved(fTableDir);
+      fTableCacheStatus = "retrieved";
+  }
+  else {
+      fTableCacheStatus = "stored";
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimPhysicsList::GetTableKey() const
+{
+  std::ostringstream key;
+  key.precision(10);
+  key << "SpecMATSim physics 1 Geant4 " << G4VERSION_NUMBER
+      << " physics" << fComposition
+      << " cuts " << GetCutValue("gamma") << " " << GetCutValue("e-")
+      << " " << GetCutValue("e+") << " " << GetCutValue("proton");
+
+  // Tables are per material, so the full composition of every material counts
+  const G4MaterialTable* materials = G4Material::GetMaterialTable();
+  for (size_t i = 0; i < materials->size(); i++) {
+    const G4Material* material = (*materials)[i];
+    key << " material " << material->GetName() << " " << material->GetDensity()
+        << " " << material->GetState() << " " << material->GetTemperature()
+        << " " << material->GetPressure()
+        << " " << (material->GetMaterialPropertiesTable() ? "optical" : "-");
+    const G4double* fractions = material->GetFractionVector();
+    for (size_t j = 0; j < material->GetNumberOfElements(); j++) {
+      key << " " << material->GetElement(j)->GetName() << " " << fractions[j];
+    }
+  }
+  return key.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhysicsList::StartTableTimer()
+{
+  if (fTableTimerStarted) return;
+  fTableTimerStarted = true;
+  fTableTimer->Start();
+  SpecMATSimPhases::Instance()->Start("physicsTables");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPhysicsList::FinishTableCache()
+{
+  if (!fTableTimerStarted || fTableTimer->IsValid()) return;
+  fTableTimer->Stop();
+  SpecMATSimPhases::Instance()->Stop("physicsTables");
+  fTableInitTime = fTableTimer->GetRealElapsed();
+
+  if (fTableCacheStatus == "retrieved") {
+      if (!IsPhysicsTableRetrieved()) {
+          // Geant4 builds the tables itself when they cannot be read
+          G4cerr << "Physics tables could not be retrieved from " << fTableDir
+                 << ", they were built. Remove the directory to store them again." << G4endl;
+          fTableCacheStatus = "failed";
+          return;
+      }
+      std::string stored;
+      SpecMATSimUtils::ReadFile(fTableDir + "/key.txt", stored);
+      G4double buildTime = 0.;
+      std::istringstream(stored.substr(stored.find('\n')+1)) >> buildTime;
+      G4cout << "Physics tables retrieved from " << fTableDir << " in " << fTableInitTime
+             << " s, building them took " << buildTime << " s (saved "
+             << buildTime - fTableInitTime << " s)" << G4endl;
+  }
+  else if (fTableCacheStatus == "stored") {
+      // Stored next to the final directory and renamed, so that a
+      // concurrent start never reads a partial set of tables
+      std::ostringstream tmpDir;
+      tmpDir << fTableDir << ".tmp" << getpid();
+      std::ostringstream keyFile;
+      keyFile << fTableKey << "\n" << fTableInitTime << "\n";
+      if (!SpecMATSimUtils::MakeDirectory(physicsTableCacheDir)
+          || !SpecMATSimUtils::MakeDirectory(tmpDir.str())
+          || !StorePhysicsTable(tmpDir.str())
+          || !SpecMATSimUtils::WriteFileAtomically(tmpDir.str() + "/key.txt", keyFile.str())
+          || std::rename(tmpDir.str().c_str(), fTableDir.c_str()) != 0) {
+          G4cerr << "Cannot store the physics tables in " << fTableDir << G4endl;
+          fTableCacheStatus = "failed";
+          return;
+      }
+      G4cout << "Physics tables built in " << fTableInitTime << " s and stored in "
+             << fTableDir << G4endl;
+  }
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -3,25 +3,45 @@
 
 #include "SpecMATSimPrimaryGeneratorAction.hh"
 #include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimLightMap.hh"
+#include "SpecMATSimPhaseSpace.hh"
+#include "SpecMATSimUtils.hh"
 
 #include "G4RunManager.hh"
 #include "G4Event.hh"
+#include "G4PrimaryVertex.hh"
+#include "G4PrimaryParticle.hh"
 #include "G4ParticleGun.hh"
 #include "G4ParticleTable.hh"
 #include "G4ParticleDefinition.hh"
 #include "G4Geantino.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4Point3D.hh"
 #include "G4SystemOfUnits.hh"
 #include "Randomize.hh"
 #include <stdlib.h>
+#include <algorithm>
+#include <cmath>
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 SpecMATSimPrimaryGeneratorAction::SpecMATSimPrimaryGeneratorAction()
  : G4VUserPrimaryGeneratorAction(),
    sciCryst(0),
-   fParticleGun(0)
+   fParticleGun(0),
+   fPhaseSpace(0),
+   fPhaseSpaceEventBegin(0),
+   fPhaseSpaceEventEnd(0),
+   fPhaseSpaceUse(0),
+   fEventSeeding(false),
+   fEventSeedBase(0),
+   fFirstEvent(0)
 {
   source = "gamma";
   //source = "ion";
+  //source = "gammaGrid";
+  //source = "opticalScan";
+  //source = "phaseSpace";
+  //source = "inFlight";
 
   //################### Monoenergetic gamma source ############################//
   n_particle = 1;
@@ -29,6 +49,41 @@ SpecMATSimPrimaryGeneratorAction::SpecMATSimPrimaryGeneratorAction()
   sciCryst = new SpecMATSimDetectorConstruction();
   gammaEnergy = 1000*keV;
 
+  //################### Response matrix gamma source ##################//
+  // Gamma energy is sampled per event from a grid of responseNbSteps
+  // equidistant points between responseEMin and responseEMax
+  responseEMin = 100*keV;
+  responseEMax = 10000*keV;
+  responseNbSteps = 100;
+  responseGridIndex = -1;
+
+  //################### Light collection scan ##########################//
+  // Optical photons from one cell of the light collection map per event,
+  // needs lightCollection = "tabulate" in SpecMATSimDetectorConstruction
+  opticalScanPhotons = 1000;
+  opticalScanCell = -1;
+
+  //################### Phase-space source ############################//
+  // Particles from a phase-space file (format in SpecMATSimPhaseSpace.hh),
+  // every event of the file is used phaseSpaceRecycle times, rotated about
+  // the beam axis by a random angle if phaseSpaceRotate = "yes"
+  phaseSpaceFile = "phasespace.smphsp";
+  phaseSpaceRecycle = 1;
+  phaseSpaceRotate = "no"; //"yes"/"no"
+  fPhaseSpaceChunk.begin = 0;
+  fPhaseSpaceChunk.end = 0;
+  fPhaseSpaceChunk.pass = 0;
+
+  //################### In-flight emitter ##############################//
+  // Gammas of gammaEnergy in the rest frame of a nucleus flying from the
+  // origin with inFlightBeta along inFlightDirection. The emission angle to
+  // the direction of flight follows W = 1 + a2 P2 + a4 P4 in the rest frame,
+  // a2 = a4 = 0 is isotropic
+  inFlightBeta = 0.1;
+  inFlightDirection = G4ThreeVector(0.,0.,1.);
+  inFlightA2 = 0.;
+  inFlightA4 = 0.;
+
   //################### Isotope source ################################//
   Z = 27;
   A = 60;
@@ -43,15 +98,36 @@ SpecMATSimPrimaryGeneratorAction::~SpecMATSimPrimaryGeneratorAction()
 {
   delete fParticleGun;
   delete sciCryst;
+  delete fPhaseSpace;
 }
 
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPrimaryGeneratorAction::ResetSource()
+{
+  delete fPhaseSpace;
+  fPhaseSpace = 0;
+  fPhaseSpaceChunk.begin = 0;
+  fPhaseSpaceChunk.end = 0;
+  fPhaseSpaceChunk.pass = 0;
+  fPhaseSpaceEventBegin = 0;
+  fPhaseSpaceEventEnd = 0;
+  fPhaseSpaceUse = 0;
+}
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void SpecMATSimPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 {
+  if (fEventSeeding) {
+      long seeds[3];
+      SpecMATSimUtils::EventSeeds(fEventSeedBase, GetEventNumber(anEvent->GetEventID()), seeds);
+      seeds[2] = 0;
+      CLHEP::HepRandom::setTheSeeds(seeds);
+  }
 
-  if (source == "gamma") {
+  if (source == "gamma" || source == "gammaGrid") {
       //################### Monoenergetic gamma source ############################//
       //this function is called at the begining of event
       //
@@ -60,7 +136,15 @@ void SpecMATSimPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
       G4ParticleDefinition* particle
                = G4ParticleTable::GetParticleTable()->FindParticle("gamma");
       fParticleGun->SetParticleDefinition(particle);
-      fParticleGun->SetParticleEnergy(gammaEnergy);
+      if (source == "gammaGrid") {
+          //################### Response matrix gamma source ##################//
+          responseGridIndex = G4int(G4UniformRand()*responseNbSteps);
+          if (responseGridIndex >= responseNbSteps) responseGridIndex = responseNbSteps - 1;
+          G4double gridStep = (responseNbSteps > 1) ? (responseEMax - responseEMin)/(responseNbSteps - 1) : 0.;
+          fParticleGun->SetParticleEnergy(responseEMin + responseGridIndex*gridStep);
+      } else {
+          fParticleGun->SetParticleEnergy(gammaEnergy);
+      }
       G4double cosTheta = 2*G4UniformRand() - 1., phi = twopi*G4UniformRand();
       G4double sinTheta = std::sqrt(1. - cosTheta*cosTheta);
       G4double ux = sinTheta*std::cos(phi),
@@ -69,6 +153,47 @@ void SpecMATSimPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
       fParticleGun->SetParticleMomentumDirection(G4ThreeVector(ux,uy,uz));
       fParticleGun->SetParticlePosition(G4ThreeVector(0.*mm,0.*mm,0.*mm));
       fParticleGun->GeneratePrimaryVertex(anEvent);
+  } else if (source == "opticalScan") {
+      //################### Light collection scan ##########################//
+      const SpecMATSimDetectorConstruction* detector
+        = static_cast<const SpecMATSimDetectorConstruction*>(
+            G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+      SpecMATSimLightMap* lightMap = detector->GetLightMap();
+      G4Transform3D crystTransform;
+      if (!lightMap || !detector->GetCrystalTransform(1, crystTransform)) {
+          G4Exception("SpecMATSimPrimaryGeneratorAction::GeneratePrimaries()",
+                      "SpecMATSim002", FatalException,
+                      "The opticalScan source needs lightCollection = \"tabulate\".");
+          return;
+      }
+      // Random point inside the cell, cells are visited in turn
+      opticalScanCell = GetEventNumber(anEvent->GetEventID())%lightMap->GetNbCells();
+      G4ThreeVector cellCentre = lightMap->GetCellCentre(opticalScanCell);
+      G4ThreeVector cellHalfSize = lightMap->GetCellHalfSize();
+      G4Point3D localPosition(cellCentre.x() + (2*G4UniformRand() - 1.)*cellHalfSize.x(),
+                              cellCentre.y() + (2*G4UniformRand() - 1.)*cellHalfSize.y(),
+                              cellCentre.z() + (2*G4UniformRand() - 1.)*cellHalfSize.z());
+      G4Point3D globalPosition = crystTransform*localPosition;
+
+      fParticleGun->SetParticleDefinition(G4OpticalPhoton::OpticalPhotonDefinition());
+      fParticleGun->SetParticleEnergy(3.35*eV);
+      fParticleGun->SetParticlePosition(G4ThreeVector(globalPosition.x(), globalPosition.y(), globalPosition.z()));
+      for (G4int i = 0; i < opticalScanPhotons; i++) {
+          G4double cosTheta = 2*G4UniformRand() - 1., phi = twopi*G4UniformRand();
+          G4double sinTheta = std::sqrt(1. - cosTheta*cosTheta);
+          G4ThreeVector direction(sinTheta*std::cos(phi), sinTheta*std::sin(phi), cosTheta);
+          G4ThreeVector polarisation = direction.orthogonal().unit();
+          polarisation.rotate(twopi*G4UniformRand(), direction);
+          fParticleGun->SetParticleMomentumDirection(direction);
+          fParticleGun->SetParticlePolarization(polarisation);
+          fParticleGun->GeneratePrimaryVertex(anEvent);
+      }
+  } else if (source == "inFlight") {
+      //################### In-flight emitter ##############################//
+      GenerateInFlight(anEvent);
+  } else if (source == "phaseSpace") {
+      //################### Phase-space source ############################//
+      GeneratePhaseSpace(anEvent);
   } else {
       //################### Isotope source ################################//
       G4ParticleDefinition* ion
@@ -84,4 +209,128 @@ void SpecMATSimPrimaryGeneratorAction::GeneratePrimaries(G4Event* anEvent)
 }
 
 
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPrimaryGeneratorAction::GeneratePhaseSpace(G4Event* anEvent)
+{
+  // The file is only opened by the generator that runs events
+  if (!fPhaseSpace) {
+      fPhaseSpace = new SpecMATSimPhaseSpace(phaseSpaceFile);
+      if (!fPhaseSpace->IsOpen() || fPhaseSpace->GetNbRecords() == 0) {
+          G4Exception("SpecMATSimPrimaryGeneratorAction::GeneratePhaseSpace()",
+                      "SpecMATSim005", FatalException,
+                      ("No records in the phase-space file " + phaseSpaceFile).c_str());
+          return;
+      }
+  }
+
+  // Next event of the chunk once the current one is recycled often enough
+  if (fPhaseSpaceUse == 0 || fPhaseSpaceUse >= phaseSpaceRecycle) {
+      if (fPhaseSpaceEventEnd >= fPhaseSpaceChunk.end) {
+          if (fPhaseSpaceChunk.end > fPhaseSpaceChunk.begin) fPhaseSpace->ReleaseChunk(fPhaseSpaceChunk);
+          fPhaseSpace->NextChunk(fPhaseSpaceChunk);
+          fPhaseSpaceEventEnd = fPhaseSpaceChunk.begin;
+      }
+      fPhaseSpaceEventBegin = fPhaseSpaceEventEnd;
+      fPhaseSpaceEventEnd = fPhaseSpace->GetEventEnd(fPhaseSpaceEventBegin, fPhaseSpaceChunk.end);
+      fPhaseSpaceUse = 0;
+  }
+  fPhaseSpaceUse++;
+
+  // One rotation about the beam axis for all particles of the event
+  G4double phi = (phaseSpaceRotate == "yes") ? twopi*G4UniformRand() : 0.;
+  for (G4long i = fPhaseSpaceEventBegin; i < fPhaseSpaceEventEnd; i++) {
+      const SpecMATSimPhaseSpace::Record& record = fPhaseSpace->GetRecord(i);
+      G4ParticleDefinition* particle = GetPhaseSpaceParticle(record.pdg);
+      if (!particle) continue;
+
+      G4ThreeVector position(record.position[0]*mm, record.position[1]*mm, record.position[2]*mm);
+      G4ThreeVector direction(record.direction[0], record.direction[1], record.direction[2]);
+      if (direction.mag2() == 0.) continue;
+      position.rotateZ(phi);
+      direction.rotateZ(phi);
+
+      G4PrimaryVertex* vertex = new G4PrimaryVertex(position, record.time*ns);
+      vertex->SetWeight(record.weight);
+      G4PrimaryParticle* primary = new G4PrimaryParticle(particle);
+      primary->SetKineticEnergy(record.energy*keV);
+      primary->SetMomentumDirection(direction.unit());
+      vertex->SetPrimary(primary);
+      anEvent->AddPrimaryVertex(vertex);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ParticleDefinition* SpecMATSimPrimaryGeneratorAction::GetPhaseSpaceParticle(G4int pdg)
+{
+  std::map<G4int, G4ParticleDefinition*>::iterator it = fPhaseSpaceParticles.find(pdg);
+  if (it != fPhaseSpaceParticles.end()) return it->second;
+
+  G4ParticleDefinition* particle = 0;
+  if (pdg > 1000000000) {
+      // ions as 100ZZZAAAI, in the ground state
+      G4int ionZ = (pdg/10000)%1000;
+      G4int ionA = (pdg/10)%1000;
+      particle = G4ParticleTable::GetParticleTable()->GetIon(ionZ, ionA, 0.);
+  }
+  else {
+      particle = G4ParticleTable::GetParticleTable()->FindParticle(pdg);
+  }
+  if (!particle) {
+      G4cerr << "Phase-space particles with PDG code " << pdg << " are skipped" << G4endl;
+  }
+  // unknown codes are remembered too, so the message comes once
+  fPhaseSpaceParticles[pdg] = particle;
+  return particle;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimPrimaryGeneratorAction::GenerateInFlight(G4Event* anEvent)
+{
+  // Emission angle in the rest frame, sampled by rejection from W(cos)
+  G4double wMax = 1. + std::fabs(inFlightA2) + std::fabs(inFlightA4);
+  G4double cosRest, w;
+  do {
+      cosRest = 2*G4UniformRand() - 1.;
+      G4double x2 = cosRest*cosRest;
+      w = 1. + inFlightA2*(3*x2 - 1.)/2. + inFlightA4*(35*x2*x2 - 30*x2 + 3.)/8.;
+  } while (w < wMax*G4UniformRand());
+
+  // Boost to the laboratory: aberration of the angle and Doppler shift
+  G4double gamma = 1./std::sqrt(1. - inFlightBeta*inFlightBeta);
+  G4double cosLab = (cosRest + inFlightBeta)/(1. + inFlightBeta*cosRest);
+  G4double sinLab = std::sqrt(std::max(0., 1. - cosLab*cosLab));
+  G4double energy = gammaEnergy*gamma*(1. + inFlightBeta*cosRest);
+
+  G4ThreeVector flight = inFlightDirection.unit();
+  G4ThreeVector e1 = flight.orthogonal().unit();
+  G4ThreeVector e2 = flight.cross(e1);
+  G4double phi = twopi*G4UniformRand();
+  G4ThreeVector direction = cosLab*flight + sinLab*(std::cos(phi)*e1 + std::sin(phi)*e2);
+
+  fParticleGun->SetParticleDefinition(G4ParticleTable::GetParticleTable()->FindParticle("gamma"));
+  fParticleGun->SetParticleEnergy(energy);
+  fParticleGun->SetParticleMomentumDirection(direction);
+  fParticleGun->SetParticlePosition(G4ThreeVector(0.*mm,0.*mm,0.*mm));
+  fParticleGun->GeneratePrimaryVertex(anEvent);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimPrimaryGeneratorAction::GetEmitterBeta(void) const
+{
+  // The ion source is not corrected: its nucleus decays wherever it
+  // stopped, at rest, not at the origin with its starting velocity
+  return (source == "inFlight") ? inFlightBeta : 0.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4ThreeVector SpecMATSimPrimaryGeneratorAction::GetEmitterDirection(void) const
+{
+  return inFlightDirection.unit();
+}
+
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,71 @@
+/// \file SpecMATSimRayCaster.cc
+/// \brief Implementation of the SpecMATSimRayCaster class
+
+#include "SpecMATSimRayCaster.hh"
+
+#include "G4Navigator.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4LogicalVolume.hh"
+#include "G4Material.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimRayCaster::SpecMATSimRayCaster(G4VPhysicalVolume* world)
+ : fNavigator(new G4Navigator()),
+   fMaxSteps(100000)
+{
+  fNavigator->SetWorldVolume(world);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimRayCaster::~SpecMATSimRayCaster()
+{
+  delete fNavigator;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SpecMATSimRayCaster::Cast(const G4ThreeVector& point, const G4ThreeVector& direction,
+                                std::map<G4String, G4double>& pathLengths)
+{
+  Segments segments;
+  G4int nbSteps = Cast(point, direction, segments);
+  for (size_t i = 0; i < segments.size(); i++) {
+    pathLengths[segments[i].first->GetName()] += segments[i].second;
+  }
+  return nbSteps;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SpecMATSimRayCaster::Cast(const G4ThreeVector& point, const G4ThreeVector& direction,
+                                Segments& segments)
+{
+  segments.clear();
+  G4ThreeVector position = point;
+  G4ThreeVector unit = direction.unit();
+  G4VPhysicalVolume* volume
+    = fNavigator->LocateGlobalPointAndSetup(position, &unit, false, false);
+
+  G4int nbSteps = 0;
+  while (volume && nbSteps < fMaxSteps) {
+    G4double safety = 0.;
+    G4double step = fNavigator->ComputeStep(position, unit, kInfinity, safety);
+    if (step == kInfinity) break;
+
+    segments.push_back(std::make_pair(volume->GetLogicalVolume()->GetMaterial(), step));
+    position += step*unit;
+    nbSteps++;
+
+    fNavigator->SetGeometricallyLimitedStep();
+    volume = fNavigator->LocateGlobalPointAndSetup(position, &unit, true);
+  }
+  if (nbSteps == fMaxSteps) {
+    G4cerr << "Ray from " << point << " along " << unit
+           << " stopped after " << fMaxSteps << " steps" << G4endl;
+  }
+  return nbSteps;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
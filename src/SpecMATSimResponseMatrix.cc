@@ -0,0 +1,155 @@
+/// \file SpecMATSimResponseMatrix.cc
+/// \brief Implementation of the SpecMATSimResponseMatrix class
+
+#include "SpecMATSimResponseMatrix.hh"
+#include "SpecMATSimSparseIO.hh"
+
+#include <fstream>
+#include <cstring>
+
+namespace {
+  const char kResponseMagic[8] = {'S','M','R','E','S','P','0','1'};
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimResponseMatrix::SpecMATSimResponseMatrix(G4int nbDetectors,
+                                                   G4int nbRows,
+                                                   G4int nbColumns,
+                                                   G4double columnWidth,
+                                                   G4double eMin,
+                                                   G4double eMax)
+ : fNbDetectors(nbDetectors),
+   fNbRows(nbRows),
+   fNbColumns(nbColumns),
+   fColumnWidth(columnWidth),
+   fEMin(eMin),
+   fEMax(eMax),
+   fThrown(nbRows, 0.),
+   fRows(nbDetectors*nbRows*2)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimResponseMatrix::~SpecMATSimResponseMatrix()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4int SpecMATSimResponseMatrix::RowIndex(G4int detector, G4int row, Kind kind) const
+{
+  return ((detector-1)*fNbRows + row)*2 + kind;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimResponseMatrix::CountThrown(G4int row)
+{
+  if (row < 0 || row >= fNbRows) return;
+  fThrown[row] += 1.;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimResponseMatrix::Add(G4int index, G4double edep)
+{
+  if (edep < 0.) return;
+  G4int column = G4int(edep/fColumnWidth);
+  if (column >= fNbColumns) return;
+  fRows[index][column] += 1;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimResponseMatrix::Fill(G4int detector, G4int row,
+                                    G4double rawEdep, G4double smearedEdep)
+{
+  if (detector < 1 || detector > fNbDetectors) return;
+  if (row < 0 || row >= fNbRows) return;
+  Add(RowIndex(detector, row, kRaw), rawEdep);
+  Add(RowIndex(detector, row, kSmeared), smearedEdep);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimResponseMatrix::Write(const G4String& fileName) const
+{
+  // Encode every row first so that the offset table can precede the data
+  std::string data;
+  std::vector<unsigned long long> offsets;
+  offsets.reserve(fRows.size()+1);
+  for (size_t i = 0; i < fRows.size(); i++) {
+    offsets.push_back(data.size());
+    SpecMATSimSparseIO::AppendVarint(data, fRows[i].size());
+    G4int previous = 0;
+    std::map<G4int, G4int>::const_iterator it;
+    for (it = fRows[i].begin(); it != fRows[i].end(); it++) {
+      SpecMATSimSparseIO::AppendVarint(data, it->first - previous);
+      SpecMATSimSparseIO::AppendVarint(data, it->second);
+      previous = it->first;
+    }
+  }
+  offsets.push_back(data.size());
+
+  std::ofstream out(fileName.c_str(), std::ios::binary);
+  if (!out) {
+    G4cerr << "Cannot open response matrix file " << fileName << G4endl;
+    return;
+  }
+  SpecMATSimSparseIO::WriteRaw(out, kResponseMagic, sizeof(kResponseMagic));
+  SpecMATSimSparseIO::WriteRaw(out, &fNbDetectors, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, &fNbRows, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, &fNbColumns, sizeof(G4int));
+  SpecMATSimSparseIO::WriteRaw(out, &fColumnWidth, sizeof(G4double));
+  SpecMATSimSparseIO::WriteRaw(out, &fEMin, sizeof(G4double));
+  SpecMATSimSparseIO::WriteRaw(out, &fEMax, sizeof(G4double));
+  SpecMATSimSparseIO::WriteRaw(out, &fThrown[0], fThrown.size()*sizeof(G4double));
+  SpecMATSimSparseIO::WriteRaw(out, &offsets[0], offsets.size()*sizeof(unsigned long long));
+  SpecMATSimSparseIO::WriteRaw(out, data.data(), data.size());
+
+  G4cout << "Response matrix written to " << fileName << " ("
+         << data.size() << " bytes of row data)" << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimResponseMatrix::ReadRow(const G4String& fileName,
+                                         G4int detector, G4int row, Kind kind,
+                                         std::map<G4int, G4int>& counts)
+{
+  counts.clear();
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  if (!in) return false;
+
+  char magic[8];
+  SpecMATSimSparseIO::ReadRaw(in, magic, sizeof(magic));
+  if (std::memcmp(magic, kResponseMagic, sizeof(magic)) != 0) return false;
+
+  G4int nbDetectors, nbRows, nbColumns;
+  SpecMATSimSparseIO::ReadRaw(in, &nbDetectors, sizeof(G4int));
+  SpecMATSimSparseIO::ReadRaw(in, &nbRows, sizeof(G4int));
+  SpecMATSimSparseIO::ReadRaw(in, &nbColumns, sizeof(G4int));
+  if (detector < 1 || detector > nbDetectors || row < 0 || row >= nbRows) return false;
+
+  const std::streamoff headerSize = sizeof(magic) + 3*sizeof(G4int) + 3*sizeof(G4double)
+                                    + nbRows*sizeof(G4double);
+  const std::streamoff nbIndices = std::streamoff(nbDetectors)*nbRows*2 + 1;
+  const G4int index = ((detector-1)*nbRows + row)*2 + kind;
+
+  unsigned long long offset;
+  in.seekg(headerSize + index*sizeof(unsigned long long));
+  SpecMATSimSparseIO::ReadRaw(in, &offset, sizeof(offset));
+  in.seekg(headerSize + nbIndices*sizeof(unsigned long long) + offset);
+
+  unsigned long long nbBins = SpecMATSimSparseIO::ReadVarint(in);
+  G4int column = 0;
+  for (unsigned long long i = 0; i < nbBins && in; i++) {
+    column += G4int(SpecMATSimSparseIO::ReadVarint(in));
+    counts[column] = G4int(SpecMATSimSparseIO::ReadVarint(in));
+  }
+  return bool(in);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,212 @@
+/// \file SpecMATSimResultCache.cc
+/// \brief Implementation of the SpecMATSimResultCache class
+
+#include "SpecMATSimResultCache.hh"
+#include "SpecMATSimRunAction.hh"
+#include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimPrimaryGeneratorAction.hh"
+#include "SpecMATSimPhysicsList.hh"
+#include "SpecMATSimTrigger.hh"
+#include "SpecMATSimUtils.hh"
+
+#include "G4RunManager.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <unistd.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimResultCache::SpecMATSimResultCache(SpecMATSimRunAction* runAction,
+                                             SpecMATSimPrimaryGeneratorAction* generator,
+                                             SpecMATSimPhysicsList* physicsList)
+ : fRunAction(runAction),
+   fGenerator(generator),
+   fPhysicsList(physicsList)
+{
+  fCached.events = 0;
+  fCached.goodEvents = 0;
+  fCached.fullEnergyEvents = 0;
+  fCached.accepted = 0;
+  fCached.rejected = 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimResultCache::~SpecMATSimResultCache()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimResultCache::BeamOn(G4int nbEvents, long seedBase)
+{
+  G4RunManager* runManager = G4RunManager::GetRunManager();
+  if (!fRunAction->HasMergeableOutputs() || fRunAction->IsRolling()) {
+    G4cout << "Result cache: only runs writing one ROOT file and the summary are cached." << G4endl;
+    runManager->BeamOn(nbEvents);
+    return;
+  }
+
+  G4String fileName = fRunAction->BuildFileName();
+  G4String summaryFileName = fileName.substr(0, fileName.size()-5) + "_summary.json";
+
+  std::ostringstream keyText;
+  keyText << "SpecMATSim result 1 executable " << SpecMATSimUtils::ExecutableHash()
+          << " seedBase " << seedBase
+          << " | " << fRunAction->GetConfiguration()
+          << " | trigger " << fRunAction->GetTrigger()->GetKey()
+          << " | " << fPhysicsList->GetTableKey();
+  if (fGenerator->GetSource() == "phaseSpace") {
+    keyText << " | phaseSpace " << fGenerator->GetPhaseSpaceFile()
+            << " " << SpecMATSimUtils::FileSize(fGenerator->GetPhaseSpaceFile());
+  }
+  // A re-tabulated light collection map changes the deposits under the
+  // same file name and size, so its content goes into the key
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(runManager->GetUserDetectorConstruction());
+  if (detector->GetLightCollection() == "map") {
+    std::string lightMap;
+    keyText << " | lightMap " << detector->GetLightMapFile() << " "
+            << (SpecMATSimUtils::ReadFile(detector->GetLightMapFile(), lightMap)
+                ? SpecMATSimUtils::Hash(lightMap) : G4String("missing"));
+  }
+  G4String key = keyText.str();
+  G4String dir = fRunAction->GetResultCacheDir() + "/result_" + SpecMATSimUtils::Hash(key);
+
+  Counters stored;
+  G4bool found = ReadEntry(dir, key, stored);
+  if (found && stored.events == nbEvents
+      && SpecMATSimUtils::CopyFile(dir + "/result.root", fileName)
+      && SpecMATSimUtils::CopyFile(dir + "/summary.json", summaryFileName)) {
+    G4cout << "Result cache: " << nbEvents << " events taken from " << dir
+           << ", written to " << fileName << G4endl;
+    return;
+  }
+
+  // The same configuration with fewer events is continued where it stopped
+  G4bool extend = found && stored.events < nbEvents
+                  && fGenerator->GetSource() != "phaseSpace" && ReadRows(dir);
+  if (extend) {
+    fCached = stored;
+    G4cout << "Result cache: continuing the " << stored.events << " events of " << dir
+           << ", running " << nbEvents - stored.events << " more" << G4endl;
+  }
+  else {
+    fCached.events = 0;
+    fCached.goodEvents = 0;
+    fCached.fullEnergyEvents = 0;
+    fCached.accepted = 0;
+    fCached.rejected = 0;
+    fCachedRows.clear();
+  }
+  fRows.clear();
+
+  fGenerator->SetEventSeeding(true, seedBase, GetFirstEvent());
+  fRunAction->AttachResultCache(this);
+  runManager->BeamOn(nbEvents - GetFirstEvent());
+  fRunAction->AttachResultCache(0);
+  fGenerator->SetEventSeeding(false);
+
+  // A larger result replaces the stored one
+  if (!found || nbEvents > stored.events) {
+    Counters total = fCached;
+    total.events = nbEvents;
+    total.goodEvents += fRunAction->fGoodEvents;
+    total.fullEnergyEvents += fRunAction->GetFullEnergyEvents();
+    total.accepted += fRunAction->GetTrigger()->GetNbAccepted();
+    total.rejected += fRunAction->GetTrigger()->GetNbRejected();
+    if (Store(dir, key, total, fileName, summaryFileName)) {
+      G4cout << "Result cache: " << nbEvents << " events stored in " << dir << G4endl;
+    }
+    else {
+      G4cerr << "Cannot store the result in " << dir << G4endl;
+    }
+  }
+  fCached.events = 0;
+  fCachedRows.clear();
+  fRows.clear();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimResultCache::Record(G4int event, G4int crystal, G4double edep)
+{
+  Row row;
+  row.event = event;
+  row.crystal = crystal;
+  row.edep = edep;
+  fRows.push_back(row);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimResultCache::ReadEntry(const G4String& dir, const G4String& key,
+                                        Counters& counters) const
+{
+  // key.txt: the key, then events, triggered and full-energy events,
+  // accepted and rejected events
+  std::string entry;
+  if (!SpecMATSimUtils::ReadFile(dir + "/key.txt", entry)) return false;
+  size_t endOfKey = entry.find('\n');
+  if (endOfKey == std::string::npos || entry.substr(0, endOfKey) != key) return false;
+  std::istringstream values(entry.substr(endOfKey+1));
+  values >> counters.events >> counters.goodEvents >> counters.fullEnergyEvents
+         >> counters.accepted >> counters.rejected;
+  return !values.fail();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimResultCache::ReadRows(const G4String& dir)
+{
+  std::string rows;
+  if (!SpecMATSimUtils::ReadFile(dir + "/rows.bin", rows) || rows.size()%sizeof(Row) != 0) {
+    return false;
+  }
+  fCachedRows.resize(rows.size()/sizeof(Row));
+  if (!rows.empty()) rows.copy(reinterpret_cast<char*>(&fCachedRows[0]), rows.size());
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimResultCache::Store(const G4String& dir, const G4String& key, const Counters& counters,
+                                    const G4String& fileName, const G4String& summaryFileName) const
+{
+  // Written next to the entry and renamed, the key file of the old entry
+  // goes first so that nobody reads a mix of both
+  std::ostringstream tmpDir;
+  tmpDir << dir << ".tmp" << getpid();
+  if (!SpecMATSimUtils::MakeDirectory(fRunAction->GetResultCacheDir())
+      || !SpecMATSimUtils::MakeDirectory(tmpDir.str())) return false;
+
+  std::ofstream rows((tmpDir.str() + "/rows.bin").c_str(), std::ios::binary);
+  if (!fCachedRows.empty()) {
+    rows.write(reinterpret_cast<const char*>(&fCachedRows[0]), fCachedRows.size()*sizeof(Row));
+  }
+  if (!fRows.empty()) {
+    rows.write(reinterpret_cast<const char*>(&fRows[0]), fRows.size()*sizeof(Row));
+  }
+  rows.close();
+
+  std::ostringstream entry;
+  entry << key << "\n" << counters.events << " " << counters.goodEvents << " "
+        << counters.fullEnergyEvents << " " << counters.accepted << " " << counters.rejected << "\n";
+  if (!rows
+      || !SpecMATSimUtils::CopyFile(fileName, tmpDir.str() + "/result.root")
+      || !SpecMATSimUtils::CopyFile(summaryFileName, tmpDir.str() + "/summary.json")
+      || !SpecMATSimUtils::WriteFileAtomically(tmpDir.str() + "/key.txt", entry.str())) {
+    return false;
+  }
+
+  std::remove((dir + "/key.txt").c_str());
+  std::remove((dir + "/rows.bin").c_str());
+  std::remove((dir + "/result.root").c_str());
+  std::remove((dir + "/summary.json").c_str());
+  rmdir(dir.c_str());
+  return std::rename(tmpDir.str().c_str(), dir.c_str()) == 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
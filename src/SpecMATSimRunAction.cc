@@ -5,6 +5,18 @@
 #include "SpecMATSimPrimaryGeneratorAction.hh"
 #include "SpecMATSimAnalysis.hh"
 #include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimResponseMatrix.hh"
+#include "SpecMATSimLightMap.hh"
+#include "SpecMATSimDigitizer.hh"
+#include "SpecMATSimCoincidences.hh"
+#include "SpecMATSimSnapshot.hh"
+#include "SpecMATSimTrigger.hh"
+#include "SpecMATSimPhysicsList.hh"
+#include "SpecMATSimUtils.hh"
+#include "SpecMATSimPhases.hh"
+#include "SpecMATSimResultCache.hh"
+#include "SpecMATSimDoppler.hh"
+#include "SpecMATSimSharedHistograms.hh"
 
 #include "G4Run.hh"
 #include "G4RunManager.hh"
@@ -15,34 +27,140 @@
 #include "G4ParticleGun.hh"
 #include "G4ParticleTable.hh"
 #include "G4ParticleDefinition.hh"
+#include "G4Timer.hh"
+#include "Randomize.hh"
+
+#include <cstdio>
+#include <cstring>
+#include <fstream>
+#include <sstream>
+#include <vector>
+
+// Phases stored in the output file, in this order; "output" is still
+// running while the file is written and is only in the summary
+static const char* const phaseNames[] = { "materials", "geometry", "overlaps",
+                                          "initialize", "physicsTables", "eventLoop" };
+static const G4int nbPhaseNames = 6;
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 SpecMATSimRunAction::SpecMATSimRunAction()
  : G4UserRunAction(),
    fGoodEvents(0),
-   sciCryst(0),
-   gammaSource(0)
+   fResponseMatrix(0),
+   fDigitizer(0),
+   fCoincidences(0),
+   fSnapshot(0),
+   fTrigger(0),
+   fDoppler(0),
+   fDopplerHistoId(-1),
+   fNbCryst(0),
+   fSpectra(0),
+   fWorker(false),
+   fSpectraChecksum(0),
+   fHitsChecksum(0),
+   fNbHits(0),
+   fLastRowEvent(-1),
+   fPhysicsList(0),
+   fResultCache(0),
+   fFullEnergyEvents(0),
+   fEnvelopeSteps(0),
+   fEnvelopeStepsBeyond(0),
+   fEnvelopeCrossings(0),
+   fEnvelopeReturns(0),
+   fEnvelopeKilledSteps(0),
+   fRecordEvents(false),
+   fPhaseTimeHistoId(-1),
+   fPhaseRSSHistoId(-1),
+   fTimer(0),
+   fChildrenCPUStart(0.)
 {
-  sciCryst = new SpecMATSimDetectorConstruction();
-  gammaSource = new SpecMATSimPrimaryGeneratorAction();
+  fTimer = new G4Timer;
+
+  // Gamma-gamma coincidence matrices of events with two or more fired crystals,
+  // optionally with add-back of neighbouring crystals and by segment distance
+  ggMatrix = "no";              //"yes"/"no"
+  ggMatrixAddBack = "no";       //"yes"/"no"
+  ggMatrixAngleGroups = "no";   //"yes"/"no"
+
+  // Live snapshot of the spectra and rates, rewritten every snapshotEvery
+  // events by a background thread, 0 switches it off
+  snapshotEvery = 0;
+
+  // Result cache for the events given with -n: a run with the same
+  // configuration, seed and executable is taken from resultCacheDir, or
+  // continued from there when it had fewer events
+  resultCache = "no";             //"yes"/"no"
+  resultCacheDir = "resultCache";
+
+  // Output rolling: the ROOT file is closed and the next numbered piece
+  // opened every rollEvents events, or once the file has grown past
+  // rollBytes bytes; pieces are listed in <name>_index.json, 0 switches off
+  rollEvents = 0;
+  rollBytes = 0;
+
+  // Trigger applied to the resolution corrected crystal energies, rejected
+  // events are not written to any output
+  fTrigger = new SpecMATSimTrigger();
+  fTrigger->SetThreshold(0*keV);            // all crystals
+  //fTrigger->SetCrystalThreshold(1, 50*keV); // crystal Nb1 only
+  fTrigger->SetMultiplicity(1, 0);          // min, max fired crystals (0 - no limit)
+  //fTrigger->AddSumWindow(1100*keV, 1400*keV);
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 SpecMATSimRunAction::~SpecMATSimRunAction()
 {
-  delete sciCryst;
-  delete gammaSource;
+  delete fResponseMatrix;
+  delete fDigitizer;
+  delete fCoincidences;
+  delete fSnapshot;
+  delete fTrigger;
+  delete fDoppler;
+  delete fSpectra;
+  delete fTimer;
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
 void SpecMATSimRunAction::BeginOfRunAction(const G4Run* run)
 {
+  // the physics tables are ready now, stop their timer before anything else
+  if (fPhysicsList) fPhysicsList->FinishTableCache();
   G4cout << "### Run " << run->GetRunID() << " start." << G4endl;
 
   fGoodEvents = 0;
+  fFullEnergyEvents = 0;
+  fEnvelopeSteps = 0;
+  fEnvelopeStepsBeyond = 0;
+  fEnvelopeCrossings = 0;
+  fEnvelopeReturns = 0;
+  fEnvelopeKilledSteps = 0;
+  fTrigger->ResetCounters();
+  fWorker = false;
+  fWorkerRows.clear();
+  fSpectraChecksum = 0;
+  fHitsChecksum = 0;
+  fNbHits = 0;
+  // The registered detector, which variants and optimisation candidates
+  // rebuild with other array sizes and materials between runs
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  fNbCryst = detector->GetNbCrystals();
+  fEventRecord.assign(fRecordEvents ? run->GetNumberOfEventToBeProcessed() : 0, 0);
+  fTimer->Start();
+  fChildrenCPUStart = SpecMATSimUtils::ChildrenCPUTime();
+
+  // Full state of the engine at the start of the event loop, in the form
+  // HepRandomEngine::get() reads back
+  std::ostringstream engineState;
+  CLHEP::HepRandom::getTheEngine()->put(engineState);
+  std::istringstream words(engineState.str());
+  std::string word;
+  fRngState = "";
+  while (words >> word) fRngState += (fRngState.empty() ? "" : " ") + word;
 
   //inform the runManager to save random number seed
   G4RunManager::GetRunManager()->SetRandomNumberStore(false);
@@ -54,39 +172,192 @@ void SpecMATSimRunAction::BeginOfRunAction(const G4Run* run)
   G4cout << "Using " << analysisManager->GetType()
          << " analysis manager" << G4endl;
 
-  // Create directories
-  analysisManager->SetHistoDirectoryName("histograms");
-  analysisManager->SetNtupleDirectoryName("ntuple");
-  // Open an output file
+  G4String fileName = BuildFileName();
+  fFileName = fileName;
+
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+
+  // Response matrix: one detector per crystal plus the array sum
   //
-  crystMat = sciCryst->GetSciCrystMat();
-  crystMatName = crystMat->GetName();
-  crystSizeX = G4UIcommand::ConvertToString(sciCryst->GetSciCrystSizeX()*2);
-  crystSizeY = G4UIcommand::ConvertToString(sciCryst->GetSciCrystSizeY()*2);
-  crystSizeZ = G4UIcommand::ConvertToString(sciCryst->GetSciCrystSizeZ()*2);
+  delete fResponseMatrix;
+  fResponseMatrix = 0;
+  if (generator && generator->GetSource()=="gammaGrid") {
+      fResponseMatrix = new SpecMATSimResponseMatrix(fNbCryst+1,
+                                                     generator->GetResponseNbSteps(),
+                                                     15500, 1.,
+                                                     generator->GetResponseEMin()/keV,
+                                                     generator->GetResponseEMax()/keV);
+      fResponseFileName = fileName.substr(0, fileName.size()-5)+"_response.dat";
+  }
 
+  // Digitized signals are streamed to a text file next to the ROOT file
+  //
+  delete fDigitizer;
+  fDigitizer = 0;
+  if (detector->GetDigitizer() == "yes") {
+      fDigitizer = new SpecMATSimDigitizer(fNbCryst, fileName.substr(0, fileName.size()-5)+"_digi.txt");
+  }
 
-  G4String source =gammaSource->GetSource();
-  if (source=="gamma") {
-      particleEnergy = G4UIcommand::ConvertToString(gammaSource->GetGammaEnergy());
-      particleName = source;
-  } else if (source=="ion") {
-      G4double Z = gammaSource->GetZ();
-      G4double A = gammaSource->GetA();
-      G4double excitEnergy = gammaSource->GetExcitEnergy();
-      particleEnergy = gammaSource->GetIonEnergy();
-      particleName = G4ParticleTable::GetParticleTable()->GetIon(Z,A,excitEnergy)->GetParticleName();
-  } else {
-      particleEnergy = "unknown";
-      particleName = "unknown";
+  // Gamma-gamma matrices
+  //
+  delete fCoincidences;
+  fCoincidences = 0;
+  if (ggMatrix == "yes") {
+      fCoincidences = new SpecMATSimCoincidences(G4int(detector->GetNbSegments()),
+                                                 G4int(detector->GetNbCrystInSegmentRow()),
+                                                 G4int(detector->GetNbCrystInSegmentColumn()),
+                                                 ggMatrixAddBack == "yes",
+                                                 ggMatrixAngleGroups == "yes");
+      fCoincidenceFileName = fileName.substr(0, fileName.size()-5)+"_gg.dat";
   }
 
-  G4String NbSegments = G4UIcommand::ConvertToString(sciCryst->GetNbSegments());
-  G4String Rows = G4UIcommand::ConvertToString(sciCryst->GetNbCrystInSegmentColumn());
-  G4String Columns = G4UIcommand::ConvertToString(sciCryst->GetNbCrystInSegmentRow());
-  G4String circleR = G4UIcommand::ConvertToString(sciCryst->ComputeCircleR1());
+  // Live snapshot for long runs
+  //
+  delete fSnapshot;
+  fSnapshot = 0;
+  if (snapshotEvery > 0) {
+      fSnapshot = new SpecMATSimSnapshot(fNbCryst, fileName.substr(0, fileName.size()-5)+"_snapshot.json", snapshotEvery);
+  }
 
-  G4String fileName = crystMatName+"_"+crystSizeX+"mmx"+crystSizeY+"mmx"+crystSizeZ+"mm_"+NbSegments+"x"+Rows+"x"+Columns+"crystals_"+"R"+circleR+"mm_"+particleName+particleEnergy+"MeV"+".root";
+  // Doppler correction for emitters in flight, from the crystal placements
+  //
+  delete fDoppler;
+  fDoppler = 0;
+  if (generator->GetEmitterBeta() > 0.) {
+      fDoppler = new SpecMATSimDoppler(detector, fNbCryst, generator->GetEmitterBeta(),
+                                       generator->GetEmitterDirection(), G4ThreeVector());
+  }
+
+  // Histograms and ntuple, in the first piece of a rolled output
+  //
+  fPieces.clear();
+  fLastRowEvent = -1;
+  if (IsRolling()) {
+      Piece piece;
+      piece.fileName = GetPieceFileName(0);
+      piece.firstEvent = generator->GetFirstEvent();
+      piece.nbEvents = 0;
+      piece.rows = 0;
+      fPieces.push_back(piece);
+      OpenOutput(piece.fileName);
+  }
+  else {
+      OpenOutput(fileName);
+  }
+
+  // The spectra of the crystals, their sum and the Doppler corrected ones
+  // are counted in bins shared with the worker processes, and handed to
+  // the histograms at the end of the run
+  delete fSpectra;
+  fSpectra = new SpecMATSimSharedHistograms(fDoppler ? 2*(fNbCryst+1) : fNbCryst+1, 15501, 0., 15500*MeV);
+  if (!fSpectra->IsValid()) {
+      G4Exception("SpecMATSimRunAction::BeginOfRunAction()", "SpecMATSim008", FatalException,
+                  "Cannot allocate the spectra of the run.");
+  }
+
+  // A continued run starts with the deposits of the stored events
+  if (fResultCache) {
+      const std::vector<SpecMATSimResultCache::Row>& rows = fResultCache->GetCachedRows();
+      for (size_t i = 0; i < rows.size(); i++) {
+          if (!IsRolling()) FillSpectra(rows[i].crystal, rows[i].edep);
+          AddNtupleRow(rows[i]);
+      }
+  }
+
+  SpecMATSimPhases::Instance()->Start("eventLoop");
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::FillDeposit(G4int eventNb, G4int copyNb, G4double edep)
+{
+  // the pieces of a rolled output count the spectra of their own rows
+  if (!IsRolling()) FillSpectra(copyNb, edep);
+
+  SpecMATSimResultCache::Row row;
+  row.event = eventNb;
+  row.crystal = copyNb;
+  row.edep = edep;
+  if (fWorker) {
+      fWorkerRows.push_back(row);
+      return;
+  }
+  AddNtupleRow(row);
+  if (fResultCache) fResultCache->Record(eventNb, copyNb, edep);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::FillSpectra(G4int copyNb, G4double edep)
+{
+  // a copy number outside the array means the spectra were sized for
+  // another geometry than the one tracked
+  if (copyNb < 1 || copyNb > fNbCryst) {
+      G4ExceptionDescription msg;
+      msg << "Crystal copy number " << copyNb << " outside the "
+          << fNbCryst << " crystals of the array.";
+      G4Exception("SpecMATSimRunAction::FillSpectra()", "SpecMATSim012", FatalException, msg);
+      return;
+  }
+  fSpectra->Fill(copyNb-1, edep);
+  fSpectra->Fill(fNbCryst, edep);
+  if (fDoppler) {
+      G4double corrected = fDoppler->Correct(copyNb, edep);
+      fSpectra->Fill(fNbCryst + copyNb, corrected);
+      fSpectra->Fill(2*fNbCryst + 1, corrected);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::AddNtupleRow(const SpecMATSimResultCache::Row& row)
+{
+  // Rows come in event order; a new event beyond the range of the current
+  // piece, or past its size, starts the next piece
+  if (IsRolling()) {
+      if (row.event != fLastRowEvent) {
+          const Piece& piece = fPieces.back();
+          G4int runFirstEvent = fPieces.front().firstEvent;
+          if (rollEvents > 0 && row.event >= piece.firstEvent + rollEvents) {
+              RollOutput(runFirstEvent + rollEvents*((row.event - runFirstEvent)/rollEvents));
+          }
+          else if (rollBytes > 0 && piece.rows > 0 && SpecMATSimUtils::FileSize(piece.fileName) >= rollBytes) {
+              RollOutput(row.event);
+          }
+          fLastRowEvent = row.event;
+      }
+      FillSpectra(row.crystal, row.edep);
+      fPieces.back().rows++;
+  }
+
+  G4AnalysisManager* analysisManager = G4AnalysisManager::Instance();
+  analysisManager->FillNtupleDColumn(0, row.event);
+  analysisManager->FillNtupleDColumn(1, row.crystal);
+  analysisManager->FillNtupleDColumn(2, row.edep);
+  analysisManager->AddNtupleRow();
+
+  // Every row hashed on its own and summed: the same rows give the same
+  // checksum, and shards over disjoint events add up to the full run
+  unsigned long long edepBits;
+  std::memcpy(&edepBits, &row.edep, sizeof(edepBits));
+  unsigned long long key = ((unsigned long long)(unsigned int)row.event << 32) | (unsigned int)row.crystal;
+  fHitsChecksum += SpecMATSimUtils::Mix64(SpecMATSimUtils::Mix64(key) ^ edepBits);
+  fNbHits++;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::OpenOutput(const G4String& fileName)
+{
+  G4AnalysisManager* analysisManager = G4AnalysisManager::Instance();
+
+  // Create directories
+  analysisManager->SetHistoDirectoryName("histograms");
+  analysisManager->SetNtupleDirectoryName("ntuple");
+  // Open an output file
+  //
   analysisManager->OpenFile(fileName);
   analysisManager->SetFirstHistoId(1);
 
@@ -94,11 +365,32 @@ void SpecMATSimRunAction::BeginOfRunAction(const G4Run* run)
   //
 
   G4int crystNb;
-  for(crystNb = 1; crystNb <= (sciCryst->GetNbCrystInSegmentRow())*(sciCryst->GetNbCrystInSegmentColumn())*(sciCryst->GetNbSegments()); crystNb++) {
+  for(crystNb = 1; crystNb <= fNbCryst; crystNb++) {
 
   analysisManager->CreateH1(G4UIcommand::ConvertToString(crystNb),"Edep in crystal Nb" + G4UIcommand::ConvertToString(crystNb), 15501, 0., 15500*MeV);
   }
   analysisManager->CreateH1("Total","Total Edep", 15501, 0., 15500*MeV);
+
+  // Provenance: configuration, engine state and the phase list in the title,
+  // wall time [s] and peak memory [MB] of phase i in bin i
+  G4String config = GetConfiguration();
+  G4String provenance = "SpecMATSim configHash " + SpecMATSimUtils::Hash(config)
+                      + " | rng " + fRngState + " | phases";
+  for (G4int i = 0; i < nbPhaseNames; i++) provenance += G4String(" ") + phaseNames[i];
+  provenance += " | configuration " + config;
+  fPhaseTimeHistoId = analysisManager->CreateH1("PhaseTime", provenance, nbPhaseNames, 0., nbPhaseNames);
+  fPhaseRSSHistoId = analysisManager->CreateH1("PhasePeakRSS", "Peak RSS [MB] at the end of each phase",
+                                               nbPhaseNames, 0., nbPhaseNames);
+  // Doppler corrected spectra, after the others to keep their ids
+  if (fDoppler) {
+      for (crystNb = 1; crystNb <= fNbCryst; crystNb++) {
+          G4int id = analysisManager->CreateH1("Doppler" + G4UIcommand::ConvertToString(crystNb),
+                                               "Doppler corrected Edep in crystal Nb" + G4UIcommand::ConvertToString(crystNb),
+                                               15501, 0., 15500*MeV);
+          if (crystNb == 1) fDopplerHistoId = id;
+      }
+      analysisManager->CreateH1("DopplerTotal", "Doppler corrected total Edep", 15501, 0., 15500*MeV);
+  }
   // Creating ntuple
   //
   analysisManager->CreateNtuple("Total", "Total Edep");
@@ -110,8 +402,227 @@ void SpecMATSimRunAction::BeginOfRunAction(const G4Run* run)
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
 
+void SpecMATSimRunAction::CloseOutput()
+{
+  SpecMATSimPhases* phases = SpecMATSimPhases::Instance();
+  G4AnalysisManager* analysisManager = G4AnalysisManager::Instance();
+  fSpectraChecksum += fSpectra->Checksum();
+  for (G4int i = 0; i < fSpectra->GetNbHistos(); i++) {
+    fSpectra->Write(i, (i <= fNbCryst) ? i+1 : fDopplerHistoId + i-(fNbCryst+1));
+  }
+  fSpectra->Reset();
+  for (G4int i = 0; i < nbPhaseNames; i++) {
+    analysisManager->FillH1(fPhaseTimeHistoId, i+0.5, phases->GetWallTime(phaseNames[i]));
+    analysisManager->FillH1(fPhaseRSSHistoId, i+0.5, phases->GetPeakRSS(phaseNames[i])/1048576.);
+  }
+  // Event range of a piece of a rolled output, known once it is closed:
+  // first event in bin 1, number of events in bin 2, both also in the title
+  if (IsRolling()) {
+    const Piece& piece = fPieces.back();
+    G4int id = analysisManager->CreateH1("EventRange",
+                                         "Events " + G4UIcommand::ConvertToString(piece.firstEvent)
+                                         + " to " + G4UIcommand::ConvertToString(piece.firstEvent + piece.nbEvents - 1)
+                                         + " of the run, piece " + G4UIcommand::ConvertToString(G4int(fPieces.size())-1),
+                                         2, 0., 2.);
+    analysisManager->FillH1(id, 0.5, piece.firstEvent);
+    analysisManager->FillH1(id, 1.5, piece.nbEvents);
+  }
+  analysisManager->Write();
+  analysisManager->CloseFile();
+
+  // the next file books everything again
+  delete G4AnalysisManager::Instance();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::RollOutput(G4int nextFirstEvent)
+{
+  Piece& current = fPieces.back();
+  current.nbEvents = nextFirstEvent - current.firstEvent;
+  CloseOutput();
+  WriteIndex(G4RunManager::GetRunManager()->GetCurrentRun());
+
+  Piece piece;
+  piece.fileName = GetPieceFileName(G4int(fPieces.size()));
+  piece.firstEvent = nextFirstEvent;
+  piece.nbEvents = 0;
+  piece.rows = 0;
+  fPieces.push_back(piece);
+  OpenOutput(piece.fileName);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimRunAction::GetPieceFileName(G4int piece) const
+{
+  char number[16];
+  std::sprintf(number, "_part%04d", piece);
+  return fFileName.substr(0, fFileName.size()-5) + number + ".root";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::WriteIndex(const G4Run* run) const
+{
+  // The closed pieces, rewritten after every piece so that the index of an
+  // unfinished job lists what can already be read
+  std::ostringstream index;
+  index << "{\n"
+        << "  \"program\": \"SpecMATSim\",\n"
+        << "  \"runID\": " << (run ? run->GetRunID() : -1) << ",\n"
+        << "  \"configHash\": \"" << SpecMATSimUtils::Hash(GetConfiguration()) << "\",\n"
+        << "  \"rollEvents\": " << rollEvents << ",\n"
+        << "  \"rollBytes\": " << rollBytes << ",\n"
+        << "  \"pieces\": [";
+  G4bool first = true;
+  for (size_t i = 0; i < fPieces.size(); i++) {
+    const Piece& piece = fPieces[i];
+    if (piece.nbEvents == 0 && piece.rows == 0) continue;
+    index << (first ? "" : ",") << "\n    {\"file\": \"" << SpecMATSimUtils::JsonEscape(piece.fileName)
+          << "\", \"firstEvent\": " << piece.firstEvent << ", \"events\": " << piece.nbEvents
+          << ", \"rows\": " << piece.rows << ", \"bytes\": " << SpecMATSimUtils::FileSize(piece.fileName) << "}";
+    first = false;
+  }
+  index << "\n  ]\n}\n";
+
+  G4String indexFileName = fFileName.substr(0, fFileName.size()-5) + "_index.json";
+  if (!SpecMATSimUtils::WriteFileAtomically(indexFileName, index.str())) {
+    G4cerr << "Cannot write the output index " << indexFileName << G4endl;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimRunAction::CanRunWorkers() const
+{
+  // phase-space files are read in sequence, and the event record is per process
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+  return HasMergeableOutputs() && !fRecordEvents && generator->GetSource() != "phaseSpace";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimRunAction::WriteWorker(const G4String& fileName) const
+{
+  // The counters of the worker, then its ntuple rows
+  G4long counters[11];
+  counters[0] = fGoodEvents;
+  counters[1] = fFullEnergyEvents;
+  fTrigger->GetCounters(&counters[2]);
+  counters[6] = fEnvelopeSteps;
+  counters[7] = fEnvelopeStepsBeyond;
+  counters[8] = fEnvelopeCrossings;
+  counters[9] = fEnvelopeReturns;
+  counters[10] = fEnvelopeKilledSteps;
+
+  std::ofstream file(fileName.c_str(), std::ios::binary);
+  file.write(reinterpret_cast<const char*>(counters), sizeof(counters));
+  if (!fWorkerRows.empty()) {
+      file.write(reinterpret_cast<const char*>(&fWorkerRows[0]),
+                 fWorkerRows.size()*sizeof(SpecMATSimResultCache::Row));
+  }
+  file.close();
+  return !file.fail();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimRunAction::MergeWorker(const G4String& fileName)
+{
+  std::string data;
+  G4long counters[11];
+  if (!SpecMATSimUtils::ReadFile(fileName, data) || data.size() < sizeof(counters)
+      || (data.size() - sizeof(counters))%sizeof(SpecMATSimResultCache::Row) != 0) {
+      return false;
+  }
+  data.copy(reinterpret_cast<char*>(counters), sizeof(counters));
+  fGoodEvents += counters[0];
+  fFullEnergyEvents += counters[1];
+  fTrigger->AddCounters(&counters[2]);
+  fEnvelopeSteps += counters[6];
+  fEnvelopeStepsBeyond += counters[7];
+  fEnvelopeCrossings += counters[8];
+  fEnvelopeReturns += counters[9];
+  fEnvelopeKilledSteps += counters[10];
+
+  // the spectra are already filled by the worker
+  std::vector<SpecMATSimResultCache::Row> rows((data.size() - sizeof(counters))/sizeof(SpecMATSimResultCache::Row));
+  if (!rows.empty()) data.copy(reinterpret_cast<char*>(&rows[0]), data.size() - sizeof(counters), sizeof(counters));
+  for (size_t i = 0; i < rows.size(); i++) {
+      AddNtupleRow(rows[i]);
+      if (fResultCache) fResultCache->Record(rows[i].event, rows[i].crystal, rows[i].edep);
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimRunAction::BuildFileName()
+{
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  crystMat = detector->GetSciCrystMat();
+  crystMatName = crystMat->GetName();
+  crystSizeX = G4UIcommand::ConvertToString(detector->GetSciCrystSizeX()*2);
+  crystSizeY = G4UIcommand::ConvertToString(detector->GetSciCrystSizeY()*2);
+  crystSizeZ = G4UIcommand::ConvertToString(detector->GetSciCrystSizeZ()*2);
+
+
+  // the source can be changed on the command line and the gamma energy by
+  // an optimisation, only the registered generator knows
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+  G4String source = generator->GetSource();
+  if (source=="gamma") {
+      particleEnergy = G4UIcommand::ConvertToString(generator->GetGammaEnergy());
+      particleName = source;
+  } else if (source=="gammaGrid") {
+      particleEnergy = G4UIcommand::ConvertToString(generator->GetResponseEMin())+"-"+G4UIcommand::ConvertToString(generator->GetResponseEMax());
+      particleName = source;
+  } else if (source=="ion") {
+      G4double Z = generator->GetZ();
+      G4double A = generator->GetA();
+      G4double excitEnergy = generator->GetExcitEnergy();
+      particleEnergy = generator->GetIonEnergy();
+      particleName = G4ParticleTable::GetParticleTable()->GetIon(Z,A,excitEnergy)->GetParticleName();
+  } else if (source=="inFlight") {
+      particleEnergy = G4UIcommand::ConvertToString(generator->GetGammaEnergy());
+      particleName = "inFlightBeta"+G4UIcommand::ConvertToString(generator->GetInFlightBeta())+"_gamma";
+  } else if (source=="phaseSpace") {
+      // named after the file, without directory and extension
+      G4String file = generator->GetPhaseSpaceFile();
+      file = file.substr(file.find_last_of('/')+1);
+      particleEnergy = "";
+      particleName = "phaseSpace_"+file.substr(0, file.find_last_of('.'));
+  } else {
+      particleEnergy = "unknown";
+      particleName = "unknown";
+  }
+
+  G4String NbSegments = G4UIcommand::ConvertToString(detector->GetNbSegments());
+  G4String Rows = G4UIcommand::ConvertToString(detector->GetNbCrystInSegmentColumn());
+  G4String Columns = G4UIcommand::ConvertToString(detector->GetNbCrystInSegmentRow());
+  G4String circleR = G4UIcommand::ConvertToString(detector->GetCircleR1());
+
+  G4String fileName = crystMatName+"_"+crystSizeX+"mmx"+crystSizeY+"mmx"+crystSizeZ+"mm_"+NbSegments+"x"+Rows+"x"+Columns+"crystals_"+"R"+circleR+"mm_"+particleName+particleEnergy+"MeV"+".root";
+  if (fOutputName != "") {
+      fileName = fOutputName+".root";
+  }
+  return fileName;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
 void SpecMATSimRunAction::EndOfRunAction(const G4Run* aRun)
 {
+  SpecMATSimPhases* phases = SpecMATSimPhases::Instance();
+  phases->Stop("eventLoop");
+
   G4int NbOfEvents = aRun->GetNumberOfEvent();
   if (NbOfEvents == 0) return;
 
@@ -126,13 +637,58 @@ void SpecMATSimRunAction::EndOfRunAction(const G4Run* aRun)
 
   // save histograms
   //
-  G4AnalysisManager* analysisManager = G4AnalysisManager::Instance();
-  analysisManager->Write();
-  analysisManager->CloseFile();
+  phases->Start("output");
+  if (IsRolling()) {
+      // the last piece ends after the last event of the run
+      Piece& piece = fPieces.back();
+      piece.nbEvents = kinematic->GetEventNumber(NbOfEvents-1) + 1 - piece.firstEvent;
+  }
+  CloseOutput();
+  if (IsRolling()) WriteIndex(aRun);
+  delete fSpectra;
+  fSpectra = 0;
+
+  if (fResponseMatrix) {
+      fResponseMatrix->Write(fResponseFileName);
+      delete fResponseMatrix;
+      fResponseMatrix = 0;
+  }
+
+  if (fCoincidences) {
+      fCoincidences->Write(fCoincidenceFileName);
+      delete fCoincidences;
+      fCoincidences = 0;
+  }
+
+  fTrigger->PrintCounters();
+
+  if (fSnapshot) {
+      fSnapshot->Finish();
+      delete fSnapshot;
+      fSnapshot = 0;
+  }
+
+  if (fDigitizer) {
+      fDigitizer->Finish();
+      delete fDigitizer;
+      fDigitizer = 0;
+  }
 
-  // complete cleanup
+  // light collection map of the tabulation run
   //
-  delete G4AnalysisManager::Instance();
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  if (detector->GetLightCollection() == "tabulate" && detector->GetLightMap()) {
+      detector->GetLightMap()->Write(detector->GetLightMapFile());
+  }
+
+  phases->Stop("output");
+
+  fTimer->Stop();
+  WriteSummary(aRun);
+  if (detector->GetEnvelope() != "off") PrintEnvelope(detector->GetEnvelope());
+  phases->Print();
 
   //print
   //
@@ -144,3 +700,191 @@ void SpecMATSimRunAction::EndOfRunAction(const G4Run* aRun)
 }
 
 //....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimRunAction::GetConfiguration() const
+{
+  // Every setting that changes the physics result, but not the output names
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+
+  std::ostringstream config;
+  config << detector->GetGeometryKey()
+         << " source " << generator->GetSource() << " " << particleName << " " << particleEnergy
+         << " emitter " << generator->GetEmitterBeta() << " " << generator->GetEmitterDirection()
+         << " " << generator->GetInFlightA2() << " " << generator->GetInFlightA4()
+         << " lightCollection " << detector->GetLightCollection()
+         << " digitizer " << detector->GetDigitizer()
+         << " envelope " << detector->GetEnvelope()
+         << " ggMatrix " << ggMatrix << " " << ggMatrixAddBack << " " << ggMatrixAngleGroups;
+  // events reseeded from their number leave the last event seed in the engine
+  if (generator->GetEventSeeding()) {
+      config << " eventSeeds " << generator->GetEventSeedBase();
+  }
+  else {
+      config << " seed " << CLHEP::HepRandom::getTheSeed();
+  }
+  return config.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimRunAction::HasMergeableOutputs() const
+{
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+  return generator->GetSource() != "gammaGrid" && generator->GetSource() != "opticalScan"
+      && detector->GetLightCollection() != "tabulate" && detector->GetDigitizer() != "yes"
+      && ggMatrix != "yes" && snapshotEvery == 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::WriteSummary(const G4Run* run)
+{
+  // Machine readable summary of the run for job schedulers, written next to
+  // the ROOT file. The configuration hash identifies the physics result.
+  const SpecMATSimDetectorConstruction* detector
+    = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(
+        G4RunManager::GetRunManager()->GetUserPrimaryGeneratorAction());
+
+  G4String config = GetConfiguration();
+
+  G4String base = fFileName.substr(0, fFileName.size()-5);
+  std::vector<G4String> outputs;
+  if (IsRolling()) {
+      for (size_t i = 0; i < fPieces.size(); i++) outputs.push_back(fPieces[i].fileName);
+      outputs.push_back(base+"_index.json");
+  }
+  else {
+      outputs.push_back(fFileName);
+  }
+  if (generator->GetSource() == "gammaGrid") outputs.push_back(fResponseFileName);
+  if (detector->GetDigitizer() == "yes") outputs.push_back(base+"_digi.txt");
+  if (ggMatrix == "yes") outputs.push_back(fCoincidenceFileName);
+  if (snapshotEvery > 0) outputs.push_back(base+"_snapshot.json");
+  if (detector->GetLightCollection() == "tabulate") outputs.push_back(detector->GetLightMapFile());
+
+  // a continued run reports the stored events too
+  G4long cachedEvents = 0, cachedGood = 0, cachedFullEnergy = 0, cachedAccepted = 0, cachedRejected = 0;
+  if (fResultCache) {
+      const SpecMATSimResultCache::Counters& cached = fResultCache->GetCachedCounters();
+      cachedEvents = cached.events;
+      cachedGood = cached.goodEvents;
+      cachedFullEnergy = cached.fullEnergyEvents;
+      cachedAccepted = cached.accepted;
+      cachedRejected = cached.rejected;
+  }
+  G4int nbRunEvents = run->GetNumberOfEvent();
+  G4long nbEvents = nbRunEvents + cachedEvents;
+  G4long goodEvents = fGoodEvents + cachedGood;
+  G4long fullEnergyEvents = fFullEnergyEvents + cachedFullEnergy;
+  G4double wallTime = fTimer->GetRealElapsed();
+  // The worker processes of the run are reaped by now; their CPU time is
+  // added to the one of this process
+  G4double cpuTime = fTimer->GetUserElapsed() + fTimer->GetSystemElapsed()
+                     + SpecMATSimUtils::ChildrenCPUTime() - fChildrenCPUStart;
+
+  // The checksums identify the content of the spectra and the ntuple, the
+  // ROOT file itself carries its time of writing
+  char spectraChecksum[17], hitsChecksum[17];
+  std::sprintf(spectraChecksum, "%016llx", fSpectraChecksum);
+  std::sprintf(hitsChecksum, "%016llx", fHitsChecksum);
+
+  G4String summaryFileName = base+"_summary.json";
+  std::ofstream summary(summaryFileName.c_str());
+  summary << "{\n"
+          << "  \"program\": \"SpecMATSim\",\n"
+          << "  \"runID\": " << run->GetRunID() << ",\n"
+          << "  \"configHash\": \"" << SpecMATSimUtils::Hash(config) << "\",\n"
+          << "  \"configuration\": \"" << SpecMATSimUtils::JsonEscape(config) << "\",\n"
+          << "  \"rngState\": \"" << SpecMATSimUtils::JsonEscape(fRngState) << "\",\n"
+          << "  \"events\": " << nbEvents << ",\n"
+          << "  \"wallTime_s\": " << wallTime << ",\n"
+          << "  \"cpuTime_s\": " << cpuTime << ",\n"
+          << "  \"cachedEvents\": " << cachedEvents << ",\n"
+          << "  \"firstEvent\": " << (generator->GetFirstEvent() - cachedEvents) << ",\n"
+          << "  \"eventsPerSecond\": " << (wallTime > 0. ? nbRunEvents/wallTime : 0.) << ",\n"
+          << "  \"peakRSS_bytes\": " << SpecMATSimUtils::PeakRSS() << ",\n"
+          << "  \"workerPeakRSS_bytes\": " << SpecMATSimUtils::ChildrenPeakRSS() << ",\n"
+          << "  \"outputs\": [";
+  for (size_t i = 0; i < outputs.size(); i++) {
+    summary << (i ? "," : "") << "\n    {\"file\": \"" << SpecMATSimUtils::JsonEscape(outputs[i])
+            << "\", \"bytes\": " << SpecMATSimUtils::FileSize(outputs[i]) << "}";
+  }
+  summary << "\n  ],\n"
+          << "  \"trigger\": {\"accepted\": " << fTrigger->GetNbAccepted() + cachedAccepted
+          << ", \"rejected\": " << fTrigger->GetNbRejected() + cachedRejected << "},\n"
+          << "  \"physicsTables\": {\"cache\": \""
+          << (fPhysicsList ? fPhysicsList->GetTableCacheStatus() : G4String("off"))
+          << "\", \"initTime_s\": " << (fPhysicsList ? fPhysicsList->GetTableInitTime() : 0.) << "},\n"
+          << "  \"envelope\": {\"policy\": \"" << detector->GetEnvelope()
+          << "\", \"steps\": " << fEnvelopeSteps << ", \"stepsBeyond\": " << fEnvelopeStepsBeyond
+          << ", \"crossings\": " << fEnvelopeCrossings << ", \"returns\": " << fEnvelopeReturns
+          << ", \"killedSteps\": " << fEnvelopeKilledSteps << "},\n"
+          << "  \"phases\": " << SpecMATSimPhases::Instance()->ToJson(4) << ",\n"
+          << "  \"results\": {\"eventSeeds\": " << (generator->GetEventSeeding() ? "true" : "false")
+          << ", \"seedBase\": " << (generator->GetEventSeeding() ? generator->GetEventSeedBase() : 0L)
+          << ", \"crystals\": " << fNbCryst
+          << ", \"hits\": " << fNbHits << ", \"hitsChecksum\": \"" << hitsChecksum
+          << "\", \"spectraChecksum\": \"" << spectraChecksum << "\"},\n"
+          << "  \"efficiency\": {\n"
+          << "    \"triggeredEvents\": " << goodEvents << ",\n"
+          << "    \"detection\": " << G4double(goodEvents)/nbEvents << ",\n"
+          << "    \"fullEnergyEvents\": " << fullEnergyEvents << ",\n"
+          << "    \"fullEnergy\": " << G4double(fullEnergyEvents)/nbEvents << "\n"
+          << "  }\n"
+          << "}\n";
+  summary.close();
+
+  G4cout << "Run summary written to " << summaryFileName << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunAction::PrintEnvelope(const G4String& policy) const
+{
+  G4double wallTime = fTimer->GetRealElapsed();
+  G4cout
+     << "\n--------------------Tracking envelope-----------------------\n"
+     << " Policy: " << policy << "\n"
+     << " Steps: " << fEnvelopeSteps << ", outward crossings: " << fEnvelopeCrossings;
+  if (policy == "kill") {
+    // Every crossing is a killed track and none of their steps beyond were
+    // taken, so the saving itself is not measured here. The share of the
+    // steps spent on the killed tracks before the shell shows how much of
+    // the run went into escaping particles; the saving is the difference in
+    // time to an envelope = "tally" run of the same events.
+    G4cout << " (killed)\n"
+           << " Steps of the killed tracks inside the envelope: " << fEnvelopeKilledSteps;
+    if (fEnvelopeSteps > 0) {
+      G4double fraction = G4double(fEnvelopeKilledSteps)/fEnvelopeSteps;
+      G4cout << " (" << 100.*fraction << " %, about " << fraction*wallTime << " s of "
+             << wallTime << " s)";
+    }
+  }
+  else {
+    G4cout << ", returns: " << fEnvelopeReturns << "\n"
+           << " Steps beyond the envelope: " << fEnvelopeStepsBeyond;
+    if (fEnvelopeSteps > 0) {
+      G4double fraction = G4double(fEnvelopeStepsBeyond)/fEnvelopeSteps;
+      G4cout << " (" << 100.*fraction << " %)\n"
+             << " Killing would save about " << fraction*wallTime << " s of "
+             << wallTime << " s";
+    }
+  }
+  G4cout << "\n------------------------------------------------------------\n"
+         << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
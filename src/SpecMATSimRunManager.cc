@@ -0,0 +1,135 @@
+/// \file SpecMATSimRunManager.cc
+/// \brief Implementation of the SpecMATSimRunManager class
+
+#include "SpecMATSimRunManager.hh"
+#include "SpecMATSimRunAction.hh"
+#include "SpecMATSimPrimaryGeneratorAction.hh"
+#include "SpecMATSimPhysicsList.hh"
+
+#include "G4Event.hh"
+#include "G4Run.hh"
+#include "G4EventManager.hh"
+#include "G4UIcommand.hh"
+
+#include <algorithm>
+#include <cstdio>
+#include <vector>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/wait.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimRunManager::SpecMATSimRunManager()
+ : G4RunManager(),
+   fNbWorkers(1)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimRunManager::~SpecMATSimRunManager()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunManager::RunInitialization()
+{
+  // The kernel builds or retrieves the physics tables in the run
+  // initialisation, and the run action stops the timer as it begins:
+  // Initialize(), the visualisation and the macro before the run are not
+  // counted as table time
+  SpecMATSimPhysicsList* list = dynamic_cast<SpecMATSimPhysicsList*>(physicsList);
+  if (list) list->StartTableTimer();
+  G4RunManager::RunInitialization();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunManager::DoEventLoop(G4int n_event, const char* macroFile, G4int n_select)
+{
+  SpecMATSimRunAction* runAction = static_cast<SpecMATSimRunAction*>(userRunAction);
+  const SpecMATSimPrimaryGeneratorAction* generator
+    = static_cast<const SpecMATSimPrimaryGeneratorAction*>(userPrimaryGeneratorAction);
+  G4int nbWorkers = std::min(fNbWorkers, n_event);
+  if (nbWorkers <= 1 || !runAction || !generator) {
+      G4RunManager::DoEventLoop(n_event, macroFile, n_select);
+      return;
+  }
+  if (!generator->GetEventSeeding() || !runAction->CanRunWorkers()) {
+      G4cout << "This run cannot be shared by worker processes, running it in one." << G4endl;
+      G4RunManager::DoEventLoop(n_event, macroFile, n_select);
+      return;
+  }
+
+  // Nothing buffered may be written twice by the children
+  G4cout << "Running " << n_event << " events in " << nbWorkers << " worker processes" << G4endl;
+  std::fflush(0);
+
+  G4String base = runAction->GetFileName();
+  base = base.substr(0, base.size()-5) + "_worker";
+  std::vector<pid_t> workers(nbWorkers, -1);
+  std::vector<G4String> fileNames(nbWorkers);
+  for (G4int i = 0; i < nbWorkers; i++) {
+      fileNames[i] = base + G4UIcommand::ConvertToString(i) + ".tmp";
+      G4int firstEvent = G4int(G4long(n_event)*i/nbWorkers);
+      G4int lastEvent = G4int(G4long(n_event)*(i+1)/nbWorkers);
+      workers[i] = fork();
+      if (workers[i] == 0) {
+          RunWorker(firstEvent, lastEvent, fileNames[i]);
+      }
+  }
+
+  // Workers are merged in order, a failed worker ends the job
+  G4bool ok = true;
+  for (G4int i = 0; i < nbWorkers; i++) {
+      G4int status = 0;
+      if (workers[i] < 0 || waitpid(workers[i], &status, 0) != workers[i]
+          || !WIFEXITED(status) || WEXITSTATUS(status) != 0) {
+          ok = false;
+      }
+  }
+  for (G4int i = 0; i < nbWorkers && ok; i++) {
+      ok = runAction->MergeWorker(fileNames[i]);
+  }
+  for (G4int i = 0; i < nbWorkers; i++) {
+      std::remove(fileNames[i].c_str());
+  }
+  if (!ok) {
+      G4Exception("SpecMATSimRunManager::DoEventLoop()", "SpecMATSim009", FatalException,
+                  "A worker process failed.");
+      return;
+  }
+
+  // The events were processed by the workers, the run only counts them
+  for (G4int i = 0; i < n_event; i++) {
+      G4Event event(i);
+      currentRun->RecordEvent(&event);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimRunManager::RunWorker(G4int firstEvent, G4int lastEvent, const G4String& fileName)
+{
+  // The same steps as the sequential loop, for the range of the worker;
+  // the child leaves with _exit, so that the files of the main process are
+  // not flushed or closed twice
+  SpecMATSimRunAction* runAction = static_cast<SpecMATSimRunAction*>(userRunAction);
+  runAction->StartWorker();
+  for (G4int i = firstEvent; i < lastEvent; i++) {
+      currentEvent = GenerateEvent(i);
+      eventManager->ProcessOneEvent(currentEvent);
+      AnalyzeEvent(currentEvent);
+      UpdateScoring();
+      StackPreviousEvent(currentEvent);
+      currentEvent = 0;
+      if (runAborted) break;
+  }
+  G4bool ok = runAction->WriteWorker(fileName);
+  std::fflush(0);
+  _exit(ok ? 0 : 1);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
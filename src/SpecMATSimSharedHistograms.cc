@@ -0,0 +1,76 @@
+/// \file SpecMATSimSharedHistograms.cc
+/// \brief Implementation of the SpecMATSimSharedHistograms class
+
+#include "SpecMATSimSharedHistograms.hh"
+#include "SpecMATSimAnalysis.hh"
+#include "SpecMATSimUtils.hh"
+
+#include <cstring>
+#include <sys/mman.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimSharedHistograms::SpecMATSimSharedHistograms(G4int nbHistos, G4int nbBins,
+                                                       G4double xMin, G4double xMax)
+ : fNbHistos(nbHistos),
+   fNbBins(nbBins),
+   fXMin(xMin),
+   fXMax(xMax),
+   fBinWidth((xMax - xMin)/nbBins),
+   fSize(size_t(nbHistos)*(nbBins+2)*sizeof(unsigned long long)),
+   fCounts(0)
+{
+  // anonymous pages are zero filled, and only touched bins take memory
+  void* map = mmap(0, fSize, PROT_READ | PROT_WRITE, MAP_SHARED | MAP_ANONYMOUS, -1, 0);
+  if (map == MAP_FAILED) {
+      G4cerr << "Cannot map " << fSize << " bytes for the shared spectra" << G4endl;
+      return;
+  }
+  fCounts = static_cast<unsigned long long*>(map);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimSharedHistograms::~SpecMATSimSharedHistograms()
+{
+  if (fCounts) munmap(fCounts, fSize);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSharedHistograms::Write(G4int histo, G4int h1Id) const
+{
+  tools::histo::h1d* h1 = G4AnalysisManager::Instance()->GetH1(h1Id);
+  if (!h1) return;
+  const unsigned long long* counts = &fCounts[histo*(fNbBins+2)];
+  for (G4int bin = 0; bin <= fNbBins+1; bin++) {
+      if (counts[bin] == 0) continue;
+      // The bins are set as if filled count times with weight 1 at the
+      // centre, under- and overflow half a bin outside the range: the
+      // entries and Sw2 stay the count, so the bin error is sqrt(count)
+      G4double x = fXMin + (bin - 0.5)*fBinWidth;
+      G4double n = G4double(counts[bin]);
+      h1->set_bin_content(bin, (unsigned int)counts[bin], n, n, n*x, n*x*x);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+unsigned long long SpecMATSimSharedHistograms::Checksum() const
+{
+  unsigned long long checksum = 0;
+  size_t nbCounts = size_t(fNbHistos)*(fNbBins+2);
+  for (size_t i = 0; i < nbCounts; i++) {
+      if (fCounts[i]) checksum += fCounts[i]*SpecMATSimUtils::Mix64(i);
+  }
+  return checksum;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSharedHistograms::Reset()
+{
+  std::memset(fCounts, 0, fSize);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,217 @@
+/// \file SpecMATSimSnapshot.cc
+/// \brief Implementation of the SpecMATSimSnapshot class
+
+#include "SpecMATSimSnapshot.hh"
+#include "SpecMATSimUtils.hh"
+
+#include <sstream>
+#include <sys/time.h>
+
+namespace {
+  // Same binning as the energy histograms of the run action
+  const G4int kSnapshotNbBins = 15501;
+  const G4double kSnapshotBinWidth = 1.;   // keV
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimSnapshot::SpecMATSimSnapshot(G4int nbCrystals, const G4String& fileName,
+                                       G4int everyNEvents)
+ : fNbCrystals(nbCrystals),
+   fNbBins(kSnapshotNbBins),
+   fFileName(fileName),
+   fEveryNEvents(everyNEvents > 0 ? everyNEvents : 1),
+   fStartTime(0.),
+   fPendingReady(false),
+   fStop(false),
+   fWriterRunning(false),
+   fLastEvents(0),
+   fLastFired(0),
+   fLastElapsed(0.),
+   fNbWritten(0),
+   fNbFailed(0),
+   fNbSkipped(0)
+{
+  // crystals 1..N, then the total spectrum
+  fLive.events = 0;
+  fLive.fired = 0;
+  fLive.elapsed = 0.;
+  fLive.counts.assign((fNbCrystals+1)*fNbBins, 0);
+  fStartTime = Elapsed();
+
+  pthread_mutex_init(&fMutex, 0);
+  pthread_cond_init(&fCondition, 0);
+  fWriterRunning = (pthread_create(&fWriter, 0, &SpecMATSimSnapshot::RunWriter, this) == 0);
+  if (!fWriterRunning) {
+    G4cerr << "Cannot start the snapshot writer, only the final snapshot is written" << G4endl;
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimSnapshot::~SpecMATSimSnapshot()
+{
+  if (fWriterRunning) {
+    pthread_mutex_lock(&fMutex);
+    fStop = true;
+    pthread_cond_signal(&fCondition);
+    pthread_mutex_unlock(&fMutex);
+    pthread_join(fWriter, 0);
+  }
+  pthread_cond_destroy(&fCondition);
+  pthread_mutex_destroy(&fMutex);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimSnapshot::Elapsed() const
+{
+  struct timeval now;
+  gettimeofday(&now, 0);
+  return now.tv_sec + 1.e-6*now.tv_usec - fStartTime;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSnapshot::Fill(G4int copyNb, G4double energy)
+{
+  if (copyNb < 1 || copyNb > fNbCrystals) return;
+  G4int bin = G4int(energy/kSnapshotBinWidth);
+  if (bin < 0 || bin >= fNbBins) return;
+  fLive.counts[(copyNb-1)*fNbBins + bin]++;
+  fLive.counts[fNbCrystals*fNbBins + bin]++;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSnapshot::EndOfEvent(G4int nbFired)
+{
+  fLive.events++;
+  fLive.fired += nbFired;
+  if (fLive.events%fEveryNEvents != 0 || !fWriterRunning) return;
+
+  // The copy is the only work done in the event loop
+  fLive.elapsed = Elapsed();
+  pthread_mutex_lock(&fMutex);
+  if (fPendingReady) {
+    fNbSkipped++;
+  }
+  else {
+    fPending.events = fLive.events;
+    fPending.fired = fLive.fired;
+    fPending.elapsed = fLive.elapsed;
+    fPending.counts = fLive.counts;
+    fPendingReady = true;
+    pthread_cond_signal(&fCondition);
+  }
+  pthread_mutex_unlock(&fMutex);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void* SpecMATSimSnapshot::RunWriter(void* snapshot)
+{
+  static_cast<SpecMATSimSnapshot*>(snapshot)->WriterLoop();
+  return 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSnapshot::WriterLoop()
+{
+  while (true) {
+    pthread_mutex_lock(&fMutex);
+    while (!fPendingReady && !fStop) {
+      pthread_cond_wait(&fCondition, &fMutex);
+    }
+    if (!fPendingReady) {
+      pthread_mutex_unlock(&fMutex);
+      return;
+    }
+    fWriting.events = fPending.events;
+    fWriting.fired = fPending.fired;
+    fWriting.elapsed = fPending.elapsed;
+    fWriting.counts.swap(fPending.counts);
+    fPendingReady = false;
+    pthread_mutex_unlock(&fMutex);
+
+    Write(fWriting);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSnapshot::Write(const State& state)
+{
+  G4double interval = state.elapsed - fLastElapsed;
+  G4double eventRate = (state.elapsed > 0.) ? state.events/state.elapsed : 0.;
+  G4double firedRate = (state.elapsed > 0.) ? state.fired/state.elapsed : 0.;
+  G4double lastEventRate = (interval > 0.) ? (state.events - fLastEvents)/interval : 0.;
+  G4double lastFiredRate = (interval > 0.) ? (state.fired - fLastFired)/interval : 0.;
+
+  std::ostringstream out;
+  out << "{\n"
+      << "  \"events\": " << state.events << ",\n"
+      << "  \"elapsed_s\": " << state.elapsed << ",\n"
+      << "  \"eventRate\": " << eventRate << ",\n"
+      << "  \"firedCrystalRate\": " << firedRate << ",\n"
+      << "  \"intervalEventRate\": " << lastEventRate << ",\n"
+      << "  \"intervalFiredCrystalRate\": " << lastFiredRate << ",\n"
+      << "  \"binWidth_keV\": " << kSnapshotBinWidth << ",\n"
+      << "  \"firedPerCrystal\": [";
+  for (G4int crystal = 0; crystal < fNbCrystals; crystal++) {
+    unsigned long long sum = 0;
+    const unsigned int* counts = &state.counts[crystal*fNbBins];
+    for (G4int bin = 0; bin < fNbBins; bin++) sum += counts[bin];
+    out << (crystal ? ", " : "") << sum;
+  }
+  out << "],\n"
+      << "  \"spectra\": {";
+  for (G4int spectrum = 0; spectrum <= fNbCrystals; spectrum++) {
+    out << (spectrum ? "," : "") << "\n    \"";
+    if (spectrum == fNbCrystals) out << "Total";
+    else out << spectrum+1;
+    out << "\": [";
+    const unsigned int* counts = &state.counts[spectrum*fNbBins];
+    G4bool first = true;
+    for (G4int bin = 0; bin < fNbBins; bin++) {
+      if (counts[bin] == 0) continue;
+      out << (first ? "" : ",") << "[" << bin << "," << counts[bin] << "]";
+      first = false;
+    }
+    out << "]";
+  }
+  out << "\n  }\n"
+      << "}\n";
+
+  if (SpecMATSimUtils::WriteFileAtomically(fFileName, out.str())) fNbWritten++;
+  else fNbFailed++;
+
+  fLastEvents = state.events;
+  fLastFired = state.fired;
+  fLastElapsed = state.elapsed;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSnapshot::Finish()
+{
+  if (fWriterRunning) {
+    pthread_mutex_lock(&fMutex);
+    fStop = true;
+    pthread_cond_signal(&fCondition);
+    pthread_mutex_unlock(&fMutex);
+    pthread_join(fWriter, 0);
+    fWriterRunning = false;
+  }
+
+  fLive.elapsed = Elapsed();
+  Write(fLive);
+
+  G4cout << "Snapshots written to " << fFileName << ": " << fNbWritten;
+  if (fNbSkipped > 0) G4cout << ", skipped while the writer was busy: " << fNbSkipped;
+  if (fNbFailed > 0) G4cout << ", failed: " << fNbFailed;
+  G4cout << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,62 @@
+/// \file SpecMATSimSparseIO.cc
+/// \brief Implementation of the SpecMATSimSparseIO helpers
+
+#include "SpecMATSimSparseIO.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSparseIO::AppendVarint(std::string& buffer, unsigned long long value)
+{
+  while (value >= 0x80) {
+    buffer.push_back(static_cast<char>((value & 0x7f) | 0x80));
+    value >>= 7;
+  }
+  buffer.push_back(static_cast<char>(value));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+unsigned long long SpecMATSimSparseIO::ReadVarint(const std::string& buffer, size_t& pos)
+{
+  unsigned long long value = 0;
+  G4int shift = 0;
+  while (pos < buffer.size()) {
+    unsigned char byte = static_cast<unsigned char>(buffer[pos++]);
+    value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) break;
+    shift += 7;
+  }
+  return value;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+unsigned long long SpecMATSimSparseIO::ReadVarint(std::istream& in)
+{
+  unsigned long long value = 0;
+  G4int shift = 0;
+  char c;
+  while (in.get(c)) {
+    unsigned char byte = static_cast<unsigned char>(c);
+    value |= static_cast<unsigned long long>(byte & 0x7f) << shift;
+    if (!(byte & 0x80)) break;
+    shift += 7;
+  }
+  return value;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSparseIO::WriteRaw(std::ostream& out, const void* data, size_t size)
+{
+  out.write(static_cast<const char*>(data), size);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSparseIO::ReadRaw(std::istream& in, void* data, size_t size)
+{
+  in.read(static_cast<char*>(data), size);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
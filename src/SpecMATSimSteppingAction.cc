@@ -0,0 +1,93 @@
+/// \file SpecMATSimSteppingAction.cc
+/// \brief Implementation of the SpecMATSimSteppingAction class
+
+#include "SpecMATSimSteppingAction.hh"
+#include "SpecMATSimEventAction.hh"
+#include "SpecMATSimRunAction.hh"
+#include "SpecMATSimDetectorConstruction.hh"
+
+#include "G4Step.hh"
+#include "G4Track.hh"
+#include "G4VPhysicalVolume.hh"
+#include "G4LogicalVolume.hh"
+#include "G4OpticalPhoton.hh"
+#include "G4RunManager.hh"
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimSteppingAction::SpecMATSimSteppingAction(SpecMATSimEventAction* eventAction,
+                                                   SpecMATSimRunAction* runAction)
+ : G4UserSteppingAction(),
+   fEventAction(eventAction),
+   fRunAction(runAction),
+   fDetector(0),
+   fEnvelopeKill(false),
+   fEnvelopeTally(false)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimSteppingAction::~SpecMATSimSteppingAction()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSteppingAction::UserSteppingAction(const G4Step* step)
+{
+  if (!fDetector) {
+    fDetector = static_cast<const SpecMATSimDetectorConstruction*>(
+        G4RunManager::GetRunManager()->GetUserDetectorConstruction());
+    fEnvelopeKill = (fDetector->GetEnvelope() == "kill");
+    fEnvelopeTally = (fDetector->GetEnvelope() == "tally");
+  }
+  if (fEnvelopeKill || fEnvelopeTally) {
+    TrackEnvelope(step);
+    if (step->GetTrack()->GetTrackStatus() == fStopAndKill) return;
+  }
+
+  G4Track* track = step->GetTrack();
+  if (track->GetDefinition() != G4OpticalPhoton::OpticalPhotonDefinition()) return;
+
+  // Photon transmitted into the quartz window counts as collected
+  G4StepPoint* postStepPoint = step->GetPostStepPoint();
+  if (postStepPoint->GetStepStatus() != fGeomBoundary) return;
+  G4VPhysicalVolume* volume = postStepPoint->GetPhysicalVolume();
+  if (volume && volume->GetLogicalVolume()->GetName() == "sciWindLog") {
+    fEventAction->AddDetectedPhoton();
+    track->SetTrackStatus(fStopAndKill);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimSteppingAction::TrackEnvelope(const G4Step* step)
+{
+  G4StepPoint* preStepPoint = step->GetPreStepPoint();
+  G4StepPoint* postStepPoint = step->GetPostStepPoint();
+  G4bool preInShell = fDetector->IsKillShell(preStepPoint->GetPhysicalVolume()->GetLogicalVolume());
+
+  // Steps in the shell or beyond it are the ones the kill policy saves
+  G4bool beyond = fEnvelopeTally
+                  && (preInShell || !fDetector->IsInsideEnvelope(preStepPoint->GetPosition()));
+  fRunAction->CountEnvelopeStep(beyond);
+
+  if (postStepPoint->GetStepStatus() != fGeomBoundary) return;
+  G4VPhysicalVolume* postVolume = postStepPoint->GetPhysicalVolume();
+  G4bool postInShell = postVolume && fDetector->IsKillShell(postVolume->GetLogicalVolume());
+
+  if (!preInShell && postInShell && fDetector->IsInsideEnvelope(preStepPoint->GetPosition())) {
+    fRunAction->CountEnvelopeCrossing();
+    if (fEnvelopeKill) {
+      step->GetTrack()->SetTrackStatus(fStopAndKill);
+      fRunAction->CountEnvelopeKill(step->GetTrack()->GetCurrentStepNumber());
+    }
+  }
+  else if (preInShell && !postInShell && fDetector->IsInsideEnvelope(postStepPoint->GetPosition())) {
+    // back from the world, only possible with the tally policy
+    fRunAction->CountEnvelopeReturn();
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,146 @@
+/// \file SpecMATSimTrigger.cc
+/// \brief Implementation of the SpecMATSimTrigger class
+
+#include "SpecMATSimTrigger.hh"
+
+#include "G4SystemOfUnits.hh"
+
+#include <sstream>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimTrigger::SpecMATSimTrigger()
+ : fThreshold(0.),
+   fMinMultiplicity(1),
+   fMaxMultiplicity(0),
+   fNbAccepted(0),
+   fNbEmpty(0),
+   fNbMultiplicity(0),
+   fNbSum(0)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimTrigger::~SpecMATSimTrigger()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimTrigger::Accept(const std::map<G4int, G4double>& energies,
+                                 std::map<G4int, G4double>& fired)
+{
+  fired.clear();
+  if (energies.empty() && fMinMultiplicity > 0) {
+    fNbEmpty++;
+    return false;
+  }
+
+  G4double sum = 0.;
+  std::map<G4int, G4double>::const_iterator it;
+  for (it = energies.begin(); it != energies.end(); it++) {
+    G4double threshold = fThreshold;
+    if (!fCrystalThresholds.empty()) {
+      std::map<G4int, G4double>::const_iterator crystal = fCrystalThresholds.find(it->first);
+      if (crystal != fCrystalThresholds.end()) threshold = crystal->second;
+    }
+    if (it->second*keV > threshold) {
+      fired[it->first] = it->second;
+      sum += it->second*keV;
+    }
+  }
+
+  G4int multiplicity = fired.size();
+  if (multiplicity < fMinMultiplicity
+      || (fMaxMultiplicity > 0 && multiplicity > fMaxMultiplicity)) {
+    if (multiplicity == 0) fNbEmpty++;
+    else fNbMultiplicity++;
+    return false;
+  }
+
+  if (!fSumWindows.empty()) {
+    G4bool inside = false;
+    for (size_t i = 0; i < fSumWindows.size() && !inside; i++) {
+      inside = (sum >= fSumWindows[i].first && sum <= fSumWindows[i].second);
+    }
+    if (!inside) {
+      fNbSum++;
+      return false;
+    }
+  }
+
+  fNbAccepted++;
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimTrigger::GetKey() const
+{
+  std::ostringstream key;
+  key << "threshold " << fThreshold/keV
+      << " multiplicity " << fMinMultiplicity << " " << fMaxMultiplicity;
+  std::map<G4int, G4double>::const_iterator it;
+  for (it = fCrystalThresholds.begin(); it != fCrystalThresholds.end(); it++) {
+    key << " crystal " << it->first << " " << it->second/keV;
+  }
+  for (size_t i = 0; i < fSumWindows.size(); i++) {
+    key << " window " << fSumWindows[i].first/keV << " " << fSumWindows[i].second/keV;
+  }
+  return key.str();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimTrigger::ResetCounters()
+{
+  fNbAccepted = 0;
+  fNbEmpty = 0;
+  fNbMultiplicity = 0;
+  fNbSum = 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimTrigger::GetCounters(G4long counters[4]) const
+{
+  counters[0] = fNbAccepted;
+  counters[1] = fNbEmpty;
+  counters[2] = fNbMultiplicity;
+  counters[3] = fNbSum;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimTrigger::AddCounters(const G4long counters[4])
+{
+  fNbAccepted += counters[0];
+  fNbEmpty += counters[1];
+  fNbMultiplicity += counters[2];
+  fNbSum += counters[3];
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimTrigger::PrintCounters() const
+{
+  G4long total = fNbAccepted + GetNbRejected();
+  G4cout
+     << "\n--------------------Trigger---------------------------------\n"
+     << " Accepted events: " << fNbAccepted;
+  if (total > 0) G4cout << " (" << 100.*fNbAccepted/total << " %)";
+  G4cout
+     << "\n Rejected events: " << GetNbRejected()
+     << "\n   no crystal above threshold: " << fNbEmpty
+     << "\n   multiplicity outside [" << fMinMultiplicity << ", ";
+  if (fMaxMultiplicity > 0) G4cout << fMaxMultiplicity;
+  else G4cout << "inf";
+  G4cout
+     << "]: " << fNbMultiplicity
+     << "\n   sum energy outside the windows: " << fNbSum
+     << "\n------------------------------------------------------------\n"
+     << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
@@ -0,0 +1,209 @@
+/// \file SpecMATSimUtils.cc
+/// \brief Implementation of the SpecMATSimUtils helpers
+
+#include "SpecMATSimUtils.hh"
+
+#include <cstdio>
+#include <fstream>
+#include <sstream>
+#include <cerrno>
+#include <sys/stat.h>
+#include <sys/types.h>
+#include <sys/resource.h>
+#include <unistd.h>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimUtils::Hash(const G4String& text)
+{
+  unsigned long long hash = 14695981039346656037ULL;
+  for (size_t i = 0; i < text.size(); i++) {
+    hash ^= (unsigned char)text[i];
+    hash *= 1099511628211ULL;
+  }
+
+  char digits[17];
+  std::sprintf(digits, "%016llx", hash);
+  return G4String(digits);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimUtils::FileExists(const G4String& fileName)
+{
+  struct stat info;
+  return stat(fileName.c_str(), &info) == 0 && S_ISREG(info.st_mode);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimUtils::MakeDirectory(const G4String& dirName)
+{
+  if (mkdir(dirName.c_str(), 0755) == 0) return true;
+  struct stat info;
+  return errno == EEXIST && stat(dirName.c_str(), &info) == 0 && S_ISDIR(info.st_mode);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimUtils::WriteFileAtomically(const G4String& fileName, const std::string& content)
+{
+  G4String tmpFileName = fileName + ".tmp";
+  std::ofstream out(tmpFileName.c_str(), std::ios::binary);
+  out.write(content.data(), content.size());
+  out.close();
+  if (!out) {
+    std::remove(tmpFileName.c_str());
+    return false;
+  }
+  return std::rename(tmpFileName.c_str(), fileName.c_str()) == 0;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimUtils::ReadFile(const G4String& fileName, std::string& content)
+{
+  std::ifstream in(fileName.c_str(), std::ios::binary);
+  if (!in) return false;
+  std::ostringstream text;
+  text << in.rdbuf();
+  content = text.str();
+  return !in.bad();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4long SpecMATSimUtils::FileSize(const G4String& fileName)
+{
+  struct stat info;
+  if (stat(fileName.c_str(), &info) != 0) return -1;
+  return G4long(info.st_size);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimUtils::CopyFile(const G4String& from, const G4String& to)
+{
+  std::string content;
+  return ReadFile(from, content) && WriteFileAtomically(to, content);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimUtils::ExecutableHash()
+{
+  static G4String hash;
+  if (hash == "") {
+    std::string binary;
+    hash = ReadFile("/proc/self/exe", binary) ? Hash(binary) : G4String(__DATE__ " " __TIME__);
+  }
+  return hash;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimUtils::EventSeeds(long base, G4int eventNb, long seeds[2])
+{
+  // splitmix64 step from the base in the high and the event in the low word
+  unsigned long long z = Mix64(((unsigned long long)base << 32) + (unsigned int)eventNb);
+  // valid ranges of the two Ranecu seeds
+  seeds[0] = 1 + long((z & 0x7FFFFFFFULL)%2147483562ULL);
+  seeds[1] = 1 + long(((z >> 32) & 0x7FFFFFFFULL)%2147483398ULL);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+unsigned long long SpecMATSimUtils::Mix64(unsigned long long z)
+{
+  z += 0x9E3779B97F4A7C15ULL;
+  z = (z ^ (z >> 30))*0xBF58476D1CE4E5B9ULL;
+  z = (z ^ (z >> 27))*0x94D049BB133111EBULL;
+  return z ^ (z >> 31);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimUtils::ParseEventList(const G4String& text, std::vector<G4int>& events)
+{
+  events.clear();
+  std::istringstream items(text);
+  std::string item;
+  while (std::getline(items, item, ',')) {
+    long first = 0, last = 0;
+    char dash = 0, rest = 0;
+    std::istringstream range(item);
+    if (!(range >> first) || first < 0) return false;
+    last = first;
+    if (range >> dash && (dash != '-' || !(range >> last) || last < first || range >> rest)) {
+      return false;
+    }
+    for (long event = first; event <= last; event++) events.push_back(G4int(event));
+  }
+  return !events.empty();
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4long SpecMATSimUtils::PeakRSS()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_SELF, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return G4long(usage.ru_maxrss);
+#else
+  return G4long(usage.ru_maxrss)*1024;
+#endif
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4double SpecMATSimUtils::ChildrenCPUTime()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_CHILDREN, &usage) != 0) return 0.;
+  return usage.ru_utime.tv_sec + 1e-6*usage.ru_utime.tv_usec
+         + usage.ru_stime.tv_sec + 1e-6*usage.ru_stime.tv_usec;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4long SpecMATSimUtils::ChildrenPeakRSS()
+{
+  struct rusage usage;
+  if (getrusage(RUSAGE_CHILDREN, &usage) != 0) return 0;
+#ifdef __APPLE__
+  return G4long(usage.ru_maxrss);
+#else
+  return G4long(usage.ru_maxrss)*1024;
+#endif
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4long SpecMATSimUtils::CurrentRSS()
+{
+  // second field of /proc/self/statm: resident pages
+  std::ifstream statm("/proc/self/statm");
+  G4long size = 0, resident = 0;
+  if (!(statm >> size >> resident)) return 0;
+  return resident*sysconf(_SC_PAGESIZE);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4String SpecMATSimUtils::JsonEscape(const G4String& text)
+{
+  G4String escaped;
+  for (size_t i = 0; i < text.size(); i++) {
+    char c = text[i];
+    if (c == '"' || c == '\\') escaped += '\\';
+    if (c == '\n') {
+      escaped += "\\n";
+      continue;
+    }
+    escaped += c;
+  }
+  return escaped;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
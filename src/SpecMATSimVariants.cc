@@ -0,0 +1,302 @@
+/// \file SpecMATSimVariants.cc
+/// \brief Implementation of the SpecMATSimVariants class
+
+#include "SpecMATSimVariants.hh"
+#include "SpecMATSimDetectorConstruction.hh"
+#include "SpecMATSimPrimaryGeneratorAction.hh"
+#include "SpecMATSimRunAction.hh"
+#include "SpecMATSimUtils.hh"
+
+#include "G4RunManager.hh"
+#include "G4Material.hh"
+#include "G4UIcommand.hh"
+#include "G4SystemOfUnits.hh"
+
+#include <cmath>
+#include <fstream>
+#include <sstream>
+#include <iomanip>
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimVariants::SpecMATSimVariants(SpecMATSimDetectorConstruction* detector,
+                                       SpecMATSimPrimaryGeneratorAction* generator,
+                                       SpecMATSimRunAction* runAction)
+ : fDetector(detector),
+   fGenerator(generator),
+   fRunAction(runAction)
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+SpecMATSimVariants::~SpecMATSimVariants()
+{
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimVariants::Read(const G4String& fileName)
+{
+  std::ifstream in(fileName.c_str());
+  if (!in) {
+    G4cerr << "Cannot read the variants file " << fileName << G4endl;
+    return false;
+  }
+
+  SaveDefaults();
+  fVariants.clear();
+  std::string line;
+  G4int lineNb = 0;
+  while (std::getline(in, line)) {
+    lineNb++;
+    line = line.substr(0, line.find('#'));
+    std::istringstream words(line);
+    std::string word;
+    if (!(words >> word)) continue;
+
+    Variant variant;
+    variant.name = word;
+    while (words >> word) {
+      size_t equal = word.find('=');
+      Setting setting(word.substr(0, equal), (equal == std::string::npos) ? "" : word.substr(equal+1));
+      if (!IsKnown(setting.first) || setting.second == "") {
+        G4cerr << fileName << ":" << lineNb << ": unknown setting " << word << G4endl;
+        return false;
+      }
+      // SetSciCrystMat() keeps the old material for an unknown one
+      if (setting.first == "sciCrystMat" && !G4Material::GetMaterial(setting.second, false)) {
+        G4cerr << fileName << ":" << lineNb << ": crystal material " << setting.second
+               << " is not defined" << G4endl;
+        return false;
+      }
+      variant.settings.push_back(setting);
+    }
+    fVariants.push_back(variant);
+  }
+
+  if (fVariants.empty()) {
+    G4cerr << fileName << " has no variants" << G4endl;
+    return false;
+  }
+  return true;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+G4bool SpecMATSimVariants::IsKnown(const G4String& key) const
+{
+  return key == "sciCrystSize" || key == "sciCrystSizeX" || key == "sciCrystSizeY"
+      || key == "sciCrystSizeZ" || key == "sciCrystMat" || key == "vacuumChamber"
+      || key == "vacuumFlangeThickFrontOfScint" || key == "nbSegments"
+      || key == "nbCrystInSegmentRow" || key == "nbCrystInSegmentColumn"
+      || key == "sciReflWallThick" || key == "sciReflWallThickX" || key == "sciReflWallThickY"
+      || key == "sciReflWindThick" || key == "sciHousWallThick" || key == "sciHousWallThickX"
+      || key == "sciHousWallThickY" || key == "sciHousWindThick";
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimVariants::SaveDefaults()
+{
+  fDefaults.name = "defaults";
+  fDefaults.settings.clear();
+  fDefaults.settings.push_back(Setting("sciCrystSizeX", G4UIcommand::ConvertToString(fDetector->GetSciCrystSizeX()/mm)));
+  fDefaults.settings.push_back(Setting("sciCrystSizeY", G4UIcommand::ConvertToString(fDetector->GetSciCrystSizeY()/mm)));
+  fDefaults.settings.push_back(Setting("sciCrystSizeZ", G4UIcommand::ConvertToString(fDetector->GetSciCrystSizeZ()/mm)));
+  fDefaults.settings.push_back(Setting("sciCrystMat", fDetector->GetSciCrystMat()->GetName()));
+  fDefaults.settings.push_back(Setting("vacuumChamber", fDetector->GetVacuumChamber()));
+  fDefaults.settings.push_back(Setting("vacuumFlangeThickFrontOfScint",
+                                       G4UIcommand::ConvertToString(fDetector->GetVacuumFlangeThickFrontOfScint()/mm)));
+  fDefaults.settings.push_back(Setting("nbSegments", G4UIcommand::ConvertToString(G4int(fDetector->GetNbSegments()))));
+  fDefaults.settings.push_back(Setting("nbCrystInSegmentRow", G4UIcommand::ConvertToString(G4int(fDetector->GetNbCrystInSegmentRow()))));
+  fDefaults.settings.push_back(Setting("nbCrystInSegmentColumn", G4UIcommand::ConvertToString(G4int(fDetector->GetNbCrystInSegmentColumn()))));
+  fDefaults.settings.push_back(Setting("sciReflWallThickX", G4UIcommand::ConvertToString(fDetector->GetSciReflWallThickX()/mm)));
+  fDefaults.settings.push_back(Setting("sciReflWallThickY", G4UIcommand::ConvertToString(fDetector->GetSciReflWallThickY()/mm)));
+  fDefaults.settings.push_back(Setting("sciReflWindThick", G4UIcommand::ConvertToString(fDetector->GetSciReflWindThick()/mm)));
+  fDefaults.settings.push_back(Setting("sciHousWallThickX", G4UIcommand::ConvertToString(fDetector->GetSciHousWallThickX()/mm)));
+  fDefaults.settings.push_back(Setting("sciHousWallThickY", G4UIcommand::ConvertToString(fDetector->GetSciHousWallThickY()/mm)));
+  fDefaults.settings.push_back(Setting("sciHousWindThick", G4UIcommand::ConvertToString(fDetector->GetSciHousWindThick()/mm)));
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimVariants::Apply(const Variant& variant) const
+{
+  Apply(variant.settings);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimVariants::Apply(const std::vector<Setting>& variantSettings) const
+{
+  // Every variant starts from the defaults, settings do not carry over
+  std::vector<Setting> settings = fDefaults.settings;
+  settings.insert(settings.end(), variantSettings.begin(), variantSettings.end());
+
+  for (size_t i = 0; i < settings.size(); i++) {
+    const G4String& key = settings[i].first;
+    const G4String& value = settings[i].second;
+    G4double length = G4UIcommand::ConvertToDouble(value)*mm;
+    if (key == "sciCrystSize") {
+      fDetector->SetSciCrystSizeX(length);
+      fDetector->SetSciCrystSizeY(length);
+      fDetector->SetSciCrystSizeZ(length);
+    }
+    else if (key == "sciCrystSizeX") fDetector->SetSciCrystSizeX(length);
+    else if (key == "sciCrystSizeY") fDetector->SetSciCrystSizeY(length);
+    else if (key == "sciCrystSizeZ") fDetector->SetSciCrystSizeZ(length);
+    else if (key == "sciCrystMat") fDetector->SetSciCrystMat(value);
+    else if (key == "vacuumChamber") fDetector->SetVacuumChamber(value);
+    else if (key == "vacuumFlangeThickFrontOfScint") fDetector->SetVacuumFlangeThickFrontOfScint(length);
+    else if (key == "nbSegments") fDetector->SetNbSegments(G4UIcommand::ConvertToInt(value));
+    else if (key == "nbCrystInSegmentRow") fDetector->SetNbCrystInSegmentRow(G4UIcommand::ConvertToInt(value));
+    else if (key == "nbCrystInSegmentColumn") fDetector->SetNbCrystInSegmentColumn(G4UIcommand::ConvertToInt(value));
+    else if (key == "sciReflWallThick") {
+      fDetector->SetSciReflWallThickX(length);
+      fDetector->SetSciReflWallThickY(length);
+    }
+    else if (key == "sciReflWallThickX") fDetector->SetSciReflWallThickX(length);
+    else if (key == "sciReflWallThickY") fDetector->SetSciReflWallThickY(length);
+    else if (key == "sciReflWindThick") fDetector->SetSciReflWindThick(length);
+    else if (key == "sciHousWallThick") {
+      fDetector->SetSciHousWallThickX(length);
+      fDetector->SetSciHousWallThickY(length);
+    }
+    else if (key == "sciHousWallThickX") fDetector->SetSciHousWallThickX(length);
+    else if (key == "sciHousWallThickY") fDetector->SetSciHousWallThickY(length);
+    else if (key == "sciHousWindThick") fDetector->SetSciHousWindThick(length);
+  }
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimVariants::Run(G4int nbEvents, long seedBase, const G4String& baseName)
+{
+  if (fVariants.size() < 2) {
+    G4cerr << "Correlated variants need a reference and at least one variant" << G4endl;
+    return;
+  }
+  // A geometry read from GDML ignores the settings, while the run action
+  // would size the spectra from the array size of the settings
+  if (fDetector->GetGdmlGeometry() == "read") {
+    for (size_t i = 0; i < fVariants.size(); i++) {
+      if (!fVariants[i].settings.empty()) {
+        G4cerr << "Variant " << fVariants[i].name << " has settings, which a geometry read"
+               << " from GDML ignores; use gdmlGeometry \"no\" or \"cache\"" << G4endl;
+        return;
+      }
+    }
+  }
+
+  G4String base = (baseName != "") ? baseName : G4String("variants");
+  fRunAction->SetRecordEvents(true);
+  fGenerator->SetEventSeeding(true, seedBase);
+
+  std::vector<std::vector<unsigned char> > records;
+  for (size_t i = 0; i < fVariants.size(); i++) {
+    G4cout << "\n### Variant " << fVariants[i].name
+           << (i == 0 ? " (reference)" : "") << G4endl;
+    Apply(fVariants[i]);
+    fDetector->UpdateGeometry();
+    fGenerator->ResetSource();
+    fRunAction->SetOutputName(base + "_" + fVariants[i].name);
+    G4RunManager::GetRunManager()->BeamOn(nbEvents);
+    records.push_back(fRunAction->GetEventRecord());
+  }
+
+  fRunAction->SetRecordEvents(false);
+  fGenerator->SetEventSeeding(false);
+  fRunAction->SetOutputName(baseName);
+
+  Report(records, seedBase, base);
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......
+
+void SpecMATSimVariants::Report(const std::vector<std::vector<unsigned char> >& records,
+                                long seedBase, const G4String& baseName) const
+{
+  const char* const metricNames[] = { "detection", "fullEnergy" };
+  const G4int nbMetrics = 2;
+  const std::vector<unsigned char>& reference = records[0];
+  G4double n = reference.size();
+  if (n < 2) return;
+
+  // Per variant and metric: efficiency, its binomial variance, and the mean
+  // and variance of the event-by-event difference to the reference
+  size_t nbVariants = records.size();
+  std::vector<G4double> efficiency(nbVariants*nbMetrics), variance(nbVariants*nbMetrics);
+  std::vector<G4double> difference(nbVariants*nbMetrics), differenceVariance(nbVariants*nbMetrics);
+  for (size_t v = 0; v < nbVariants; v++) {
+    for (G4int m = 0; m < nbMetrics; m++) {
+      G4double count = 0., sum = 0., sum2 = 0.;
+      for (size_t i = 0; i < records[v].size(); i++) {
+        G4int x = (records[v][i] >> m) & 1, x0 = (reference[i] >> m) & 1;
+        count += x;
+        sum += x - x0;
+        sum2 += (x - x0)*(x - x0);
+      }
+      size_t k = v*nbMetrics + m;
+      efficiency[k] = count/n;
+      variance[k] = efficiency[k]*(1. - efficiency[k])/n;
+      difference[k] = sum/n;
+      differenceVariance[k] = (sum2/n - difference[k]*difference[k])/(n - 1.);
+    }
+  }
+
+  G4cout
+     << "\n--------------------Correlated variants---------------------\n"
+     << " " << reference.size() << " events per variant, seed base " << seedBase << "\n"
+     << std::setw(16) << std::left << " variant" << std::right
+     << std::setw(26) << "detection" << std::setw(26) << "full energy";
+  for (size_t v = 0; v < nbVariants; v++) {
+    G4cout << "\n " << std::setw(15) << std::left << fVariants[v].name << std::right;
+    for (G4int m = 0; m < nbMetrics; m++) {
+      size_t k = v*nbMetrics + m;
+      G4cout << std::setw(14) << efficiency[k] << " +- " << std::setw(8) << std::sqrt(variance[k]);
+    }
+  }
+  G4cout << "\n Differences to " << fVariants[0].name
+         << " (error of independent runs, variance reduction):";
+  for (size_t v = 1; v < nbVariants; v++) {
+    G4cout << "\n " << fVariants[v].name;
+    for (G4int m = 0; m < nbMetrics; m++) {
+      size_t k = v*nbMetrics + m;
+      G4double independentVariance = variance[k] + variance[m];
+      G4cout << "\n   " << std::setw(12) << std::left << metricNames[m] << std::right
+             << difference[k] << " +- " << std::sqrt(differenceVariance[k])
+             << " (" << std::sqrt(independentVariance);
+      if (differenceVariance[k] > 0.) G4cout << ", x" << independentVariance/differenceVariance[k];
+      G4cout << ")";
+    }
+  }
+  G4cout << "\n------------------------------------------------------------\n"
+         << G4endl;
+
+  G4String fileName = baseName + "_variants.json";
+  std::ofstream json(fileName.c_str());
+  json << "{\n"
+       << "  \"events\": " << reference.size() << ",\n"
+       << "  \"seedBase\": " << seedBase << ",\n"
+       << "  \"reference\": \"" << SpecMATSimUtils::JsonEscape(fVariants[0].name) << "\",\n"
+       << "  \"variants\": [";
+  for (size_t v = 0; v < nbVariants; v++) {
+    json << (v ? "," : "") << "\n    {\"name\": \"" << SpecMATSimUtils::JsonEscape(fVariants[v].name) << "\"";
+    for (G4int m = 0; m < nbMetrics; m++) {
+      size_t k = v*nbMetrics + m;
+      json << ", \"" << metricNames[m] << "\": " << efficiency[k]
+           << ", \"" << metricNames[m] << "Variance\": " << variance[k];
+      if (v == 0) continue;
+      json << ", \"" << metricNames[m] << "Difference\": " << difference[k]
+           << ", \"" << metricNames[m] << "DifferenceVariance\": " << differenceVariance[k]
+           << ", \"" << metricNames[m] << "IndependentVariance\": " << variance[k] + variance[m];
+    }
+    json << "}";
+  }
+  json << "\n  ]\n}\n";
+  json.close();
+  G4cout << "Variant comparison written to " << fileName << G4endl;
+}
+
+//....oooOO0OOooo........oooOO0OOooo........oooOO0OOooo........oooOO0OOooo......